@@ -4,9 +4,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/fcntl.h>
+#include <fcntl.h>
+#include <stdint.h>
 
 #define BUFMAX 256
 #define DBFILE "db20"
+#define MAXSHARDS 64
+#define VIEW_BATCH 256 // records read at a time by view_db
 
 struct record_t {
 	int acctnum;
@@ -19,6 +23,8 @@ void print_help();
 void parse_string(char *, char * [], int, char *);
 void print_record(struct record_t);
 int seek_record(int);
+int shard_of(int, int);
+int split_db(int);
 void view_db(int);
 int update_record(int, float);
 int write_record(int, char *, float, int);
@@ -27,6 +33,7 @@ void print_help() {
 	printf("help\n");
 	printf("print <acctnum:int>\n");
 	printf("quit\n");
+	printf("split <nshards:int>\n");
 	printf("viewdb <rperpage:int>\n");
 	printf("update <acctnum:int> <value:float>\n");
 	printf("write <acctnum:int> <name:str> <value:float> <age:int>\n");
@@ -109,33 +116,90 @@ int update_record(int acctnum, float value) {
 	return rval;
 }
 
-void view_db(int rperpage) {
+// MUST agree with shard_of in the client and server
+int shard_of(int acctnum, int n) {
+	uint32_t h = (uint32_t)acctnum;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return (int)(h % (uint32_t)n);
+}
+
+// writes the records owned by each shard to DBFILE.shard-<n>
+int split_db(int nshards) {
+	if (nshards < 1 || nshards > MAXSHARDS) {
+		printf("Error: nshards must be between 1 and %d\n", MAXSHARDS);
+		return -1;
+	}
+
 	int fd = open(DBFILE, O_RDONLY);
 	if (fd < 0) {
 		perror("open error");
-		return;
+		return -1;
+	}
+
+	int out[MAXSHARDS];
+	char path[BUFMAX];
+	for (int i = 0; i < nshards; i++) {
+		snprintf(path, sizeof(path), "%s.shard-%d", DBFILE, i);
+		if ((out[i] = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0664)) < 0) {
+			perror("open error");
+			while (i-- > 0) {
+				close(out[i]);
+			}
+			close(fd);
+			return -1;
+		}
 	}
 
-	char input[1];
-	char page[rperpage*sizeof(struct record_t)];
 	struct record_t record;
+	while (read(fd, &record, sizeof(struct record_t)) == sizeof(struct record_t)) {
+		write(out[shard_of(record.acctnum, nshards)], &record, sizeof(struct record_t));
+	}
 
+	for (int i = 0; i < nshards; i++) {
+		close(out[i]);
+	}
+	close(fd);
+	return 0;
+}
+
+// reads the file in batches of VIEW_BATCH records whatever the page
+//	size, with the kernel reading ahead, and pages the output
+void view_db(int rperpage) {
+	if (rperpage < 1) {
+		printf("Error: rperpage must be at least 1\n");
+		return;
+	}
+
+	int fd = open(DBFILE, O_RDONLY);
+	if (fd < 0) {
+		perror("open error");
+		return;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	struct record_t batch[VIEW_BATCH];
 	ssize_t bytes_read = 0;
-	int pnum = 0;
-	do {
-		bytes_read = read(fd, page, rperpage*sizeof(struct record_t));
-		
-		if (bytes_read > 0) {
-			printf("Page Number: %d\n", pnum+1);
-			for (ssize_t bmark = 0; bmark < bytes_read; bmark += sizeof(struct record_t)) {
-				memcpy(&record, &page[bmark], sizeof(struct record_t));
-				print_record(record);
+	int nrecs = 0;
+	while ((bytes_read = read(fd, batch, sizeof(batch))) >= (ssize_t)sizeof(struct record_t)) {
+		for (int r = 0; r < bytes_read / (ssize_t)sizeof(struct record_t); r++, nrecs++) {
+			if (nrecs % rperpage == 0) {
+				if (nrecs > 0) {
+					printf("press any key to continue...\n");
+					getc(stdin);
+				}
+				printf("Page Number: %d\n", nrecs / rperpage + 1);
 			}
-			printf("press any key to continue...\n");
-			getc(stdin);
+			print_record(batch[r]);
 		}
-		pnum++;
-	} while (bytes_read > 0);
+	}
+	if (nrecs > 0) {
+		printf("press any key to continue...\n");
+		getc(stdin);
+	}
 
 	close(fd);
 }
@@ -179,6 +243,8 @@ int main(int argc, char * argv) {
 		// seek, view, update, write, help, quit
 		if (strcmp(tokens[0], "print") == 0) {
 			seek_record(atoi(tokens[1]));
+		} else if (strcmp(tokens[0], "split") == 0) {
+			split_db(atoi(tokens[1]));
 		} else if (strcmp(tokens[0], "viewdb") == 0) { 
 			view_db(atoi(tokens[1]));
 		} else if (strcmp(tokens[0], "update") == 0) {
@@ -0,0 +1,275 @@
+/**
+ * Implements admission control, see admit.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "admit.h"
+#include "metrics.h"
+
+// rate limiter defines
+#define BUCKET_PROBES 8 // slots searched before evicting an address
+#define LOCK_SPINS 64 // yields waiting for the limiter before checking on its holder
+
+// token bucket of one client address
+struct bucket_t {
+	in_addr_t addr; // 0 when unused
+	double tokens;
+	double last; // time of the last refill, in seconds
+};
+
+// the rate limiter, shared by every worker process
+struct limiter_t {
+	pid_t holder; // the worker holding the limiter, 0 when free
+	struct bucket_t buckets[ADMIT_BUCKETS];
+};
+
+static struct limiter_t * limiter = NULL;
+static double rate = 0; // requests per second per client, 0 for unlimited
+static double burst = 0; // bucket capacity
+
+//
+// PROTOTYPES
+//
+
+static struct bucket_t * find_bucket(in_addr_t, double);
+static void limiter_lock();
+static double now();
+
+//
+// METHODS
+//
+
+/**
+ * Gets the monotonic time.
+ * @returns The time in seconds.
+ */
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Sets up the rate limiter. MUST be called before the server forks.
+ * @param r The requests per second allowed per client, 0 for no limit.
+ * @param b The requests a client may burst above the rate.
+ * @returns 0 on success, -1 on error.
+ */
+int admit_init(double r, int b) {
+	rate = r;
+	burst = b > 0 ? b : 1;
+	if (rate <= 0) {
+		return 0;
+	}
+
+	void * addr = mmap(NULL, sizeof(struct limiter_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+
+	limiter = addr;
+	return 0;
+}
+
+/**
+ * Finds the bucket of a client, claiming one if it has none. Evicts
+ * the least recently used of the probed buckets when all are taken.
+ * MUST hold the limiter lock.
+ * @param addr The client address.
+ * @param t The current time.
+ * @returns The bucket.
+ */
+static struct bucket_t * find_bucket(in_addr_t addr, double t) {
+	uint32_t h = (uint32_t)addr * 2654435761u;
+	struct bucket_t * victim = NULL;
+
+	for (int i = 0; i < BUCKET_PROBES; i++) {
+		struct bucket_t * b = &limiter->buckets[(h + i) % ADMIT_BUCKETS];
+		if (b->addr == addr) {
+			return b;
+		}
+		if (b->addr == 0) {
+			victim = b;
+			break;
+		}
+		if (victim == NULL || b->last < victim->last) {
+			victim = b;
+		}
+	}
+
+	// new clients start with a full bucket
+	victim->addr = addr;
+	victim->tokens = burst;
+	victim->last = t;
+	return victim;
+}
+
+/**
+ * Locks the limiter. A worker killed while holding it never gives it
+ * back, so after LOCK_SPINS yields a waiter checks that the holder is
+ * still alive and takes the lock over from a dead one. Its bucket may
+ * be left half refilled, which costs the client a few tokens at most.
+ */
+static void limiter_lock() {
+	pid_t self = getpid(), holder = 0;
+	for (int spins = 0; !__atomic_compare_exchange_n(&limiter->holder, &holder, self, 0,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED); spins++) {
+		if (spins >= LOCK_SPINS && holder != 0 && kill(holder, 0) < 0 && errno == ESRCH
+				&& __atomic_compare_exchange_n(&limiter->holder, &holder, self, 0,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			METRIC_ADD(limiter_recovered, 1);
+			return;
+		}
+		holder = 0;
+		sched_yield();
+	}
+}
+
+/**
+ * Takes tokens for a batch of requests from a client's bucket.
+ * @param addr The client address.
+ * @param n The number of requests in the batch.
+ * @returns The number of requests admitted, the rest MUST be shed.
+ */
+int admit_take(struct in_addr addr, int n) {
+	if (limiter == NULL) {
+		return n;
+	}
+
+	double t = now();
+	limiter_lock();
+
+	struct bucket_t * b = find_bucket(addr.s_addr, t);
+	b->tokens += (t - b->last) * rate;
+	if (b->tokens > burst) {
+		b->tokens = burst;
+	}
+	b->last = t;
+
+	int admitted = b->tokens >= n ? n : (int)b->tokens;
+	b->tokens -= admitted;
+
+	__atomic_store_n(&limiter->holder, 0, __ATOMIC_RELEASE);
+
+	if (admitted < n) {
+		METRIC_ADD(shed_requests, n - admitted);
+	}
+	return admitted;
+}
+
+/**
+ * Encodes a busy response.
+ * @param pkt The packet to overwrite with the response.
+ */
+void encode_busy(struct pkt_t * pkt) {
+	memset(pkt, 0, sizeof(*pkt));
+	pkt->ptype = htons(PTYPE_BUSY);
+	strcpy(pkt->body.message, "Server busy, try again later!");
+}
+
+/**
+ * Sheds a connection the server has no room for. Sends a busy reply
+ * without waiting on the client and closes the connection.
+ * @param sk The connected socket.
+ */
+void admit_shed(int sk) {
+	struct pkt_t pkt;
+	encode_busy(&pkt);
+	send(sk, &pkt, sizeof(pkt), MSG_DONTWAIT | MSG_NOSIGNAL);
+	close(sk);
+	METRIC_ADD(shed_conns, 1);
+}
+
+/**
+ * Sets up an empty connection queue.
+ * @param q The queue.
+ * @param cap The most connections the queue holds.
+ * @param timeout The ms a connection may wait before it is shed.
+ * @returns 0 on success, -1 on error.
+ */
+int connq_init(struct connq_t * q, int cap, int timeout) {
+	q->head = q->count = 0;
+	q->cap = cap;
+	q->timeout = timeout;
+	q->fds = NULL;
+	q->since = NULL;
+	if (cap == 0) {
+		return 0;
+	}
+
+	if ((q->fds = calloc(cap, sizeof(int))) == NULL || (q->since = calloc(cap, sizeof(double))) == NULL) {
+		perror("calloc error");
+		free(q->fds);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Sheds the connections that waited too long, a server with no room
+ * answers them busy rather than letting them wait without bound.
+ * @param q The queue.
+ * @returns The ms until the oldest remaining connection expires, -1
+ * if the queue is empty.
+ */
+int connq_expire(struct connq_t * q) {
+	double t = now();
+	while (q->count > 0 && (t - q->since[q->head]) * 1000 >= q->timeout) {
+		admit_shed(connq_pop(q));
+	}
+
+	if (q->count == 0) {
+		return -1;
+	}
+	return (int)(q->timeout - (t - q->since[q->head]) * 1000) + 1;
+}
+
+/**
+ * Queues a connection.
+ * @param q The queue.
+ * @param sk The connected socket.
+ * @returns 0 on success, -1 if the queue is full.
+ */
+int connq_push(struct connq_t * q, int sk) {
+	if (q->count == q->cap) {
+		return -1;
+	}
+
+	q->fds[(q->head + q->count) % q->cap] = sk;
+	q->since[(q->head + q->count) % q->cap] = now();
+	q->count++;
+	METRIC_ADD(queued_conns, 1);
+	return 0;
+}
+
+/**
+ * Takes the oldest connection off the queue.
+ * @param q The queue.
+ * @returns The connected socket, -1 if the queue is empty.
+ */
+int connq_pop(struct connq_t * q) {
+	if (q->count == 0) {
+		return -1;
+	}
+
+	int sk = q->fds[q->head];
+	q->head = (q->head + 1) % q->cap;
+	q->count--;
+	return sk;
+}
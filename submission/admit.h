@@ -0,0 +1,41 @@
+/**
+ * Admission control for the database server: a bounded queue of
+ * accepted connections waiting for a free worker, per-client token
+ * buckets limiting the request rate of each IP address, and busy
+ * replies for the work that is shed.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#ifndef ADMIT_H
+#define ADMIT_H
+
+#include <netinet/in.h>
+
+#include "proto.h"
+
+// admission defines
+#define ADMIT_BUCKETS 1024 // client addresses tracked by the rate limiter
+
+// accepted connections waiting for a free worker, oldest first
+struct connq_t {
+	int * fds;
+	double * since; // when each connection was queued
+	int head, count, cap;
+	int timeout; // ms a connection may wait before it is shed
+};
+
+//
+// PROTOTYPES
+//
+
+int admit_init(double, int);
+void admit_shed(int);
+int admit_take(struct in_addr, int);
+int connq_expire(struct connq_t *);
+int connq_init(struct connq_t *, int, int);
+int connq_pop(struct connq_t *);
+int connq_push(struct connq_t *, int);
+void encode_busy(struct pkt_t *);
+
+#endif
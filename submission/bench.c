@@ -0,0 +1,747 @@
+/**
+ * Implements bench, the load generator behind make bench. It writes
+ * synthetic database files and runs one benchmark scenario against a
+ * running service, printing machine readable results, one
+ * "scenario metric value" line per metric.
+ *
+ * Scenarios:
+ *	query		pipelined queries of random accounts
+ *	update		pipelined updates of random accounts
+ *	hotkey		pipelined updates of a single account, every client
+ *				contends for the same record lock
+ *	connstorm	every query on a fresh handle: service lookup, connect,
+ *				query and close
+ *	missing		pipelined queries of a few accounts past the database
+ *				that get past the server's Bloom filter, every client
+ *				asks for the same ones at about the same time so their
+ *				lookups are shared; a reply other than not found is an
+ *				error
+ *	replay		the requests of a capture file, see capture.h
+ *
+ * bench replay sends the captured requests to the service as they
+ * were captured, pipelined over one connection per client, the
+ * captured connections spread over the clients, at the captured pace
+ * times the speed, or as fast as depth allows with speed 0. A paced
+ * request's latency runs from when it was due, not when it was sent,
+ * so a server that falls behind shows in the percentiles rather than
+ * slowing the replay down.
+ *
+ * bench compact measures the compact image of a database file, see
+ * compact.h, against its records kept as a sorted record_t array: the
+ * memory per account and the latency of random lookups, in process.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Add bench compact.
+ *			   - Add the replay scenario.
+ *			   - Add the missing scenario.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "capture.h"
+#include "cisbank.h"
+#include "compact.h"
+#include "store.h"
+
+// bench defines
+#define FIRST_ACCTNUM 10000 // synthetic accounts are numbered from here
+#define MAXCLIENTS 64
+#define COMPACT_LOOKUPS 1000000 // lookups timed by bench compact
+#define MISSING_ACCTS 4 // accounts past the database the missing scenario asks for
+#define MISSING_TRIES 1000000000 // accounts past the database tried for them
+#define REPLAY_RECV 32 // replies read per recv by bench replay
+
+// a captured request
+struct replay_req_t {
+	uint64_t t; // ns after the first request of the capture
+	uint32_t conn;
+	uint32_t seq; // place in the capture file, orders a receive's requests
+	const uint8_t * bytes;
+	size_t len;
+};
+
+//
+// bench configuration - set from the command line
+//
+
+static char * mapper_addr = "127.0.0.1";
+static int nclients = 4; // client processes
+static int nops = 5000; // requests per client
+static int depth = 32; // requests in flight per client
+static int naccts = 1000; // accounts in the database
+static char * service = SERVICE_NAME; // the service bench replay drives
+static double speed = 1; // of the captured pace, 0 for as fast as possible
+static int expect_missing = 0; // requests succeed with not found
+static int missing[MISSING_ACCTS]; // the accounts the missing scenario asks for
+
+// the requests replayed, in capture order, and the server they go to
+static struct replay_req_t * reqs = NULL;
+static size_t nreqs = 0;
+static struct sockaddr_in server_addr;
+
+// latencies of the requests of one client, in us
+static float * lats = NULL;
+static double * starts = NULL;
+static int nerrors = 0;
+
+//
+// PROTOTYPES
+//
+
+int cmp_float(const void *, const void *);
+int cmp_record(const void *, const void *);
+int cmp_req(const void *, const void *);
+int gen_db(char *, int);
+int load_capture(char *);
+int main(int, char * []);
+double now_us();
+void on_done(struct cisbank_result_t *, void *);
+int pick_missing();
+void print_usage(char *);
+int run_compact(char *, int);
+int run_client(char *, int, float *, int *);
+int run_connstorm(int, float *, int *);
+int run_replay(int, float *, int *);
+int run_scenario(char *);
+
+//
+// METHODS
+//
+
+/**
+ * Prints command line usage.
+ * @param prog The name the program was invoked with.
+ */
+void print_usage(char * prog) {
+	printf("usage: %s gen <dbfile> <naccts>\n", prog);
+	printf("       %s compact <dbfile> [lookups]\n", prog);
+	printf("       %s [-m mapper_addr] [-c clients] [-n ops] [-d depth] [-a naccts] <scenario>\n", prog);
+	printf("       %s [-m mapper_addr] [-s service] [-c clients] [-d depth] replay <capfile> [speed]\n", prog);
+	printf("\t-m The address of the service mapper (default 127.0.0.1).\n");
+	printf("\t-c The number of client processes (default %d).\n", nclients);
+	printf("\t-n The requests sent per client (default %d).\n", nops);
+	printf("\t-d The requests in flight per client (default %d).\n", depth);
+	printf("\t-a The number of accounts in the database (default %d).\n", naccts);
+	printf("\t-s The service replayed to (default %s).\n", service);
+	printf("\tscenario One of query, update, hotkey, connstorm or missing.\n");
+	printf("\tspeed A multiple of the captured pace (default 1), 0 for as fast\n");
+	printf("\t   as depth allows.\n");
+}
+
+/**
+ * Gets the time on the monotonic clock.
+ * @returns The time in us.
+ */
+double now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/**
+ * Orders latencies.
+ */
+int cmp_float(const void * a, const void * b) {
+	float x = *(const float *)a, y = *(const float *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Writes a synthetic database, accounts numbered from FIRST_ACCTNUM.
+ * @param path The database file to write.
+ * @param n The number of accounts.
+ * @returns 0 on success, -1 on error.
+ */
+int gen_db(char * path, int n) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		struct record_t record;
+		memset(&record, 0, sizeof(record));
+		record.acctnum = FIRST_ACCTNUM + i;
+		snprintf(record.name, sizeof(record.name), "BENCH %d", i);
+		record.value = 1000;
+		record.age = 20 + i % 60;
+		if (write(fd, &record, sizeof(record)) != sizeof(record)) {
+			perror("write error");
+			close(fd);
+			return -1;
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+/**
+ * Orders records by account.
+ */
+int cmp_record(const void * a, const void * b) {
+	const struct record_t * x = a, * y = b;
+	return (x->acctnum > y->acctnum) - (x->acctnum < y->acctnum);
+}
+
+/**
+ * Compares the compact image of a database with a sorted array of its
+ * records: the bytes per account and the ns per random lookup of each,
+ * and the lookups of the image that do not match the array.
+ * @param path The database file.
+ * @param nlookups The number of lookups to time.
+ * @returns 0 on success, -1 on error.
+ */
+int run_compact(char * path, int nlookups) {
+	struct compact_stats_t stats;
+	double start = now_us();
+	if (compact_build(path, &stats) < 0) {
+		return -1;
+	}
+	double build = now_us() - start;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+	off_t size = lseek(fd, 0, SEEK_END);
+	struct record_t * raw = malloc(size);
+	int32_t * accts = malloc(nlookups * sizeof(int32_t));
+	if (raw == NULL || accts == NULL || pread(fd, raw, size, 0) != size) {
+		perror("read error");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	size_t n = size / sizeof(struct record_t);
+	qsort(raw, n, sizeof(struct record_t), cmp_record);
+
+	// the same random accounts for both, xorshift
+	uint32_t x = 2463534242u;
+	for (int i = 0; i < nlookups; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		accts[i] = raw[x % n].acctnum;
+	}
+
+	struct record_t record;
+	float sum = 0;
+	start = now_us();
+	for (int i = 0; i < nlookups; i++) {
+		size_t lo = 0, hi = n;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (raw[mid].acctnum < accts[i]) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		record = raw[lo];
+		sum += record.value + record.name[0];
+	}
+	double raw_us = now_us() - start;
+
+	start = now_us();
+	for (int i = 0; i < nlookups; i++) {
+		compact_query(accts[i], &record);
+		sum += record.value + record.name[0];
+	}
+	double compact_us = now_us() - start;
+
+	int mismatches = 0;
+	for (int i = 0; i < nlookups; i++) {
+		struct record_t * want = bsearch(&accts[i], raw, n, sizeof(struct record_t), cmp_record);
+		mismatches += compact_query(accts[i], &record) < 0 || record.acctnum != want->acctnum
+				|| record.value != want->value || record.age != want->age
+				|| strncmp(record.name, want->name, sizeof(record.name)) != 0;
+	}
+
+	printf("compact accounts %zu\n", stats.accounts);
+	printf("compact names %zu\n", stats.names);
+	printf("compact build_ms %.1f\n", build / 1000);
+	printf("compact bytes_per_acct %.2f\n", (double)stats.bytes / stats.accounts);
+	printf("raw bytes_per_acct %.2f\n", (double)sizeof(struct record_t));
+	printf("compact lookup_ns %.1f\n", compact_us * 1000 / nlookups);
+	printf("raw lookup_ns %.1f\n", raw_us * 1000 / nlookups);
+	printf("compact mismatches %d\n", mismatches + (sum != sum));
+
+	free(raw);
+	free(accts);
+	return 0;
+}
+
+/**
+ * Orders captured requests by when they were received.
+ */
+int cmp_req(const void * a, const void * b) {
+	const struct replay_req_t * x = a, * y = b;
+	if (x->t != y->t) {
+		return x->t < y->t ? -1 : 1;
+	}
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/**
+ * Reads a capture file into the requests to replay, in the order they
+ * were received, timed from the first.
+ * @param path The capture file.
+ * @returns 0 on success, -1 on error.
+ */
+int load_capture(char * path) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	// the requests point into the file, kept mapped for good
+	struct cap_hdr_t hdr;
+	const uint8_t * file = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (file == MAP_FAILED || (size_t)st.st_size < sizeof(hdr)
+			|| (memcpy(&hdr, file, sizeof(hdr)), hdr.magic != CAPTURE_MAGIC) || hdr.pktsize != sizeof(struct pkt_t)) {
+		fprintf(stderr, "%s is not a capture of this build\n", path);
+		return -1;
+	}
+
+	size_t cap = 1024, off = sizeof(hdr);
+	reqs = malloc(cap * sizeof(struct replay_req_t));
+	while (reqs != NULL && off < (size_t)st.st_size) {
+		struct cap_ent_t ent;
+		if ((size_t)st.st_size - off < sizeof(ent) || (memcpy(&ent, file + off, sizeof(ent)), ent.len > hdr.pktsize)
+				|| (size_t)st.st_size - off - sizeof(ent) < ent.len) {
+			fprintf(stderr, "%s is torn at byte %zu, replaying what comes before\n", path, off);
+			break;
+		}
+
+		if (nreqs == cap) {
+			cap *= 2;
+			struct replay_req_t * grown = realloc(reqs, cap * sizeof(struct replay_req_t));
+			if (grown == NULL) {
+				free(reqs);
+				reqs = NULL;
+				break;
+			}
+			reqs = grown;
+		}
+		struct replay_req_t * req = &reqs[nreqs];
+		req->t = ent.t;
+		req->conn = ent.conn;
+		req->seq = nreqs++;
+		req->bytes = file + off + sizeof(ent);
+		req->len = ent.len;
+		off += sizeof(ent) + ent.len;
+	}
+
+	if (reqs == NULL) {
+		perror("malloc error");
+		return -1;
+	} else if (nreqs == 0) {
+		fprintf(stderr, "%s holds no requests\n", path);
+		return -1;
+	}
+
+	qsort(reqs, nreqs, sizeof(struct replay_req_t), cmp_req);
+	uint64_t first = reqs[0].t;
+	for (size_t i = 0; i < nreqs; i++) {
+		reqs[i].t -= first;
+	}
+	return 0;
+}
+
+/**
+ * Records the latency of a completed request.
+ * @param result The result of the request.
+ * @param arg The index of the request.
+ */
+void on_done(struct cisbank_result_t * result, void * arg) {
+	int i = (int)(intptr_t)arg;
+	lats[i] = now_us() - starts[i];
+	if (result->status != (expect_missing ? CISBANK_ESERVER : CISBANK_OK)) {
+		nerrors++;
+	}
+}
+
+/**
+ * Picks the accounts of the missing scenario: accounts past the
+ * database that the Bloom filter of a server on a bench gen database
+ * of naccts accounts lets through, so every query of them is looked up
+ * in the store. Falls back to the first accounts past the database
+ * when too few do.
+ * @returns 0 on success, -1 on error.
+ */
+int pick_missing() {
+	uint64_t nbits = bloom_bits(naccts);
+	uint64_t * words = calloc(nbits / 64, sizeof(uint64_t));
+	if (words == NULL) {
+		perror("calloc error");
+		return -1;
+	}
+
+	for (int a = FIRST_ACCTNUM; a < FIRST_ACCTNUM + naccts; a++) {
+		uint64_t h1, h2;
+		bloom_hash(a, &h1, &h2);
+		for (int i = 0; i < BLOOM_HASHES; i++) {
+			uint64_t bit = (h1 + i * h2) & (nbits - 1);
+			words[bit / 64] |= 1ULL << (bit % 64);
+		}
+	}
+
+	int found = 0;
+	for (int a = FIRST_ACCTNUM + naccts; found < MISSING_ACCTS && a - FIRST_ACCTNUM - naccts < MISSING_TRIES; a++) {
+		uint64_t h1, h2;
+		bloom_hash(a, &h1, &h2);
+		int i = 0;
+		for (; i < BLOOM_HASHES; i++) {
+			uint64_t bit = (h1 + i * h2) & (nbits - 1);
+			if (!(words[bit / 64] & (1ULL << (bit % 64)))) {
+				break;
+			}
+		}
+		if (i == BLOOM_HASHES) {
+			missing[found++] = a;
+		}
+	}
+	free(words);
+
+	for (int i = found; i < MISSING_ACCTS; i++) {
+		missing[i] = FIRST_ACCTNUM + naccts + i;
+	}
+	return 0;
+}
+
+/**
+ * Runs the requests of one client of a pipelined scenario.
+ * @param scenario The scenario.
+ * @param seed Seeds the choice of accounts.
+ * @param dest The latencies of the requests.
+ * @param errors The number of failed requests.
+ * @returns 0 on success, -1 on error.
+ */
+int run_client(char * scenario, int seed, float * dest, int * errors) {
+	struct cisbank_t * cb = cisbank_open(mapper_addr, 1, 1);
+	if (cb == NULL) {
+		perror("cisbank_open error");
+		return -1;
+	}
+
+	lats = dest;
+	starts = malloc(nops * sizeof(double));
+	srand(seed);
+	expect_missing = strcmp(scenario, "missing") == 0;
+
+	for (int i = 0; i < nops; i++) {
+		// keep depth requests in flight
+		while (cisbank_pending(cb) >= depth) {
+			cisbank_poll(cb, -1);
+		}
+
+		int acctnum = FIRST_ACCTNUM + rand() % naccts;
+		starts[i] = now_us();
+		int rval;
+		if (strcmp(scenario, "query") == 0) {
+			rval = cisbank_query_async(cb, acctnum, on_done, (void *)(intptr_t)i);
+		} else if (expect_missing) {
+			rval = cisbank_query_async(cb, missing[i % MISSING_ACCTS], on_done, (void *)(intptr_t)i);
+		} else if (strcmp(scenario, "update") == 0) {
+			rval = cisbank_update_async(cb, acctnum, 0.01, on_done, (void *)(intptr_t)i);
+		} else {
+			rval = cisbank_update_async(cb, FIRST_ACCTNUM, 0.01, on_done, (void *)(intptr_t)i);
+		}
+
+		if (rval < 0) {
+			dest[i] = 0;
+			nerrors++;
+		}
+	}
+
+	while (cisbank_pending(cb) > 0) {
+		cisbank_poll(cb, -1);
+	}
+
+	*errors = nerrors;
+	free(starts);
+	cisbank_close(cb);
+	return 0;
+}
+
+/**
+ * Runs the requests of one client of the connection storm, each on
+ * its own handle.
+ * @param seed Seeds the choice of accounts.
+ * @param dest The latencies of the requests, lookup and connect
+ * included.
+ * @param errors The number of failed requests.
+ * @returns 0 on success, -1 on error.
+ */
+int run_connstorm(int seed, float * dest, int * errors) {
+	srand(seed);
+	for (int i = 0; i < nops; i++) {
+		double start = now_us();
+		struct record_t record;
+		struct cisbank_t * cb = cisbank_open(mapper_addr, 1, 1);
+		if (cb == NULL || cisbank_query(cb, FIRST_ACCTNUM + rand() % naccts, &record) != CISBANK_OK) {
+			(*errors)++;
+		}
+		if (cb != NULL) {
+			cisbank_close(cb);
+		}
+		dest[i] = now_us() - start;
+	}
+
+	return 0;
+}
+
+/**
+ * Replays the captured requests of one client over its own connection,
+ * the captured connections numbered client modulo clients.
+ * @param client The client, from 0.
+ * @param dest The latencies of the requests, indexed like reqs.
+ * @param errors The number of error and busy replies.
+ * @returns 0 on success, -1 on error.
+ */
+int run_replay(int client, float * dest, int * errors) {
+	int sk = socket(AF_INET, SOCK_STREAM, 0), nodelay = 1;
+	if (sk < 0 || connect(sk, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+		perror("connect error");
+		return -1;
+	}
+	setsockopt(sk, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+	size_t n = 0;
+	size_t * mine = malloc(nreqs * sizeof(size_t) + 1);
+	double * due = malloc(nreqs * sizeof(double) + 1);
+	if (mine == NULL || due == NULL) {
+		perror("malloc error");
+		return -1;
+	}
+	for (size_t i = 0; i < nreqs; i++) {
+		if (reqs[i].conn % nclients == (uint32_t)client) {
+			mine[n++] = i;
+		}
+	}
+
+	struct pkt_t replies[REPLAY_RECV], batch[CISBANK_MAXINFLIGHT];
+	size_t sent = 0, done = 0, len = 0;
+	double start = now_us();
+	while (done < n) {
+		// send what is due in one go, the last ms before a request is
+		//	spun out since poll only waits whole ms
+		int timeout = -1, nbatch = 0;
+		while (sent < n && sent - done < (size_t)depth) {
+			double now = now_us();
+			due[sent] = speed > 0 ? start + reqs[mine[sent]].t / 1000.0 / speed : now;
+			if (due[sent] > now) {
+				timeout = (int)((due[sent] - now) / 1000) - 1;
+				timeout = timeout > 0 ? timeout : 0;
+				break;
+			}
+
+			memset(&batch[nbatch], 0, sizeof(struct pkt_t));
+			memcpy(&batch[nbatch++], reqs[mine[sent]].bytes, reqs[mine[sent]].len);
+			sent++;
+		}
+		if (nbatch > 0 && send(sk, batch, nbatch * sizeof(struct pkt_t), MSG_NOSIGNAL)
+				!= (ssize_t)(nbatch * sizeof(struct pkt_t))) {
+			perror("send error");
+			return -1;
+		}
+
+		struct pollfd pfd = { sk, POLLIN, 0 };
+		int ready = poll(&pfd, 1, timeout);
+		if (ready < 0 && errno != EINTR) {
+			perror("poll error");
+			return -1;
+		} else if (ready <= 0) {
+			continue;
+		}
+
+		// replies come back in the order the requests were sent
+		ssize_t got = recv(sk, (char *)replies + len, sizeof(replies) - len, 0);
+		if (got <= 0) {
+			fprintf(stderr, "server closed the connection\n");
+			return -1;
+		}
+		len += got;
+
+		double now = now_us();
+		size_t whole = len / sizeof(struct pkt_t);
+		for (size_t i = 0; i < whole; i++, done++) {
+			dest[mine[done]] = now - due[done];
+			unsigned short ptype = ntohs(replies[i].ptype);
+			if (ptype == PTYPE_ERROR || ptype == PTYPE_BUSY) {
+				(*errors)++;
+			}
+		}
+		len -= whole * sizeof(struct pkt_t);
+		memmove(replies, (char *)replies + whole * sizeof(struct pkt_t), len);
+	}
+
+	free(mine);
+	free(due);
+	close(sk);
+	return 0;
+}
+
+/**
+ * Runs a scenario with every client in its own process and prints
+ * its throughput and latency percentiles.
+ * @param scenario The scenario.
+ * @returns 0 on success, -1 on error.
+ */
+int run_scenario(char * scenario) {
+	if (strcmp(scenario, "missing") == 0 && pick_missing() < 0) {
+		return -1;
+	}
+
+	size_t nlats = strcmp(scenario, "replay") == 0 ? nreqs : (size_t)nclients * nops;
+	float * all = mmap(NULL, nlats * sizeof(float) + MAXCLIENTS * sizeof(int), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (all == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+	int * errors = (int *)(all + nlats);
+
+	// clients connect first, then wait for the pipe to close
+	int gate[2];
+	if (pipe(gate) < 0) {
+		perror("pipe error");
+		return -1;
+	}
+
+	for (int c = 0; c < nclients; c++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			char go;
+			close(gate[1]);
+			if (read(gate[0], &go, 1) < 0) {
+				exit(1);
+			}
+
+			int rval;
+			if (strcmp(scenario, "connstorm") == 0) {
+				rval = run_connstorm(c + 1, all + (size_t)c * nops, &errors[c]);
+			} else if (strcmp(scenario, "replay") == 0) {
+				rval = run_replay(c, all, &errors[c]);
+			} else {
+				rval = run_client(scenario, c + 1, all + (size_t)c * nops, &errors[c]);
+			}
+			exit(rval < 0 ? 1 : 0);
+		} else if (pid < 0) {
+			perror("fork error");
+			return -1;
+		}
+	}
+
+	close(gate[0]);
+	double start = now_us();
+	close(gate[1]);
+
+	int failed = 0, status;
+	while (wait(&status) > 0) {
+		failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+	}
+	double elapsed = now_us() - start;
+
+	if (failed) {
+		fprintf(stderr, "%s: a client failed\n", scenario);
+		return -1;
+	}
+
+	int nerr = 0;
+	for (int c = 0; c < nclients; c++) {
+		nerr += errors[c];
+	}
+
+	qsort(all, nlats, sizeof(float), cmp_float);
+	printf("%s ops_per_sec %.0f\n", scenario, nlats / (elapsed / 1000000.0));
+	printf("%s p50_us %.1f\n", scenario, all[nlats * 50 / 100]);
+	printf("%s p99_us %.1f\n", scenario, all[nlats * 99 / 100]);
+	printf("%s p999_us %.1f\n", scenario, all[nlats * 999 / 1000]);
+	printf("%s errors %d\n", scenario, nerr);
+
+	munmap(all, nlats * sizeof(float) + MAXCLIENTS * sizeof(int));
+	return 0;
+}
+
+/**
+ * Entry point of bench.
+ * @param argc Number of arguments passed via command line.
+ * @param argv Arguments passed via command line.
+ */
+int main(int argc, char * argv[]) {
+	if (argc == 4 && strcmp(argv[1], "gen") == 0) {
+		return gen_db(argv[2], atoi(argv[3])) < 0 ? 1 : 0;
+	} else if ((argc == 3 || argc == 4) && strcmp(argv[1], "compact") == 0) {
+		int nlookups = argc == 4 ? atoi(argv[3]) : COMPACT_LOOKUPS;
+		return nlookups < 1 || run_compact(argv[2], nlookups) < 0 ? 1 : 0;
+	}
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:s:c:n:d:a:h")) != -1) {
+		switch (opt) {
+			case 'm': mapper_addr = optarg; break;
+			case 's': service = optarg; break;
+			case 'c': nclients = atoi(optarg); break;
+			case 'n': nops = atoi(optarg); break;
+			case 'd': depth = atoi(optarg); break;
+			case 'a': naccts = atoi(optarg); break;
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind < argc && strcmp(argv[optind], "replay") == 0 && (argc - optind == 2 || argc - optind == 3)) {
+		speed = argc - optind == 3 ? atof(argv[optind + 2]) : 1;
+		if (nclients < 1 || nclients > MAXCLIENTS || depth < 1 || depth > CISBANK_MAXINFLIGHT || speed < 0) {
+			fprintf(stderr, "invalid bench parameters\n");
+			return 1;
+		}
+		if (load_capture(argv[optind + 1]) < 0) {
+			return 1;
+		}
+		if (cisbank_request_service(mapper_addr, service, &server_addr) < 0) {
+			fprintf(stderr, "service %s not found\n", service);
+			return 1;
+		}
+		return run_scenario("replay") < 0 ? 1 : 0;
+	}
+
+	if (optind != argc - 1 || (strcmp(argv[optind], "query") != 0 && strcmp(argv[optind], "update") != 0
+			&& strcmp(argv[optind], "hotkey") != 0 && strcmp(argv[optind], "connstorm") != 0
+			&& strcmp(argv[optind], "missing") != 0)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (nclients < 1 || nclients > MAXCLIENTS || nops < 1 || depth < 1 || depth > CISBANK_MAXINFLIGHT || naccts < 1) {
+		fprintf(stderr, "invalid bench parameters\n");
+		return 1;
+	}
+
+	return run_scenario(argv[optind]) < 0 ? 1 : 0;
+}
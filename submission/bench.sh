@@ -0,0 +1,138 @@
+#!/bin/sh
+#
+# Runs the benchmark scenarios against every server backend on
+# loopback and compares the results with the stored baseline, see
+# make bench. Results go to <bindir>/bench.results, one
+# "backend.scenario metric value" line per metric.
+#
+# usage: bench.sh [-u] <bindir>
+#	-u Store the results as the new baseline instead of comparing.
+#
+# Tunables, from the environment:
+#	BENCH_PORT		first server port, one per backend (default 7977)
+#	BENCH_ACCTS		accounts in the synthetic database (default 1000)
+#	BENCH_CLIENTS	client processes per scenario (default 4)
+#	BENCH_OPS		requests per client (default 5000)
+#	BENCH_RUNS		runs per scenario, the median is kept (default 3)
+#	BENCH_TOLERANCE	percent a metric may get worse (default 20)
+#
+# Changelog:
+#	10/18/2026 - Created initial version.
+#
+
+update=0
+if [ "$1" = "-u" ]; then
+	update=1
+	shift
+fi
+if [ $# -ne 1 ]; then
+	echo "usage: $0 [-u] <bindir>" >&2
+	exit 1
+fi
+
+bindir=$1
+port=${BENCH_PORT:-7977}
+accts=${BENCH_ACCTS:-1000}
+clients=${BENCH_CLIENTS:-4}
+ops=${BENCH_OPS:-5000}
+runs=${BENCH_RUNS:-3}
+tolerance=${BENCH_TOLERANCE:-20}
+baseline=bench.baseline
+results=$bindir/bench.results
+run=$bindir/run
+
+mapper_pid=
+server_pid=
+
+stop() {
+	[ -n "$server_pid" ] && kill $server_pid 2>/dev/null && wait $server_pid 2>/dev/null
+	[ -n "$mapper_pid" ] && kill $mapper_pid 2>/dev/null && wait $mapper_pid 2>/dev/null
+	server_pid=
+	mapper_pid=
+}
+trap 'stop; exit 1' INT TERM
+
+rm -rf $run $results
+mkdir -p $run
+
+for backend in fork prefork uring; do
+	# a fresh store and mapper per backend, the mapper keeps the first
+	#	address registered for a service
+	$bindir/bench gen $run/db $accts || exit 1
+	$bindir/servicemap > $run/servicemap.log 2>&1 &
+	mapper_pid=$!
+	sleep 0.2
+	$bindir/server -m 127.0.0.1 -p $port -d $run/db -b $backend -w $clients > $run/server-$backend.log 2>&1 &
+	server_pid=$!
+	sleep 0.5
+	if ! kill -0 $server_pid 2>/dev/null; then
+		echo "$backend server failed to start, see $run/server-$backend.log" >&2
+		stop
+		exit 1
+	fi
+
+	echo "== $backend"
+	for scenario in query update hotkey connstorm missing; do
+		n=$ops
+		[ $scenario = connstorm ] && n=$((ops / 10))
+		rm -f $run/out
+		for i in $(seq $runs); do
+			if ! $bindir/bench -c $clients -n $n -a $accts $scenario >> $run/out; then
+				echo "$backend $scenario failed" >&2
+				stop
+				exit 1
+			fi
+		done
+
+		# keep the median of every metric
+		sort -k2,2 -k3,3g $run/out | awk -v b=$backend '
+			$2 != metric { if (n) print b "." name, metric, v[int((n - 1) / 2)]; n = 0 }
+			{ name = $1; metric = $2; v[n++] = $3 }
+			END { if (n) print b "." name, metric, v[int((n - 1) / 2)] }
+		' | tee -a $results
+	done
+
+	stop
+	port=$((port + 1))
+done
+
+if [ $update -eq 1 ] || [ ! -f $baseline ]; then
+	cp $results $baseline
+	echo "stored the results as the baseline in $baseline"
+	exit 0
+fi
+
+# throughput must not drop and median and p99 latency must not grow by
+#	more than the tolerance, errors must not appear; p999 is too noisy
+#	to gate on and only reported
+awk -v tol=$tolerance '
+	NR == FNR { base[$1 " " $2] = $3; next }
+	{
+		key = $1 " " $2
+		if (!(key in base)) {
+			next
+		}
+		b = base[key]; v = $3; verdict = "ok"
+		if ($2 == "errors") {
+			if (v > b) verdict = "REGRESSION"
+		} else if ($2 == "ops_per_sec") {
+			if (v < b * (1 - tol / 100)) verdict = "REGRESSION"
+		} else if ($2 == "p999_us") {
+			verdict = "-"
+		} else if (v > b * (1 + tol / 100)) {
+			verdict = "REGRESSION"
+		}
+		change = b != 0 ? (v - b) * 100 / b : 0
+		printf "%-22s %-12s %12s %12s %+8.1f%% %s\n", $1, $2, b, v, change, verdict
+		if (verdict == "REGRESSION") failed = 1
+	}
+	END { exit failed }
+' $baseline $results
+status=$?
+
+if [ $status -ne 0 ]; then
+	echo "performance regressed beyond ${tolerance}% of $baseline"
+else
+	echo "no regressions beyond ${tolerance}% of $baseline"
+fi
+exit $status
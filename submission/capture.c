@@ -0,0 +1,139 @@
+/**
+ * Implements the request capture of the server, see capture.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "metrics.h"
+
+static int cap_fd = -1; // O_APPEND, shared by every worker
+static uint32_t * conns = NULL; // connections numbered so far, shared
+
+// the entries of this worker not yet written, the server itself never
+// captures so every child starts with an empty buffer
+static uint8_t buf[CAPTURE_BUF];
+static size_t buflen = 0;
+static uint64_t oldest = 0; // ns the first entry in buf was received
+
+//
+// PROTOTYPES
+//
+
+static uint64_t capture_clock();
+
+//
+// METHODS
+//
+
+/**
+ * Reads the capture clock.
+ * @returns The time in ns on the monotonic clock.
+ */
+static uint64_t capture_clock() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Creates a capture file, replacing any file of that name, and starts
+ * capturing. MUST be called before the server forks.
+ * @param path The capture file.
+ * @returns 0 on success, -1 on error.
+ */
+int capture_init(const char * path) {
+	void * addr = mmap(NULL, sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+
+	struct cap_hdr_t hdr = { CAPTURE_MAGIC, sizeof(struct pkt_t) };
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fd < 0 || write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		perror("capture file error");
+		if (fd >= 0) {
+			close(fd);
+		}
+		munmap(addr, sizeof(uint32_t));
+		return -1;
+	}
+
+	conns = addr;
+	cap_fd = fd;
+	return 0;
+}
+
+/**
+ * Numbers a new connection.
+ * @returns The number of the connection, 0 when not capturing.
+ */
+uint32_t capture_conn() {
+	return conns != NULL ? __atomic_add_fetch(conns, 1, __ATOMIC_RELAXED) : 0;
+}
+
+/**
+ * Appends the entries of this worker to the capture file.
+ */
+void capture_flush() {
+	if (buflen == 0) {
+		return;
+	}
+
+	// a short write leaves a torn entry, only ever a whole buffer or none
+	if (write(cap_fd, buf, buflen) != (ssize_t)buflen) {
+		perror("capture write error");
+		METRIC_ADD(capture_lost, 1);
+	} else {
+		METRIC_ADD(capture_bytes, buflen);
+	}
+	buflen = 0;
+}
+
+/**
+ * Captures the requests of a receive, before they are answered in
+ * place.
+ * @param conn The connection they came on, from capture_conn.
+ * @param pkts The requests, in network byte order.
+ * @param n The number of requests.
+ */
+void capture_pkts(uint32_t conn, const struct pkt_t * pkts, int n) {
+	if (cap_fd < 0 || n <= 0) {
+		return;
+	}
+
+	uint64_t now = capture_clock();
+	for (int i = 0; i < n; i++) {
+		const uint8_t * bytes = (const uint8_t *)&pkts[i];
+		size_t len = sizeof(struct pkt_t);
+		while (len > 0 && bytes[len - 1] == 0) {
+			len--;
+		}
+
+		struct cap_ent_t ent = { now, conn, len, 0 };
+		if (buflen + sizeof(ent) + len > sizeof(buf)) {
+			capture_flush();
+		}
+		if (buflen == 0) {
+			oldest = now;
+		}
+		memcpy(buf + buflen, &ent, sizeof(ent));
+		memcpy(buf + buflen + sizeof(ent), bytes, len);
+		buflen += sizeof(ent) + len;
+	}
+	METRIC_ADD(capture_requests, n);
+
+	if (now - oldest >= (uint64_t)CAPTURE_FLUSH_MS * 1000000) {
+		capture_flush();
+	}
+}
@@ -0,0 +1,56 @@
+/**
+ * Request capture for the database server. With -P the server appends
+ * every request it receives to a capture file, stamped with the time it
+ * was received and the connection it came on, so the traffic of a
+ * production box can be replayed offline with bench replay.
+ *
+ * A capture file is a cap_hdr_t followed by entries in no particular
+ * order: a cap_ent_t and the bytes of the request packet as received,
+ * in network byte order, trailing zero bytes dropped, so a query takes
+ * 28 bytes rather than 260. Each worker gathers entries in a buffer of
+ * its own and appends it with a single write to the file opened with
+ * O_APPEND, so the buffers of several workers never interleave; a
+ * buffer goes out when full, at most CAPTURE_FLUSH_MS after its first
+ * entry when requests keep coming, and when its connection ends.
+ * Entries of one connection are appended in the order received. A
+ * worker killed before flushing loses its buffer.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+#include "proto.h"
+
+// capture defines
+#define CAPTURE_MAGIC 0x43424350 // marks a capture file
+#define CAPTURE_BUF 65536 // bytes gathered per worker before a write
+#define CAPTURE_FLUSH_MS 1000 // most ms an entry waits in a worker's buffer
+
+// the header of a capture file
+struct cap_hdr_t {
+	uint32_t magic;
+	uint32_t pktsize; // the size of a packet when captured
+};
+
+// an entry of a capture file, followed by len bytes of the packet
+struct cap_ent_t {
+	uint64_t t; // ns on the monotonic clock the request was received
+	uint32_t conn; // the connection, numbered from 1 by the server
+	uint16_t len; // bytes of the packet kept
+	uint16_t unused;
+};
+
+//
+// PROTOTYPES
+//
+
+uint32_t capture_conn();
+void capture_flush();
+int capture_init(const char *);
+void capture_pkts(uint32_t, const struct pkt_t *, int);
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * Client library for the CISBANK database service. Resolves the
+ * service through the service mapper, keeps a pool of connections
+ * to every shard and pipelines requests over them.
+ *
+ * Requests are issued either synchronously (cisbank_query,
+ * cisbank_update, cisbank_transfer, cisbank_txn) or asynchronously
+ * (cisbank_*_async), in which case the callback runs from inside
+ * cisbank_poll once the reply arrives. cisbank_scan streams every
+ * record of a shard through a callback, a batch at a time, and
+ * cisbank_history the ledger entries of an account, a page at a time.
+ * Every request carries a deadline, cisbank_set_timeout; a request
+ * that misses it completes with CISBANK_ETIMEDOUT and its late reply
+ * is discarded. A handle is not thread safe, use one handle per thread.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Add cisbank_stats.
+ *			   - Add CISBANK_EBUSY.
+ *			   - Add request deadlines and retried service lookups.
+ *			   - Add cisbank_transfer and cisbank_txn.
+ *			   - Updates return the updated record.
+ *			   - Add cisbank_scan.
+ *			   - Add cisbank_history.
+ */
+
+#ifndef CISBANK_H
+#define CISBANK_H
+
+#include <stddef.h>
+#include <netinet/in.h>
+
+#include "proto.h"
+
+// library defines
+#define CISBANK_POOLSIZE 4 // default connections per shard
+#define CISBANK_MAXINFLIGHT 128 // requests pipelined per connection
+#define CISBANK_TIMEOUT 5000 // default ms a request may take
+#define CISBANK_LOOKUP_TRIES 4 // service lookups sent before giving up
+#define CISBANK_LOOKUP_WAIT 250 // ms to wait for the first lookup reply, doubles per try
+#define CISBANK_SCAN_WINDOW 64 // batches a scan keeps in flight
+
+// result status codes
+#define CISBANK_OK 0 // request succeeded
+#define CISBANK_ESERVER -1 // server rejected the request, see message
+#define CISBANK_ENET -2 // connection to the server failed
+#define CISBANK_EBUSY -3 // server shed the request, retry later
+#define CISBANK_ETIMEDOUT -4 // no reply before the request's deadline
+#define CISBANK_EINVAL -5 // request could not be sent, see message
+
+// the outcome of a request, handed to the callback
+struct cisbank_result_t {
+	int status; // one of the CISBANK_ status codes
+	int acctnum; // the account the request was for
+	struct record_t record; // the record, valid for successful queries and updates, the source of transfers
+	struct record_t to; // the destination record, valid for successful transfers
+	const char * message; // server message, only valid in the callback
+	const struct scan_t * scan; // scan batch in local byte order, only valid in the callback
+	const struct history_t * history; // history page in local byte order, only valid in the callback
+};
+
+// invoked once per request with its result and the user argument
+typedef void (* cisbank_cb_t)(struct cisbank_result_t *, void *);
+
+// invoked with every batch of records of a scan and the user argument,
+//	returns nonzero to stop the scan
+typedef int (* cisbank_scan_cb_t)(const struct record_t *, int, void *);
+
+// invoked with every page of ledger entries of a history and the user
+//	argument, returns nonzero to stop reading
+typedef int (* cisbank_history_cb_t)(const struct ledger_ent_t *, int, void *);
+
+// client handle, opaque to users of the library
+struct cisbank_t;
+
+//
+// PROTOTYPES
+//
+
+void cisbank_close(struct cisbank_t *);
+const char * cisbank_lasterror(struct cisbank_t *);
+struct cisbank_t * cisbank_open(const char *, int, int);
+int cisbank_history(struct cisbank_t *, int, uint32_t, uint32_t, cisbank_history_cb_t, void *);
+int cisbank_pending(struct cisbank_t *);
+int cisbank_poll(struct cisbank_t *, int);
+int cisbank_query(struct cisbank_t *, int, struct record_t *);
+int cisbank_query_async(struct cisbank_t *, int, cisbank_cb_t, void *);
+int cisbank_request_service(const char *, char *, struct sockaddr_in *);
+int cisbank_scan(struct cisbank_t *, int, cisbank_scan_cb_t, void *);
+void cisbank_set_timeout(struct cisbank_t *, int);
+int cisbank_transfer(struct cisbank_t *, int, int, float, struct record_t *);
+int cisbank_transfer_async(struct cisbank_t *, int, int, float, cisbank_cb_t, void *);
+int cisbank_txn(struct cisbank_t *, const struct txn_op_t *, int);
+int cisbank_txn_async(struct cisbank_t *, const struct txn_op_t *, int, cisbank_cb_t, void *);
+int cisbank_stats(struct cisbank_t *, int, const char *, char *, size_t);
+int cisbank_update(struct cisbank_t *, int, float, struct record_t *);
+int cisbank_update_async(struct cisbank_t *, int, float, cisbank_cb_t, void *);
+
+#endif
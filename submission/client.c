@@ -12,102 +12,106 @@
  *	03/28/2020 - Get client 100% working.
  *	03/30/2020 - Complete testing of client.
  *	04/05/2020 - Create method to send packets, cleaner this way.
+ *	10/18/2026 - Route requests to the shard owning the account.
+ *			   - Bind to any local port so clients can share a host
+ *				 with the server.
+ *			   - Move networking into the cisbank client library.
+ *			   - Add stats command.
+ *			   - Add request timeout option.
+ *			   - Add transfer command.
+ *			   - Print the record returned by update instead of
+ *				 querying it again.
+ *			   - Locate the service mapper unless it is given.
+ *			   - Add export command, a CSV of every record dbload reads.
+ *			   - Add history command, the ledger of an account.
  * Bugs:
  *	03/25/2020 - --Client connects successfully to server by
  *				 immediately closes when calling query-- FIXED
  */
 
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <netinet/ip.h>
-#include <unistd.h>
-#include <sys/fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
 
-// client defines
-#define BUFMAX 1024
-#define CLIENT_PORT 7777
-#define MAPPER_PORT 21896
-
-// various broadcast addresses
-#define DOT0_BC_ADDR "192.168.0.255" // home
-#define DOT1_BC_ADDR "192.168.1.255" // home
-#define LLAB_BC_ADDR "137.148.205.255" // use when submitting
-
-// the broadcast address (set to one of above)
-#define BROADCAST_ADDR LLAB_BC_ADDR
-
-// packet code defines
-#define PTYPE_REGISTER 0
-#define PTYPE_LOOKUP 10
-#define PTYPE_QUERY 20
-#define PTYPE_UPDATE 30
-#define PTYPE_RECORD 40
-#define PTYPE_ERROR 50
-
-// database command codes
-#define DB_QUERY_CODE 1000
-#define DB_UPDATE_CODE 1001
+#include "cisbank.h"
+#include "mapper.h"
 
 //
-// packet stuff
+// client configuration - set from the command line
 //
 
-// database query type
-struct query_t {
-	int code;
-	int acctnum;
-};
-
-// database update type
-struct update_t {
-	int code;
-	int acctnum;
-	float value;
-};
-
-// database record type
-struct record_t {
-	int acctnum;
-	char name[20];
-	float value;
-	int age;
-};
-
-// allows for sending/receiving fixed sized chunks to/from clients
-// all of these refer to the same region in memory
-union body_t {
-	// used for commands, messages, random data, etc...
-	//	behavior is undefined if this is not NULL terminated
-	char message[BUFMAX/4]; // MUST BE NULL TERMINATED
-	struct query_t query;
-	struct update_t update;
-	struct record_t record;
-};
-
-// send this type to/from clients - best to define in header file
-struct pkt_t {
-	unsigned short ptype;
-	union body_t body;
-};
+static char * mapper_addr = NULL; // located when not given
+static int nshards = 1;
+static int timeout = CISBANK_TIMEOUT; // ms a request may take
 
 //
 // PROTOTYPES
 //
 
-void decode_addrstr(char * addrstr, char * ip, unsigned short * port);
+int export_batch(const struct record_t *, int, void *);
 int main(int, char * []);
+int print_entries(const struct ledger_ent_t *, int, void *);
 void parse_string(char *, char * [], int, char *);
 void print_help();
-int request_service(char *, struct sockaddr_in *);
+void print_record(struct record_t);
+void print_usage(char *);
 
 //
 // METHODS
 //
 
+/**
+ * Writes a batch of scanned records as CSV lines, quoting names that
+ * hold commas or quotes the way dbload reads them.
+ * @param records The records.
+ * @param n The number of records.
+ * @param arg The file to write to.
+ * @returns 0 to go on with the scan, 1 to stop on a write error.
+ */
+int export_batch(const struct record_t * records, int n, void * arg) {
+	FILE * file = arg;
+	for (int i = 0; i < n; i++) {
+		char name[sizeof(records[i].name) + 1];
+		snprintf(name, sizeof(name), "%.*s", (int)sizeof(records[i].name), records[i].name);
+
+		fprintf(file, "%d,", records[i].acctnum);
+		if (strpbrk(name, ",\"") != NULL) {
+			fputc('"', file);
+			for (char * c = name; *c != '\0'; c++) {
+				if (*c == '"') {
+					fputc('"', file);
+				}
+				fputc(*c, file);
+			}
+			fputc('"', file);
+		} else {
+			fputs(name, file);
+		}
+		fprintf(file, ",%.9g,%d\n", records[i].value, records[i].age);
+	}
+	return ferror(file) ? 1 : 0;
+}
+
+/**
+ * Prints a page of ledger entries, one per line.
+ * @param entries The entries.
+ * @param n The number of entries.
+ * @param arg Unused.
+ * @returns 0 to go on with the next page.
+ */
+int print_entries(const struct ledger_ent_t * entries, int n, void * arg) {
+	(void)arg;
+	for (int i = 0; i < n; i++) {
+		char when[32];
+		time_t sec = entries[i].stamp.sec;
+		strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&sec));
+		printf("%s.%06u %+.2f %.2f\n", when, entries[i].stamp.usec, entries[i].delta, entries[i].balance);
+	}
+	return 0;
+}
+
 /**
  * Prints command line help.
  */
@@ -115,32 +119,33 @@ void print_help() {
 	printf("-- Help --\n");
 	printf("\tquery <acctnum:int>\n");
 	printf("\tupdate <acctnum:int> <value:decimal>\n");
+	printf("\ttransfer <from:int> <to:int> <amount:decimal>\n");
+	printf("\tstats [section:str]\n");
+	printf("\texport <file:str>\n");
+	printf("\thistory <acctnum:int> [from:epoch] [to:epoch]\n");
 	printf("\thelp\n");
 	printf("\tquit\n");
 	printf("\n");
 }
 
 /**
- * Decodes an address string storing the IP address in \'ip\' and
- * the port in \'port\'.
- * @param addrstr A pointer to a buffer containing the address
- * string received from the server.
- * @param ip A pointer to stored the IP address in.
- * @param port A pointer to stored the port number in.
+ * Prints command line usage.
+ * @param prog The name the program was invoked with.
  */
-void decode_addrstr(char * addrstr, char *ip, unsigned short * port) {
-	char * tokens[6];
-	parse_string(addrstr, tokens, 6, ",");
+void print_usage(char * prog) {
+	printf("usage: %s [-m mapper_addr] [-n nshards] [-t timeout]\n", prog);
+	printf("\t-m The address[:port] of the service mapper (default located by\n");
+	printf("\t   broadcast, then cached in ~/%s or under $XDG_RUNTIME_DIR).\n", MAPPER_CACHE);
+	printf("\t-n The number of shards the service is split across.\n");
+	printf("\t-t The ms a request may take (default %d), 0 for no limit.\n", CISBANK_TIMEOUT);
+}
 
-	// BUG REPORT - snprintf does not work here
-	//	will print 127.0.1 into ip not 127.0.1.1
-	for (int i = 0; i < 4; i++) {
-		strcat(ip, tokens[i]);
-		if (i < 3) {
-			strcat(ip, ".");
-		}
-	}
-	*port = (atoi(tokens[4]) * 256) + atoi(tokens[5]);
+/**
+ * Prints a record received from the server.
+ * @param record The record to print.
+ */
+void print_record(struct record_t record) {
+	printf("%s %d %.1f\n", record.name, record.acctnum, record.value);
 }
 
 /**
@@ -158,227 +163,99 @@ void parse_string(char * src, char * dest[], int n, char * delim) {
 	} while (tokens < n && (token = strtok(NULL, delim)) != NULL);
 }
 
-/**
- * Requests a service from the service mapper.
- * @param service The service to request.
- * @param dest The destination socket address to intialize.
- * @returns 0 on success, -1 in error.
- */
-int request_service(char * service, struct sockaddr_in * dest) {
-	struct sockaddr_in local, remote;
-	socklen_t len=sizeof(local), rlen=sizeof(remote);
-	int sk;
-	char sendbuf[BUFMAX], recvbuf[BUFMAX];
-
-	if ((sk = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-		perror("socket error");
-		return -1;
-	}
-
-	local.sin_family = AF_INET;
-	local.sin_port = htons(CLIENT_PORT);
-	local.sin_addr.s_addr = INADDR_ANY;
-
-	if (bind(sk, (struct sockaddr *)&local, len) < 0) {
-		perror("bind error");
-		close(sk);
-		return -1;
-	}
-
-	remote.sin_family = AF_INET;
-	remote.sin_port = htons(MAPPER_PORT);
-	remote.sin_addr.s_addr = inet_addr(BROADCAST_ADDR);
-
-	// enable broadcasting on the socket
-	int broadcast = 1;
-	if (setsockopt(sk, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
-		perror("setsockopt error");
-		close(sk);
-		return -1;
-	}
-
-	// construct a packet to send
-	struct pkt_t pkt;
-
-	pkt.ptype = htons(PTYPE_LOOKUP);
-	memset(pkt.body.message, 0, sizeof(pkt.body.message));
-	snprintf(pkt.body.message, sizeof(pkt.body.message), "GET %s%c", service, '\0');
-	memset(sendbuf, 0, sizeof(sendbuf));
-	memcpy(sendbuf, &pkt, sizeof(struct pkt_t));
-
-	// attempt to send a packet
-	ssize_t net_bytes = 0;
-	if ((net_bytes = sendto(sk, sendbuf, sizeof(struct pkt_t), 0, (struct sockaddr *)&remote, rlen)) < 0) {
-		perror("sendto error");
-		close(sk);
-		return -1;
-	}
-
-	if (net_bytes != sizeof(struct pkt_t)) {
-		perror("sendto error");
-		close(sk);
-		return -1;
-	}
-
-	// attempt to receive a packet
-	if ((net_bytes = recvfrom(sk, recvbuf, sizeof(struct pkt_t), 0, (struct sockaddr *)&remote, &rlen)) < 0) {
-		perror("recvfrom error");
-		close(sk);
-		return -1;
-	}
-
-	if (net_bytes != sizeof(struct pkt_t)) {
-		perror("recvfrom error");
-		close(sk);
-		return -1;
-	}
-
-	// receive over the same packet
-	memcpy(&pkt, recvbuf, sizeof(struct pkt_t));
-	pkt.ptype = ntohs(pkt.ptype);
-
-	// check packet format
-	if (pkt.ptype != PTYPE_LOOKUP) {
-		perror("packet error");
-		close(sk);
-		return -1;
-	}
-
-	close(sk);
-
-	// decode the pkt contents
-	char raddr[24];
-	unsigned short rport;
-	memset(raddr, 0, sizeof(raddr));
-	decode_addrstr(pkt.body.message, raddr, &rport);
-	printf("Service provided by %s at port %d\n", raddr, rport);
-
-	// set the fields in the dest socket address
-	dest->sin_family = AF_INET;
-	dest->sin_port = rport; // port's already in big endian
-	dest->sin_addr.s_addr = inet_addr(raddr);
-
-	return 0;
-}
-
-int send_pkt(
-		struct pkt_t pkt, 
-		struct sockaddr_in remote, socklen_t rlen) {
-	struct sockaddr_in local;
-	socklen_t len=sizeof(local);
-	int sk;
-	char sendbuf[BUFMAX], recvbuf[BUFMAX];
-
-	if ((sk = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		perror("socket error");
-		return -1;
-	}
-
-	local.sin_family = AF_INET;
-	local.sin_port = htons(CLIENT_PORT);
-	local.sin_addr.s_addr = INADDR_ANY;
-
-	if (bind(sk, (struct sockaddr *)&local, len) < 0) {
-		perror("bind error");
-		close(sk);
-		return -1;
-	}
-
-	if (connect(sk, (struct sockaddr *)&remote, rlen) < 0) {
-		perror("connect error");
-		close(sk);
-		return -1;
-	}
-
-	memset(sendbuf, 0, sizeof(sendbuf));
-	memcpy(sendbuf, &pkt, sizeof(struct pkt_t));
-
-	ssize_t net_bytes = 0;
-	if ((net_bytes = send(sk, sendbuf, sizeof(struct pkt_t), 0)) != sizeof(struct pkt_t)) {
-		perror("send error");
-		close(sk);
-		return -1;
-	}
-
-	if ((net_bytes = recv(sk, recvbuf, sizeof(struct pkt_t), 0)) != sizeof(struct pkt_t)) {
-		perror("recv error");
-		close(sk);
-		return -1;
-	}
-
-	memcpy(&pkt, recvbuf, sizeof(struct pkt_t));
-
-	pkt.ptype = ntohs(pkt.ptype);
-	if (pkt.ptype == PTYPE_RECORD) {
-		// convert the fields to local byte order
-		pkt.body.record.acctnum = ntohl(pkt.body.record.acctnum);
-		pkt.body.record.age = ntohl(pkt.body.record.age);
-		int * ip = (int *)&pkt.body.record.value;
-		*ip = ntohl(*ip);
-
-		printf("%s %d %.1f\n", pkt.body.record.name, pkt.body.record.acctnum, pkt.body.record.value);
-	} else if (pkt.ptype == PTYPE_UPDATE) {
-		if (strcmp(pkt.body.message, "OK") == 0) {
-			// do nothing here, its handled in main
-		} else {
-			printf("Packet Error: %s\n\n", pkt.body.message);
-		}
-	} else if (pkt.ptype == PTYPE_ERROR) {
-		printf("Packet Error: %s\n\n", pkt.body.message);
-	} else {
-		printf("An unexpected error occurred!\n\n");
-	}
-
-	close(sk);
-	return 0;
-}
-
 /**
  * Entry point of the client program.
  * @param argc Number of arguments passed via command line.
  * @param argv Arguments passed via command line.
  */
 int main(int argc, char * argv[]) {
-	struct sockaddr_in remote;
-	socklen_t rlen = sizeof(remote);
+	int opt;
+	while ((opt = getopt(argc, argv, "m:n:t:h")) != -1) {
+		switch (opt) {
+			case 'm': mapper_addr = optarg; break;
+			case 'n': nshards = atoi(optarg); break;
+			case 't': timeout = atoi(optarg); break;
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (nshards < 1 || nshards > MAXSHARDS) {
+		fprintf(stderr, "invalid number of shards %d\n", nshards);
+		return 1;
+	}
 
-	// attempt to initialize the remote socket
-	if (request_service("CISBANK", &remote) < 0) {
+	// resolve the service and open the connection pool
+	struct cisbank_t * cb;
+	if ((cb = cisbank_open(mapper_addr, nshards, 1)) == NULL) {
 		perror("request_service error");
 		return 1;
 	}
+	cisbank_set_timeout(cb, timeout);
 
-	int sendmsg = 0;
 	char inbuf[BUFMAX];
-	struct pkt_t pkt;
+	struct record_t record;
 	while (1) {
 		printf(">: ");
-		fgets(inbuf, BUFMAX, stdin);
+		if (fgets(inbuf, BUFMAX, stdin) == NULL) {
+			break;
+		}
 
-		if (strlen(inbuf) == 0) {
+		if (strlen(inbuf) <= 1) {
 			continue;
 		}
 		inbuf[strlen(inbuf)-1] = '\0';
 
-		char * tokens[3];
-		parse_string(inbuf, tokens, 3, " ");
+		char * tokens[4] = { NULL, NULL, NULL, NULL };
+		parse_string(inbuf, tokens, 4, " ");
+
+		int status = CISBANK_OK;
+		if (strcmp(tokens[0], "query") == 0 && tokens[1] != NULL) {
+			if ((status = cisbank_query(cb, atoi(tokens[1]), &record)) == CISBANK_OK) {
+				print_record(record);
+			}
+		} else if (strcmp(tokens[0], "update") == 0 && tokens[2] != NULL) {
+			if ((status = cisbank_update(cb, atoi(tokens[1]), strtof(tokens[2], NULL), &record)) == CISBANK_OK) {
+				print_record(record);
+			}
+		} else if (strcmp(tokens[0], "transfer") == 0 && tokens[3] != NULL) {
+			int from = atoi(tokens[1]), to = atoi(tokens[2]);
+			struct record_t records[2];
+			if ((status = cisbank_transfer(cb, from, to, strtof(tokens[3], NULL), records)) == CISBANK_OK) {
+				print_record(records[0]);
+				print_record(records[1]);
+			}
+		} else if (strcmp(tokens[0], "stats") == 0) {
+			// every shard keeps its own counters
+			char stats[BUFMAX/4];
+			for (int i = 0; i < nshards && status == CISBANK_OK; i++) {
+				if ((status = cisbank_stats(cb, i, tokens[1], stats, sizeof(stats))) == CISBANK_OK) {
+					printf("shard %d %s\n", i, stats);
+				}
+			}
+		} else if (strcmp(tokens[0], "export") == 0 && tokens[1] != NULL) {
+			FILE * file = fopen(tokens[1], "w");
+			if (file == NULL) {
+				perror("fopen error");
+				continue;
+			}
 
-		if (strcmp(tokens[0], "query") == 0) {
-			// construct a query packet, send to server
-			pkt.ptype = htons(PTYPE_QUERY);
-			pkt.body.query.code = htonl(DB_QUERY_CODE);
-			pkt.body.query.acctnum = htonl(atoi(tokens[1]));
-			sendmsg = 1;
-		} else if (strcmp(tokens[0], "update") == 0) {
-			// construct an update packet, send to server
-			pkt.ptype = htons(PTYPE_UPDATE);
-			pkt.body.update.code = htonl(DB_UPDATE_CODE);
-			pkt.body.update.acctnum = htonl(atoi(tokens[1]));
-			float value = strtof(tokens[2], NULL);
-			int * ip = (int *)&value;
-			*ip = htonl(*ip);
-			pkt.body.update.value = value;
-			sendmsg = 1;
+			// every shard holds its own records
+			static char filebuf[1 << 20];
+			setvbuf(file, filebuf, _IOFBF, sizeof(filebuf));
+			for (int i = 0; i < nshards && status == CISBANK_OK && !ferror(file); i++) {
+				status = cisbank_scan(cb, i, export_batch, file);
+			}
+			int failed = ferror(file);
+			if (fclose(file) != 0 || failed) {
+				perror("write error");
+			}
+		} else if (strcmp(tokens[0], "history") == 0 && tokens[1] != NULL) {
+			// the whole ledger unless a range is given
+			uint32_t from = tokens[2] != NULL ? strtoul(tokens[2], NULL, 10) : 0;
+			uint32_t to = tokens[3] != NULL ? strtoul(tokens[3], NULL, 10) : UINT32_MAX;
+			status = cisbank_history(cb, atoi(tokens[1]), from, to, print_entries, NULL);
 		} else if (strcmp(tokens[0], "help") == 0) {
 			print_help();
 		} else if (strcmp(tokens[0], "quit") == 0) {
@@ -388,23 +265,11 @@ int main(int argc, char * argv[]) {
 			continue;
 		}
 
-		if (sendmsg) {
-			send_pkt(pkt, remote, rlen);
-
-			if (strcmp(tokens[0], "update") == 0) {
-				// need to wait for TCP to make port available
-				usleep(500);
-				
-				// send a query message to confirm update
-				pkt.ptype = htons(PTYPE_QUERY);
-				pkt.body.query.code = htonl(DB_QUERY_CODE);
-				pkt.body.query.acctnum = htonl(atoi(tokens[1]));
-				send_pkt(pkt, remote, rlen);
-			}
-
-			sendmsg = 0;
+		if (status != CISBANK_OK) {
+			printf("Packet Error: %s\n\n", cisbank_lasterror(cb));
 		}
 	}
 
+	cisbank_close(cb);
 	return 0;
 }
@@ -0,0 +1,410 @@
+/**
+ * Implements the compact image of the record store, see compact.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compact.h"
+#include "proto.h"
+
+// the image, every array in one shared mapping
+struct compact_t {
+	size_t n; // accounts
+	int32_t * accts; // sorted
+	uint32_t * values; // float bits, beside accts
+	uint32_t * blocks; // packed offset of every block
+	uint32_t * names; // pool offset of every shared name, and the end of the pool
+	char * pool;
+	uint8_t * packed; // name tag, inline name and zigzag age of every record
+};
+
+// an account found in the store
+struct order_t {
+	int32_t acctnum;
+	uint32_t pos; // position in the store
+};
+
+// a name found in the store
+struct name_t {
+	uint32_t pos; // a record carrying it
+	uint32_t count; // records carrying it
+};
+
+static struct compact_t image;
+static const struct name_t * ranked; // the names cmp_uses orders
+
+//
+// PROTOTYPES
+//
+
+static int cmp_order(const void *, const void *);
+static int cmp_uses(const void *, const void *);
+static size_t find_slot(int);
+static uint32_t hash_name(const char *, size_t);
+static size_t varint_len(uint32_t);
+static const uint8_t * varint_get(const uint8_t *, uint32_t *);
+static uint8_t * varint_put(uint8_t *, uint32_t);
+static uint32_t zigzag(int32_t);
+
+//
+// METHODS
+//
+
+/**
+ * Orders accounts by number, then by position in the store.
+ */
+static int cmp_order(const void * a, const void * b) {
+	const struct order_t * x = a, * y = b;
+	if (x->acctnum != y->acctnum) {
+		return x->acctnum < y->acctnum ? -1 : 1;
+	}
+	return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/**
+ * Orders names by descending use.
+ */
+static int cmp_uses(const void * a, const void * b) {
+	uint32_t x = ranked[*(const uint32_t *)a].count, y = ranked[*(const uint32_t *)b].count;
+	return (x < y) - (x > y);
+}
+
+/**
+ * Hashes a name, FNV-1a.
+ * @param name The name.
+ * @param len Its length.
+ * @returns The hash.
+ */
+static uint32_t hash_name(const char * name, size_t len) {
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ (uint8_t)name[i]) * 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Computes the length of a varint.
+ * @param v The value.
+ * @returns Its length in bytes.
+ */
+static size_t varint_len(uint32_t v) {
+	size_t n = 1;
+	for (; v >= 0x80; v >>= 7) {
+		n++;
+	}
+	return n;
+}
+
+/**
+ * Writes a varint, 7 bits per byte, the low bits first.
+ * @param p Where to write it.
+ * @param v The value.
+ * @returns The byte after it.
+ */
+static uint8_t * varint_put(uint8_t * p, uint32_t v) {
+	for (; v >= 0x80; v >>= 7) {
+		*p++ = v | 0x80;
+	}
+	*p++ = v;
+	return p;
+}
+
+/**
+ * Reads a varint.
+ * @param p Where to read it.
+ * @param v Where to write the value.
+ * @returns The byte after it.
+ */
+static const uint8_t * varint_get(const uint8_t * p, uint32_t * v) {
+	uint32_t r = 0;
+	int shift = 0;
+	for (; *p & 0x80; shift += 7) {
+		r |= (uint32_t)(*p++ & 0x7f) << shift;
+	}
+	*v = r | (uint32_t)*p++ << shift;
+	return p;
+}
+
+/**
+ * Maps a signed value to an unsigned one, small magnitudes to small
+ * values.
+ * @param v The value.
+ * @returns The mapped value.
+ */
+static uint32_t zigzag(int32_t v) {
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+/**
+ * Builds the image of a store. An account stored more than once is
+ * imaged as its first record, the one the store answers with. MUST be
+ * called before the server forks.
+ * @param dbfile The store.
+ * @param stats Where to write the size of the image, may be NULL.
+ * @returns 0 on success, -1 on error.
+ */
+int compact_build(const char * dbfile, struct compact_stats_t * stats) {
+	int fd = open(dbfile, O_RDONLY);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	struct stat sb;
+	if (fstat(fd, &sb) < 0) {
+		perror("fstat error");
+		close(fd);
+		return -1;
+	}
+
+	size_t nrecs = sb.st_size / sizeof(struct record_t);
+	if (nrecs == 0 || nrecs > UINT32_MAX) {
+		fprintf(stderr, "compact error: %zu records\n", nrecs);
+		close(fd);
+		return -1;
+	}
+
+	struct record_t * recs = mmap(NULL, nrecs * sizeof(struct record_t), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (recs == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+	madvise(recs, nrecs * sizeof(struct record_t), MADV_SEQUENTIAL);
+
+	// order the accounts, a store written in order needs no sort
+	struct order_t * order = malloc(nrecs * sizeof(struct order_t));
+	uint32_t * nameof = malloc(nrecs * sizeof(uint32_t));
+	struct name_t * names = malloc(nrecs * sizeof(struct name_t));
+	size_t nbuckets = 1;
+	while (nbuckets < 2 * nrecs) {
+		nbuckets <<= 1;
+	}
+	uint32_t * buckets = calloc(nbuckets, sizeof(uint32_t));
+	if (order == NULL || nameof == NULL || names == NULL || buckets == NULL) {
+		fprintf(stderr, "compact error: out of memory\n");
+		free(order);
+		free(nameof);
+		free(names);
+		free(buckets);
+		munmap(recs, nrecs * sizeof(struct record_t));
+		return -1;
+	}
+
+	int sorted = 1;
+	for (size_t i = 0; i < nrecs; i++) {
+		order[i].acctnum = recs[i].acctnum;
+		order[i].pos = i;
+		sorted &= i == 0 || order[i - 1].acctnum < order[i].acctnum;
+	}
+	if (!sorted) {
+		qsort(order, nrecs, sizeof(struct order_t), cmp_order);
+	}
+
+	size_t n = 0;
+	for (size_t i = 0; i < nrecs; i++) {
+		if (n == 0 || order[n - 1].acctnum != order[i].acctnum) {
+			order[n++] = order[i];
+		}
+	}
+
+	// intern the names, counting their uses
+	size_t nnames = 0;
+	for (size_t i = 0; i < n; i++) {
+		const char * name = recs[order[i].pos].name;
+		size_t len = strnlen(name, sizeof(recs->name));
+		size_t b = hash_name(name, len) & (nbuckets - 1);
+		for (; buckets[b] != 0; b = (b + 1) & (nbuckets - 1)) {
+			const char * other = recs[names[buckets[b] - 1].pos].name;
+			if (strnlen(other, sizeof(recs->name)) == len && memcmp(other, name, len) == 0) {
+				break;
+			}
+		}
+		if (buckets[b] == 0) {
+			names[nnames].pos = order[i].pos;
+			names[nnames].count = 0;
+			buckets[b] = ++nnames;
+		}
+		names[buckets[b] - 1].count++;
+		nameof[i] = buckets[b] - 1;
+	}
+
+	// the most used names get the shortest ids, reusing the buckets; a
+	//	name of a single account is kept inline instead
+	uint32_t * rank = buckets, * ids = buckets + nnames;
+	for (size_t i = 0; i < nnames; i++) {
+		rank[i] = i;
+	}
+	ranked = names;
+	qsort(rank, nnames, sizeof(uint32_t), cmp_uses);
+
+	size_t ndict = 0, pool_len = 0;
+	for (; ndict < nnames && names[rank[ndict]].count > 1; ndict++) {
+		ids[rank[ndict]] = ndict;
+		pool_len += strnlen(recs[names[rank[ndict]].pos].name, sizeof(recs->name));
+	}
+
+	size_t packed_len = 0;
+	for (size_t i = 0; i < n; i++) {
+		const struct record_t * rec = &recs[order[i].pos];
+		if (names[nameof[i]].count > 1) {
+			packed_len += varint_len(ids[nameof[i]] << 1);
+		} else {
+			packed_len += 1 + strnlen(rec->name, sizeof(recs->name));
+		}
+		packed_len += varint_len(zigzag(rec->age));
+	}
+
+	size_t nblocks = (n + COMPACT_BLOCK - 1) / COMPACT_BLOCK;
+	size_t bytes = n * (sizeof(int32_t) + sizeof(uint32_t)) + nblocks * sizeof(uint32_t)
+			+ (ndict + 1) * sizeof(uint32_t) + pool_len + packed_len;
+	void * addr = MAP_FAILED;
+	if (pool_len <= UINT32_MAX && packed_len <= UINT32_MAX) {
+		addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	}
+	if (addr == MAP_FAILED) {
+		fprintf(stderr, "compact error: cannot map %zu bytes\n", bytes);
+		free(order);
+		free(nameof);
+		free(names);
+		free(buckets);
+		munmap(recs, nrecs * sizeof(struct record_t));
+		return -1;
+	}
+
+	// the word arrays first, keeping them aligned
+	image.n = n;
+	image.accts = addr;
+	image.values = (uint32_t *)(image.accts + n);
+	image.blocks = image.values + n;
+	image.names = image.blocks + nblocks;
+	image.pool = (char *)(image.names + ndict + 1);
+	image.packed = (uint8_t *)image.pool + pool_len;
+
+	uint32_t off = 0;
+	for (size_t i = 0; i < ndict; i++) {
+		const char * name = recs[names[rank[i]].pos].name;
+		size_t len = strnlen(name, sizeof(recs->name));
+		image.names[i] = off;
+		memcpy(image.pool + off, name, len);
+		off += len;
+	}
+	image.names[ndict] = off;
+
+	uint8_t * p = image.packed;
+	for (size_t i = 0; i < n; i++) {
+		const struct record_t * rec = &recs[order[i].pos];
+		if (i % COMPACT_BLOCK == 0) {
+			image.blocks[i / COMPACT_BLOCK] = p - image.packed;
+		}
+		image.accts[i] = rec->acctnum;
+		memcpy(&image.values[i], &rec->value, sizeof(uint32_t));
+		if (names[nameof[i]].count > 1) {
+			p = varint_put(p, ids[nameof[i]] << 1);
+		} else {
+			size_t len = strnlen(rec->name, sizeof(recs->name));
+			p = varint_put(p, len << 1 | 1);
+			memcpy(p, rec->name, len);
+			p += len;
+		}
+		p = varint_put(p, zigzag(rec->age));
+	}
+
+	free(order);
+	free(nameof);
+	free(names);
+	free(buckets);
+	munmap(recs, nrecs * sizeof(struct record_t));
+
+	if (stats != NULL) {
+		stats->accounts = n;
+		stats->names = nnames;
+		stats->bytes = bytes;
+	}
+	return 0;
+}
+
+/**
+ * Finds the slot of an account.
+ * @param acctnum The account.
+ * @returns Its slot, or the number of accounts if it is not imaged.
+ */
+static size_t find_slot(int acctnum) {
+	size_t lo = 0, hi = image.n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (image.accts[mid] < acctnum) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo < image.n && image.accts[lo] == acctnum ? lo : image.n;
+}
+
+/**
+ * Looks up an account in the image.
+ * @param acctnum The account.
+ * @param record Where to write its record.
+ * @returns 0 on success, -1 if the account is not imaged.
+ */
+int compact_query(int acctnum, struct record_t * record) {
+	size_t slot = find_slot(acctnum);
+	if (slot == image.n) {
+		return -1;
+	}
+
+	uint32_t bits = __atomic_load_n(&image.values[slot], __ATOMIC_RELAXED);
+	record->acctnum = acctnum;
+	memcpy(&record->value, &bits, sizeof(float));
+
+	// skip to the record through its block
+	uint32_t tag, age;
+	const uint8_t * p = image.packed + image.blocks[slot / COMPACT_BLOCK];
+	for (size_t i = slot % COMPACT_BLOCK; ; i--) {
+		p = varint_get(p, &tag);
+		const uint8_t * name = p;
+		p = varint_get(p + (tag & 1 ? tag >> 1 : 0), &age);
+		if (i > 0) {
+			continue;
+		}
+
+		memset(record->name, 0, sizeof(record->name));
+		if (tag & 1) {
+			memcpy(record->name, name, tag >> 1);
+		} else {
+			uint32_t id = tag >> 1;
+			memcpy(record->name, image.pool + image.names[id], image.names[id + 1] - image.names[id]);
+		}
+		break;
+	}
+	record->age = (int32_t)(age >> 1) ^ -(int32_t)(age & 1);
+	return 0;
+}
+
+/**
+ * Writes the new value of an account through to the image, if imaged.
+ * @param acctnum The account.
+ * @param value Its value.
+ */
+void compact_update(int acctnum, float value) {
+	size_t slot = find_slot(acctnum);
+	if (slot == image.n) {
+		return;
+	}
+
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+	__atomic_store_n(&image.values[slot], bits, __ATOMIC_RELAXED);
+}
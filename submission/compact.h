@@ -0,0 +1,46 @@
+/**
+ * Compact image of the record store, for keeping stores too large for
+ * memory as record_t arrays in memory. The accounts are kept as a
+ * dense sorted array with their values beside it. Names shared by
+ * accounts are interned in a dictionary, the most used first; the
+ * dictionary id of every record's name, or the name itself when no
+ * other account has it, and its age are packed as varints in blocks
+ * of COMPACT_BLOCK records, each block found through its offset. A lookup binary
+ * searches the accounts and decodes at most a block, rebuilding the
+ * record_t the store holds, its name zero padded.
+ *
+ * Once built only values change, written through by the store as
+ * changes commit, so lookups take no lock: the other fields never
+ * change and a value is a single word. The image lives in a shared
+ * mapping built before the server forks; records appended to the
+ * store later are not in it.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include <stddef.h>
+
+#include "proto.h"
+
+// compact defines
+#define COMPACT_BLOCK 8 // records per block of packed fields
+
+// the size of an image
+struct compact_stats_t {
+	size_t accounts;
+	size_t names; // distinct names
+	size_t bytes; // memory of the image
+};
+
+//
+// PROTOTYPES
+//
+
+int compact_build(const char *, struct compact_stats_t *);
+int compact_query(int, struct record_t *);
+void compact_update(int, float);
+
+#endif
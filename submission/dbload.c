@@ -0,0 +1,758 @@
+/**
+ * Implements dbload, which builds a store from CSV or binary record
+ * files in one pass instead of one write per record. Inputs are split
+ * into chunks that parser threads turn into records and sort by
+ * account; the sorted chunks are merged, keeping the last record of
+ * every account, and written out in large sequential writes together
+ * with the index of the store, see store.h. Needs about twice the size
+ * of the store in memory.
+ *
+ * CSV lines hold acctnum,name,value,age; the name may be quoted. Lines
+ * that do not parse, a header line included, are counted and skipped.
+ *
+ * With -Z the store is tiered, see tier.h: the records of its cold
+ * tier, the store and the inputs are merged, in that order, and every
+ * record not served within the given number of seconds goes to the
+ * cold tier, the rest to the store. Records are known served by their
+ * stamps, which follow them to their new place in the store; loaded
+ * records were never served. Loading a tiered store without -Z leaves
+ * its cold tier as it is.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Add -Z, moving idle records to the cold tier.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+
+#include "proto.h"
+#include "store.h"
+#include "tier.h"
+
+// dbload defines
+#define DBFILE "db20"
+#define MAXTHREADS 64
+#define LINEMAX 256 // longest CSV line accepted
+#define WRITE_RECS 131072 // records per write of the store, 4 MiB
+
+// a piece of one input, parsed and sorted by one thread
+struct chunk_t {
+	const char * start;
+	const char * end;
+	int binary; // holds record_t, not CSV
+	struct record_t * recs; // parsed, then sorted by account
+	size_t nrecs;
+	size_t bad; // lines that did not parse
+};
+
+//
+// dbload configuration - set from the command line
+//
+
+static char * dbfile = DBFILE;
+static int nthreads = 0; // 0 for one per cpu
+static int keep = 0; // load the records already in the store first
+static int binary = 0; // inputs are binary record files
+static long idle = -1; // demote records not served for this many seconds, -1 to keep them
+static int tiered = 0; // the store has a cold tier, or gets one
+static uint32_t now;
+
+// the stamp of an account of the store, sorted by account
+struct seen_t {
+	int32_t acctnum;
+	uint32_t stamp;
+};
+
+static struct seen_t * seen = NULL;
+static size_t nseen = 0;
+
+// the chunks of every input, in input order
+static struct chunk_t * chunks = NULL;
+static int nchunks = 0;
+static int next_chunk = 0; // the next chunk a thread takes
+
+//
+// PROTOTYPES
+//
+
+int add_chunks(const char *, size_t, int);
+int add_input(char *, int);
+int cmp_seen(const void *, const void *);
+void * grow(void *, size_t *, size_t);
+int load_stamps();
+int main(int, char * []);
+int parse_chunk(struct chunk_t *);
+int parse_line(char *, struct record_t *);
+void * parse_worker(void *);
+void print_usage(char *);
+int sort_chunk(struct chunk_t *);
+int write_file(char *, const void *, size_t, const void *, size_t);
+ssize_t write_store(size_t *, size_t *);
+
+//
+// METHODS
+//
+
+/**
+ * Prints command line usage.
+ * @param prog The name the program was invoked with.
+ */
+void print_usage(char * prog) {
+	printf("usage: %s [-o dbfile] [-t threads] [-a] [-B] [-Z idle] <input>...\n", prog);
+	printf("\t-o The store to build (default %s).\n", DBFILE);
+	printf("\t-t The number of parser threads (default one per cpu).\n");
+	printf("\t-a Keep the records of the store, loaded records replace them.\n");
+	printf("\t-B The inputs are binary record files, not CSV.\n");
+	printf("\t-Z Tier the store, records not served for idle seconds go to\n");
+	printf("\t   its cold tier; implies -a, the inputs may be left out.\n");
+	printf("Records loaded later replace earlier records of the same account.\n");
+	printf("The store MUST NOT be served while it is loaded.\n");
+}
+
+/**
+ * Maps an input and splits it into chunks, see add_chunks.
+ * @param path The input.
+ * @param is_binary The input holds record_t.
+ * @returns 0 on success, -1 on error.
+ */
+int add_input(char * path, int is_binary) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		perror("stat error");
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	const char * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+	madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+	return add_chunks(data, st.st_size, is_binary);
+}
+
+/**
+ * Splits an input into one chunk per thread, cut at line or record
+ * boundaries.
+ * @param data The input.
+ * @param len Its length.
+ * @param is_binary The input holds record_t.
+ * @returns 0 on success, -1 on error.
+ */
+int add_chunks(const char * data, size_t len, int is_binary) {
+	struct chunk_t * grown = realloc(chunks, (nchunks + nthreads) * sizeof(struct chunk_t));
+	if (grown == NULL) {
+		perror("realloc error");
+		return -1;
+	}
+	chunks = grown;
+
+	const char * end = data + len, * start = data;
+	size_t step = len / nthreads;
+	for (int i = 0; i < nthreads && start < end; i++) {
+		const char * cut = i == nthreads - 1 ? end : start + step;
+		if (is_binary) {
+			cut = data + (cut - data) / sizeof(struct record_t) * sizeof(struct record_t);
+		} else {
+			while (cut < end && cut[-1] != '\n') {
+				cut++;
+			}
+		}
+		if (cut <= start) {
+			continue;
+		}
+
+		memset(&chunks[nchunks], 0, sizeof(struct chunk_t));
+		chunks[nchunks].start = start;
+		chunks[nchunks].end = cut;
+		chunks[nchunks++].binary = is_binary;
+		start = cut;
+	}
+
+	return 0;
+}
+
+/**
+ * Parses one CSV line.
+ * @param line The line, NUL terminated, without its newline.
+ * @param rec The record to fill.
+ * @returns 0 on success, -1 if the line does not parse.
+ */
+int parse_line(char * line, struct record_t * rec) {
+	char * p = line, * end;
+	memset(rec, 0, sizeof(*rec));
+
+	errno = 0;
+	long acctnum = strtol(p, &end, 10);
+	if (end == p || errno != 0 || acctnum < INT32_MIN || acctnum > INT32_MAX) {
+		return -1;
+	}
+	rec->acctnum = acctnum;
+	for (p = end; isspace((unsigned char)*p); p++);
+	if (*p++ != ',') {
+		return -1;
+	}
+
+	// the name, quoted if it holds commas, cut to fit the record
+	for (; isspace((unsigned char)*p); p++);
+	size_t len = 0;
+	if (*p == '"') {
+		for (p++; *p != '\0' && !(p[0] == '"' && p[1] != '"'); p++) {
+			p += p[0] == '"'; // "" stands for "
+			if (len < sizeof(rec->name) - 1) {
+				rec->name[len++] = *p;
+			}
+		}
+		if (*p++ != '"') {
+			return -1;
+		}
+		for (; isspace((unsigned char)*p); p++);
+	} else {
+		for (; *p != '\0' && *p != ','; p++) {
+			if (len < sizeof(rec->name) - 1) {
+				rec->name[len++] = *p;
+			}
+		}
+		while (len > 0 && isspace((unsigned char)rec->name[len - 1])) {
+			rec->name[--len] = '\0';
+		}
+	}
+	if (*p++ != ',') {
+		return -1;
+	}
+
+	rec->value = strtof(p, &end);
+	if (end == p) {
+		return -1;
+	}
+	for (p = end; isspace((unsigned char)*p); p++);
+	if (*p++ != ',') {
+		return -1;
+	}
+
+	long age = strtol(p, &end, 10);
+	if (end == p) {
+		return -1;
+	}
+	rec->age = age;
+	for (p = end; isspace((unsigned char)*p); p++);
+	return *p == '\0' ? 0 : -1;
+}
+
+/**
+ * Turns a chunk into records.
+ * @param chunk The chunk.
+ * @returns 0 on success, -1 on error.
+ */
+int parse_chunk(struct chunk_t * chunk) {
+	size_t len = chunk->end - chunk->start;
+	if (chunk->binary) {
+		chunk->nrecs = len / sizeof(struct record_t);
+		if ((chunk->recs = malloc(len)) == NULL) {
+			return -1;
+		}
+		memcpy(chunk->recs, chunk->start, len);
+		return 0;
+	}
+
+	// a line holds at least 8 bytes, "1,a,1,1\n", grow past typical lines
+	size_t cap = len / 32 + 16;
+	if ((chunk->recs = malloc(cap * sizeof(struct record_t))) == NULL) {
+		return -1;
+	}
+
+	for (const char * p = chunk->start; p < chunk->end;) {
+		const char * eol = memchr(p, '\n', chunk->end - p);
+		if (eol == NULL) {
+			eol = chunk->end;
+		}
+
+		// copied so parsing never runs off the end of the mapping
+		char line[LINEMAX];
+		size_t n = eol - p;
+		if (n > 0 && p[n - 1] == '\r') {
+			n--;
+		}
+
+		if (n >= sizeof(line)) {
+			chunk->bad++;
+		} else if (n > 0) {
+			memcpy(line, p, n);
+			line[n] = '\0';
+
+			if (chunk->nrecs == cap) {
+				struct record_t * grown = realloc(chunk->recs, 2 * cap * sizeof(struct record_t));
+				if (grown == NULL) {
+					return -1;
+				}
+				chunk->recs = grown;
+				cap *= 2;
+			}
+
+			if (parse_line(line, &chunk->recs[chunk->nrecs]) == 0) {
+				chunk->nrecs++;
+			} else {
+				chunk->bad++;
+			}
+		}
+		p = eol + 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Sorts the records of a chunk by account with a radix sort. It is
+ * stable, so records of the same account stay in input order. Skips
+ * the bytes every account shares.
+ * @param chunk The chunk.
+ * @returns 0 on success, -1 on error.
+ */
+int sort_chunk(struct chunk_t * chunk) {
+	size_t n = chunk->nrecs;
+	struct record_t * src = chunk->recs, * dst = malloc(n * sizeof(struct record_t) + 1);
+	if (dst == NULL) {
+		return -1;
+	}
+
+	for (int shift = 0; shift < 32; shift += 8) {
+		size_t counts[256] = { 0 };
+		for (size_t i = 0; i < n; i++) {
+			// flipping the sign bit orders negative accounts first
+			counts[(((uint32_t)src[i].acctnum ^ 0x80000000) >> shift) & 0xff]++;
+		}
+		if (n == 0 || counts[(((uint32_t)src[0].acctnum ^ 0x80000000) >> shift) & 0xff] == n) {
+			continue;
+		}
+
+		size_t pos = 0;
+		for (int b = 0; b < 256; b++) {
+			size_t count = counts[b];
+			counts[b] = pos;
+			pos += count;
+		}
+		for (size_t i = 0; i < n; i++) {
+			dst[counts[(((uint32_t)src[i].acctnum ^ 0x80000000) >> shift) & 0xff]++] = src[i];
+		}
+
+		struct record_t * swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	free(dst);
+	chunk->recs = src;
+	return 0;
+}
+
+/**
+ * Parses and sorts chunks until none are left.
+ * @param arg Unused.
+ * @returns NULL on success, non NULL on error.
+ */
+void * parse_worker(void * arg) {
+	(void)arg;
+	int i;
+	while ((i = __atomic_fetch_add(&next_chunk, 1, __ATOMIC_RELAXED)) < nchunks) {
+		if (parse_chunk(&chunks[i]) < 0 || sort_chunk(&chunks[i]) < 0) {
+			perror("parse error");
+			return (void *)1;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Orders stamps by account.
+ */
+int cmp_seen(const void * a, const void * b) {
+	const struct seen_t * x = a, * y = b;
+	return (x->acctnum > y->acctnum) - (x->acctnum < y->acctnum);
+}
+
+/**
+ * Makes room for one more element of an array, doubling it when full.
+ * @param buf The array, may be NULL.
+ * @param cap Its capacity in elements, updated.
+ * @param size The size of an element.
+ * @returns The array, NULL if it could not grow; the old one is then
+ * still valid.
+ */
+void * grow(void * buf, size_t * cap, size_t size) {
+	size_t want = *cap ? 2 * *cap : 1024;
+	void * grown = realloc(buf, want * size);
+	if (grown != NULL) {
+		*cap = want;
+	}
+	return grown;
+}
+
+/**
+ * Reads the stamp of every account of the store. Records past the end
+ * of the stamp file were promoted after the server sized it, so they
+ * count as served now; without a stamp file none was ever served.
+ * @returns 0 on success, -1 on error.
+ */
+int load_stamps() {
+	char path[BUFMAX];
+	snprintf(path, sizeof(path), "%s%s", dbfile, STAMP_SUFFIX);
+	int fd = open(dbfile, O_RDONLY), sfd = open(path, O_RDONLY);
+	struct stat st, sst;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		if (sfd >= 0) {
+			close(sfd);
+		}
+		return errno == ENOENT ? 0 : -1;
+	}
+
+	size_t n = st.st_size / sizeof(struct record_t);
+	size_t nstamps = sfd >= 0 && fstat(sfd, &sst) == 0 ? sst.st_size / sizeof(uint32_t) : 0;
+	struct record_t * recs = n > 0 ? mmap(NULL, n * sizeof(struct record_t), PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	uint32_t * stamps = nstamps > 0 ? mmap(NULL, nstamps * sizeof(uint32_t), PROT_READ, MAP_PRIVATE, sfd, 0) : NULL;
+	close(fd);
+	if (sfd >= 0) {
+		close(sfd);
+	}
+	if (recs == MAP_FAILED || stamps == MAP_FAILED || (seen = malloc(n * sizeof(struct seen_t) + 1)) == NULL) {
+		perror("stamp error");
+		return -1;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		seen[i].acctnum = recs[i].acctnum;
+		seen[i].stamp = i < nstamps ? stamps[i] : sfd >= 0 ? now : 0;
+	}
+	nseen = n;
+	qsort(seen, nseen, sizeof(struct seen_t), cmp_seen);
+
+	if (recs != NULL) {
+		munmap(recs, n * sizeof(struct record_t));
+	}
+	if (stamps != NULL) {
+		munmap(stamps, nstamps * sizeof(uint32_t));
+	}
+	return 0;
+}
+
+/**
+ * Writes a file whole, through a temporary file renamed over it.
+ * @param path The file.
+ * @param head The bytes to start with.
+ * @param head_len The number of bytes to start with.
+ * @param body The bytes that follow, written in large writes.
+ * @param body_len The number of bytes that follow.
+ * @returns 0 on success, -1 on error.
+ */
+int write_file(char * path, const void * head, size_t head_len, const void * body, size_t body_len) {
+	char tmp[BUFMAX];
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	int rval = head_len > 0 && write(fd, head, head_len) != (ssize_t)head_len ? -1 : 0;
+	for (size_t off = 0; off < body_len && rval == 0;) {
+		ssize_t n = write(fd, (const char *)body + off, body_len - off);
+		if (n <= 0) {
+			rval = -1;
+		}
+		off += n;
+	}
+
+	if (rval < 0 || fsync(fd) < 0 || close(fd) < 0 || rename(tmp, path) < 0) {
+		perror("write error");
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Merges the sorted chunks into the store, the last record of every
+ * account wins, and writes the index of the store. A tiered store
+ * gets the stamps of its records written too, and with -Z its idle
+ * records are written to the cold tier instead.
+ * @param dups Set to the number of records replaced by later ones.
+ * @param ncold Set to the number of records in the cold tier.
+ * @returns The number of records written to the store, -1 on error.
+ */
+ssize_t write_store(size_t * dups, size_t * ncold) {
+	char tmp[BUFMAX], path[BUFMAX];
+	snprintf(tmp, sizeof(tmp), "%s.%d", dbfile, (int)getpid());
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	size_t * pos = calloc(nchunks, sizeof(size_t)), total = 0, nout = 0, nfences = 0, cap = 1024;
+	struct record_t * out = malloc(WRITE_RECS * sizeof(struct record_t));
+	int32_t * fences = malloc(cap * sizeof(int32_t));
+	if (pos == NULL || out == NULL || fences == NULL) {
+		perror("malloc error");
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+
+	struct record_t * cold = NULL;
+	uint32_t * stamps = NULL;
+	size_t cold_cap = 0, stamps_cap = 0, s = 0;
+
+	*dups = 0;
+	*ncold = 0;
+	int rval = 0, have = 0;
+	struct record_t last;
+	while (rval == 0) {
+		// the smallest account, the earliest chunk on ties
+		int c = -1;
+		for (int i = 0; i < nchunks; i++) {
+			if (pos[i] < chunks[i].nrecs
+					&& (c < 0 || chunks[i].recs[pos[i]].acctnum < chunks[c].recs[pos[c]].acctnum)) {
+				c = i;
+			}
+		}
+
+		// a later record of the same account replaces the held one
+		if (c >= 0 && have && chunks[c].recs[pos[c]].acctnum == last.acctnum) {
+			last = chunks[c].recs[pos[c]++];
+			(*dups)++;
+			continue;
+		}
+
+		// the stamps are sorted like the records, follow them along
+		uint32_t stamp = 0;
+		for (; have && s < nseen && seen[s].acctnum <= last.acctnum; s++) {
+			if (seen[s].acctnum == last.acctnum) {
+				stamp = seen[s].stamp;
+			}
+		}
+
+		if (have && idle >= 0 && (stamp == 0 || stamp + idle < now)) {
+			if (*ncold == cold_cap) {
+				struct record_t * grown = grow(cold, &cold_cap, sizeof(struct record_t));
+				if (grown == NULL) {
+					perror("realloc error");
+					rval = -1;
+					break;
+				}
+				cold = grown;
+			}
+			cold[(*ncold)++] = last;
+		} else if (have) {
+			if (tiered && total == stamps_cap) {
+				uint32_t * grown = grow(stamps, &stamps_cap, sizeof(uint32_t));
+				if (grown == NULL) {
+					perror("realloc error");
+					rval = -1;
+					break;
+				}
+				stamps = grown;
+			}
+			if (tiered) {
+				stamps[total] = stamp;
+			}
+
+			if (total % INDEX_EVERY == 0) {
+				if (nfences == cap) {
+					int32_t * grown = realloc(fences, 2 * cap * sizeof(int32_t));
+					if (grown == NULL) {
+						perror("realloc error");
+						rval = -1;
+						break;
+					}
+					fences = grown;
+					cap *= 2;
+				}
+				fences[nfences++] = last.acctnum;
+			}
+
+			out[nout++] = last;
+			total++;
+		}
+
+		if (nout > 0 && (nout == WRITE_RECS || c < 0)) {
+			if (write(fd, out, nout * sizeof(struct record_t)) != (ssize_t)(nout * sizeof(struct record_t))) {
+				perror("write error");
+				rval = -1;
+			}
+			nout = 0;
+		}
+
+		if (c < 0) {
+			break;
+		}
+		last = chunks[c].recs[pos[c]++];
+		have = 1;
+	}
+
+	if (rval == 0 && (fsync(fd) < 0 || close(fd) < 0)) {
+		perror("write error");
+		rval = -1;
+	} else if (rval < 0) {
+		close(fd);
+	}
+
+	// the cold tier goes before the store: until the store is replaced
+	//	its copies of the records demoted win
+	if (rval == 0 && idle >= 0) {
+		rval = tier_write(dbfile, cold, *ncold);
+	}
+
+	// the old index goes first, a store without one is only slower
+	struct index_hdr_t hdr = { INDEX_MAGIC, INDEX_EVERY, total };
+	snprintf(path, sizeof(path), "%s%s", dbfile, INDEX_SUFFIX);
+	if (rval == 0) {
+		unlink(path);
+	}
+	if (rval < 0 || rename(tmp, dbfile) < 0) {
+		perror("rename error");
+		unlink(tmp);
+		rval = -1;
+	} else {
+		rval = write_file(path, &hdr, sizeof(hdr), fences, nfences * sizeof(int32_t));
+	}
+
+	// the stamps follow the records to their new place
+	snprintf(path, sizeof(path), "%s%s", dbfile, STAMP_SUFFIX);
+	if (rval == 0 && tiered) {
+		rval = write_file(path, NULL, 0, stamps, total * sizeof(uint32_t));
+	}
+
+	free(cold);
+	free(stamps);
+	free(fences);
+	free(out);
+	free(pos);
+	return rval < 0 ? -1 : (ssize_t)total;
+}
+
+/**
+ * Entry point of dbload.
+ * @param argc Number of arguments passed via command line.
+ * @param argv Arguments passed via command line.
+ */
+int main(int argc, char * argv[]) {
+	int opt;
+	while ((opt = getopt(argc, argv, "o:t:aBZ:h")) != -1) {
+		switch (opt) {
+			case 'o': dbfile = optarg; break;
+			case 't': nthreads = atoi(optarg); break;
+			case 'a': keep = 1; break;
+			case 'B': binary = 1; break;
+			case 'Z': idle = atol(optarg); keep = 1; break;
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if ((optind >= argc && idle < 0) || idle < -1) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (nthreads <= 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (nthreads < 1 || nthreads > MAXTHREADS) {
+		nthreads = nthreads < 1 ? 1 : MAXTHREADS;
+	}
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	// the cold tier goes first, the store's copies of its records win
+	char path[BUFMAX];
+	snprintf(path, sizeof(path), "%s%s", dbfile, COLD_SUFFIX);
+	tiered = idle >= 0 || access(path, F_OK) == 0;
+	now = time(NULL);
+	if (tiered && load_stamps() < 0) {
+		return 1;
+	}
+
+	struct record_t * cold;
+	size_t ncold;
+	if (idle >= 0 && (tier_load(dbfile, &cold, &ncold) < 0
+			|| (ncold > 0 && add_chunks((const char *)cold, ncold * sizeof(struct record_t), 1) < 0))) {
+		return 1;
+	}
+
+	if (keep && access(dbfile, F_OK) == 0 && add_input(dbfile, 1) < 0) {
+		return 1;
+	}
+	for (int i = optind; i < argc; i++) {
+		if (add_input(argv[i], binary) < 0) {
+			return 1;
+		}
+	}
+
+	pthread_t threads[MAXTHREADS];
+	int started = 0, failed = 0;
+	for (; started < nthreads; started++) {
+		if (pthread_create(&threads[started], NULL, parse_worker, NULL) != 0) {
+			perror("pthread_create error");
+			break;
+		}
+	}
+	for (int i = 0; i < started; i++) {
+		void * res;
+		pthread_join(threads[i], &res);
+		failed |= res != NULL;
+	}
+	if (started == 0 || failed) {
+		return 1;
+	}
+
+	size_t bad = 0, dups;
+	for (int i = 0; i < nchunks; i++) {
+		bad += chunks[i].bad;
+	}
+
+	ssize_t total = write_store(&dups, &ncold);
+	if (total < 0) {
+		return 1;
+	}
+
+	// the redo log holds offsets into the old store
+	snprintf(path, sizeof(path), "%s%s", dbfile, LOG_SUFFIX);
+	unlink(path);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("Loaded %zd records into %s in %.2fs, %zu duplicates replaced, %zu lines skipped\n", total, dbfile,
+			(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, dups, bad);
+	if (idle >= 0) {
+		printf("%zu records not served for %lds are in %s%s\n", ncold, idle, dbfile, COLD_SUFFIX);
+	}
+	return 0;
+}
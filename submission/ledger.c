@@ -0,0 +1,383 @@
+/**
+ * Implements the ledger of the record store, see ledger.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ledger.h"
+#include "metrics.h"
+
+#define SEG_BYTES sizeof(struct seg_t) // a power of two
+#define SCAN_SEGS 4096 // segments read per read while rebuilding the table
+
+// the key of an account in the table, never 0
+#define LEDGER_KEY(acctnum) ((1ULL << 32) | (uint32_t)(acctnum))
+
+// a segment of the ledger file, the file starts with a segment of no
+//	account as its header, so no segment of an account is at offset 0
+struct seg_t {
+	uint32_t magic;
+	int32_t acctnum;
+	uint32_t ordinal; // 1 for the account's first segment
+	uint32_t unused;
+	uint64_t prev; // offset of the account's segment before, 0 for none
+	uint64_t skip; // offset of its segment ordinal - (ordinal & -ordinal), 0 for none
+	struct ledger_ent_t entries[LEDGER_SEG_ENTS];
+};
+
+// the newest segment of an account
+struct head_t {
+	uint64_t key; // LEDGER_KEY of the account, 0 for a free slot
+	uint64_t head; // offset of the newest segment + its entries, 0 for none
+	uint64_t last; // stamp of the newest entry in us
+};
+
+// the table of newest segments, shared by every worker
+struct ledger_t {
+	uint64_t tail; // offset of the next segment
+	uint64_t nslots; // a power of two
+	struct head_t slots[];
+};
+
+static int ledger_fd = -1; // shared by every worker
+static struct ledger_t * ledger = NULL; // NULL when unavailable
+
+//
+// PROTOTYPES
+//
+
+static struct head_t * head_slot(int, int);
+static int read_seg(uint64_t, struct seg_t *);
+static int rebuild(off_t);
+static uint64_t stamp_us(struct stamp_t);
+
+//
+// METHODS
+//
+
+/**
+ * Converts a stamp to microseconds.
+ * @param stamp The stamp.
+ * @returns The microseconds since the epoch.
+ */
+static uint64_t stamp_us(struct stamp_t stamp) {
+	return stamp.sec * 1000000ULL + stamp.usec;
+}
+
+/**
+ * Finds the slot of an account in the table.
+ * @param acctnum The account.
+ * @param claim Claim a free slot if the account has none.
+ * @returns The slot, NULL if the account has none.
+ */
+static struct head_t * head_slot(int acctnum, int claim) {
+	uint64_t key = LEDGER_KEY(acctnum);
+	uint32_t h = (uint32_t)acctnum * 0x9e3779b1;
+	for (int i = 0; i < LEDGER_PROBES; i++) {
+		struct head_t * slot = &ledger->slots[(h + i) & (ledger->nslots - 1)];
+		uint64_t found = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+		if (found == key) {
+			return slot;
+		} else if (found == 0 && claim) {
+			if (__atomic_compare_exchange_n(&slot->key, &found, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+					|| found == key) {
+				return slot;
+			}
+		} else if (found == 0) {
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Reads a segment. The entries of the newest segment that were never
+ * written read as zeros.
+ * @param offset The offset of the segment.
+ * @param seg The structure to read the segment into.
+ * @returns 0 on success, -1 on error.
+ */
+static int read_seg(uint64_t offset, struct seg_t * seg) {
+	memset(seg, 0, sizeof(*seg));
+	ssize_t bytes_read = pread(ledger_fd, seg, sizeof(*seg), offset);
+	METRIC_ADD(ledger_reads, 1);
+	if (bytes_read < (ssize_t)offsetof(struct seg_t, entries) || seg->magic != LEDGER_MAGIC) {
+		fprintf(stderr, "ledger segment at %lu unreadable\n", (unsigned long)offset);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Appends a change of an account to the ledger. The caller MUST hold
+ * the record lock of the account.
+ * @param acctnum The account.
+ * @param delta The change.
+ * @param balance The value of the account after the change.
+ * @returns 0 on success, -1 if the change could not be appended.
+ */
+int ledger_append(int acctnum, float delta, float balance) {
+	struct head_t * slot;
+	if (ledger == NULL || (slot = head_slot(acctnum, 1)) == NULL) {
+		METRIC_ADD(ledger_dropped, 1);
+		return -1;
+	}
+
+	// stamps of an account only move forward, even if the clock does not
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t us = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+	if (us <= slot->last) {
+		us = slot->last + 1;
+	}
+
+	struct ledger_ent_t ent;
+	ent.stamp.sec = us / 1000000;
+	ent.stamp.usec = us % 1000000;
+	ent.delta = delta;
+	ent.balance = balance;
+
+	uint64_t head = __atomic_load_n(&slot->head, __ATOMIC_RELAXED);
+	uint64_t offset = head & ~(SEG_BYTES - 1);
+	int n = head & (SEG_BYTES - 1);
+	if (head != 0 && n < LEDGER_SEG_ENTS) {
+		if (pwrite(ledger_fd, &ent, sizeof(ent), offset + offsetof(struct seg_t, entries) + n * sizeof(ent))
+				!= sizeof(ent)) {
+			perror("ledger error");
+			METRIC_ADD(ledger_dropped, 1);
+			return -1;
+		}
+		head++;
+	} else {
+		struct seg_t seg;
+		memset(&seg, 0, sizeof(seg));
+		seg.magic = LEDGER_MAGIC;
+		seg.acctnum = acctnum;
+		seg.ordinal = 1;
+		seg.entries[0] = ent;
+
+		if (head != 0) {
+			struct seg_t hop;
+			if (read_seg(offset, &hop) < 0) {
+				METRIC_ADD(ledger_dropped, 1);
+				return -1;
+			}
+			seg.ordinal = hop.ordinal + 1;
+			seg.prev = offset;
+
+			// the skip target is reached from the segment before
+			//	through its own skips
+			uint32_t target = seg.ordinal - (seg.ordinal & -seg.ordinal);
+			while (target > 0 && hop.ordinal > target) {
+				offset = hop.skip;
+				if (read_seg(offset, &hop) < 0) {
+					METRIC_ADD(ledger_dropped, 1);
+					return -1;
+				}
+			}
+			seg.skip = target > 0 ? offset : 0;
+		}
+
+		uint64_t at = __atomic_fetch_add(&ledger->tail, SEG_BYTES, __ATOMIC_RELAXED);
+		if (pwrite(ledger_fd, &seg, sizeof(seg), at) != sizeof(seg)) {
+			perror("ledger error");
+			METRIC_ADD(ledger_dropped, 1);
+			return -1;
+		}
+		head = at + 1;
+		METRIC_ADD(ledger_segments, 1);
+	}
+
+	slot->last = us;
+	__atomic_store_n(&slot->head, head, __ATOMIC_RELEASE);
+	METRIC_ADD(ledger_entries, 1);
+	return 0;
+}
+
+/**
+ * Reads the entries of an account in a time range, newest first.
+ * Segments that start after the range are skipped, then the entries
+ * are read back segment by segment.
+ * @param acctnum The account.
+ * @param from The oldest stamp of the range.
+ * @param to The stamp after the range.
+ * @param dest The buffer to read the entries into.
+ * @param max The most entries to read, the newest of the range.
+ * @returns The number of entries read, -1 on error.
+ */
+int ledger_history(int acctnum, struct stamp_t from, struct stamp_t to, struct ledger_ent_t * dest, int max) {
+	struct head_t * slot;
+	if (ledger == NULL) {
+		return -1;
+	} else if ((slot = head_slot(acctnum, 0)) == NULL) {
+		return 0;
+	}
+
+	uint64_t head = __atomic_load_n(&slot->head, __ATOMIC_ACQUIRE);
+	if (head == 0) {
+		return 0;
+	}
+
+	struct seg_t seg, skip;
+	int n = head & (SEG_BYTES - 1);
+	if (read_seg(head & ~(SEG_BYTES - 1), &seg) < 0) {
+		return -1;
+	}
+
+	// every segment after one that starts at or after the range does
+	//	too, skip over them
+	uint64_t lo = stamp_us(from), hi = stamp_us(to);
+	while (stamp_us(seg.entries[0].stamp) >= hi) {
+		if (seg.skip != 0) {
+			if (read_seg(seg.skip, &skip) < 0) {
+				return -1;
+			} else if (stamp_us(skip.entries[0].stamp) >= hi) {
+				seg = skip;
+				n = LEDGER_SEG_ENTS;
+				continue;
+			}
+		}
+
+		if (seg.prev == 0) {
+			return 0;
+		} else if (seg.prev == seg.skip) {
+			seg = skip;
+		} else if (read_seg(seg.prev, &seg) < 0) {
+			return -1;
+		}
+		n = LEDGER_SEG_ENTS;
+	}
+
+	int count = 0;
+	while (1) {
+		for (int i = n - 1; i >= 0 && count < max; i--) {
+			uint64_t us = stamp_us(seg.entries[i].stamp);
+			if (us < lo) {
+				return count;
+			} else if (us < hi) {
+				dest[count++] = seg.entries[i];
+			}
+		}
+
+		if (count == max || seg.prev == 0) {
+			return count;
+		} else if (read_seg(seg.prev, &seg) < 0) {
+			return -1;
+		}
+		n = LEDGER_SEG_ENTS;
+	}
+}
+
+/**
+ * Fills the table from the ledger file. Segments are allocated in
+ * file order, so the last segment of an account is its newest.
+ * @param size The size of the ledger file.
+ * @returns The number of segments read, -1 on error.
+ */
+static int rebuild(off_t size) {
+	struct seg_t * buf = malloc(SCAN_SEGS * SEG_BYTES);
+	if (buf == NULL) {
+		perror("malloc error");
+		return -1;
+	}
+
+	int nsegs = 0;
+	off_t off = SEG_BYTES;
+	ssize_t bytes_read;
+	while (off < size && (bytes_read = pread(ledger_fd, buf, SCAN_SEGS * SEG_BYTES, off)) > 0) {
+		// the newest segment may end short of its unwritten entries
+		memset((char *)buf + bytes_read, 0, SCAN_SEGS * SEG_BYTES - bytes_read);
+		int nread = (bytes_read + SEG_BYTES - 1) / SEG_BYTES;
+
+		for (int i = 0; i < nread; i++) {
+			struct seg_t * seg = &buf[i];
+			struct head_t * slot;
+			if (seg->magic != LEDGER_MAGIC || (slot = head_slot(seg->acctnum, 1)) == NULL) {
+				continue; // torn, or an account the table has no room for
+			}
+
+			int n = 0;
+			while (n < LEDGER_SEG_ENTS && seg->entries[n].stamp.sec != 0) {
+				n++;
+			}
+			if (n > 0) {
+				slot->head = off + i * SEG_BYTES + n;
+				slot->last = stamp_us(seg->entries[n - 1].stamp);
+				nsegs++;
+			}
+		}
+		off += nread * SEG_BYTES;
+	}
+
+	free(buf);
+	ledger->tail = off > size ? (uint64_t)off : ((uint64_t)size + SEG_BYTES - 1) & ~(SEG_BYTES - 1);
+	return nsegs;
+}
+
+/**
+ * Opens the ledger of a store and maps the table of its accounts,
+ * sized for twice the records in the store. MUST be called before the
+ * server forks.
+ * @param dbfile The store.
+ * @returns 0 on success, -1 on error.
+ */
+int ledger_init(const char * dbfile) {
+	char path[BUFMAX/4];
+	snprintf(path, sizeof(path), "%s%s", dbfile, LEDGER_SUFFIX);
+
+	struct stat st;
+	size_t nslots = LEDGER_MIN_ACCTS;
+	if (stat(dbfile, &st) == 0) {
+		while (nslots < 2 * (st.st_size / sizeof(struct record_t))) {
+			nslots *= 2;
+		}
+	}
+
+	if ((ledger_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0 || fstat(ledger_fd, &st) < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	// a new ledger gets its header, an old one must have it
+	struct seg_t hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = LEDGER_MAGIC;
+	if (st.st_size == 0) {
+		if (pwrite(ledger_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+			perror("write error");
+			return -1;
+		}
+		st.st_size = sizeof(hdr);
+	} else if (pread(ledger_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != LEDGER_MAGIC) {
+		fprintf(stderr, "%s is not a ledger\n", path);
+		return -1;
+	}
+
+	size_t len = sizeof(struct ledger_t) + nslots * sizeof(struct head_t);
+	void * addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+
+	ledger = addr;
+	ledger->nslots = nslots;
+	if (rebuild(st.st_size) < 0) {
+		munmap(addr, len);
+		ledger = NULL;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,48 @@
+/**
+ * Ledger of the record store. Every committed change of an account is
+ * appended to the ledger file next to the store as an entry of its
+ * stamp, the change and the balance after it, so an account's
+ * statement can be rebuilt from the server alone.
+ *
+ * The file is cut into segments of LEDGER_SEG_ENTS entries, each
+ * holding the entries of a single account in time order. A segment
+ * points at the account's segment before it and, for the n-th segment
+ * of the account, at its (n - lowest set bit of n)-th, so a time range
+ * is found walking back from the newest segment in a logarithmic
+ * number of segment reads and read out with one more per segment it
+ * spans. The newest segment of every account is kept in a table shared
+ * by every worker, rebuilt from the file at startup.
+ *
+ * Entries are appended while the account's record lock is held, so
+ * they are written in commit order, with a pwrite into the page cache.
+ * The ledger is not synced and not covered by the redo log: a crash of
+ * the host can lose the newest entries. A combined round of updates of
+ * a hot account is an entry per worker stripe it drained, so updates of
+ * workers sharing a stripe are only told apart when they land in
+ * different rounds.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - An entry per stripe of a combined round.
+ */
+
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include "proto.h"
+
+// ledger defines
+#define LEDGER_SUFFIX ".ldg" // the ledger sits next to the store
+#define LEDGER_MAGIC 0x43424c44 // marks the file and every segment
+#define LEDGER_SEG_ENTS 14 // entries per segment, 256 byte segments
+#define LEDGER_MIN_ACCTS 4096 // the table has room for at least this many
+#define LEDGER_PROBES 32 // slots tried for an account before giving up on it
+
+//
+// PROTOTYPES
+//
+
+int ledger_append(int, float, float);
+int ledger_history(int, struct stamp_t, struct stamp_t, struct ledger_ent_t *, int);
+int ledger_init(const char *);
+
+#endif
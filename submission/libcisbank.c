@@ -0,0 +1,1415 @@
+/**
+ * Implements the CISBANK client library, see cisbank.h.
+ * Changelog:
+ *	10/18/2026 - Created from the networking code in client.c.
+ *			   - Add connection pool and pipelined async requests.
+ *			   - Add cisbank_stats.
+ *			   - Report shed requests as CISBANK_EBUSY.
+ *			   - Add request deadlines and retried service lookups.
+ *			   - Connect to servers on this host over their unix socket.
+ *			   - Add transfers and multi-record transactions.
+ *			   - Updates return the updated record.
+ *			   - Locate the service mapper through mapper.c, lookups
+ *				 go straight to a mapper that answered before.
+ *			   - Add cisbank_scan.
+ *			   - Add cisbank_history.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cisbank.h"
+#include "mapper.h"
+
+// library defines
+#define CLIENT_PORT 0 // any port
+#define PKTSIZE sizeof(struct pkt_t)
+
+//
+// connection pool stuff
+//
+
+// a request waiting on its reply
+struct op_t {
+	cisbank_cb_t cb; // NULL once the request timed out
+	void * arg;
+	int acctnum;
+	double deadline; // ms on the monotonic clock, 0 for none
+};
+
+// a pooled connection to one shard, replies arrive in request order
+struct conn_t {
+	int fd; // -1 when not connected
+	int connecting; // non-blocking connect still in progress
+	int busy; // last reply was busy, the server may be shedding us
+	struct sockaddr_in remote;
+	int local; // the server is on this host, try its unix socket first
+
+	// requests sent or queued, oldest first
+	struct op_t ops[CISBANK_MAXINFLIGHT];
+	int head, count;
+
+	// packets queued for sending
+	char sendbuf[CISBANK_MAXINFLIGHT * PKTSIZE];
+	size_t sendoff, sendlen;
+
+	// partially received replies
+	char recvbuf[16 * PKTSIZE];
+	size_t recvlen;
+};
+
+struct cisbank_t {
+	int nshards;
+	int poolsize;
+	struct conn_t * conns; // poolsize connections per shard
+	int pending; // requests awaiting a reply across all connections
+	int timeout; // ms a request may take, 0 for no limit
+	char lasterror[BUFMAX/4]; // message from the last failed sync request
+};
+
+// a batch of a scan, held until the batches before it are handed over
+struct scan_slot_t {
+	int done;
+	int status;
+	uint32_t next; // the cursor after the batch
+	int count;
+	struct record_t records[SCAN_BATCH];
+	char message[BUFMAX/4];
+};
+
+// filled in by the sync wrappers
+struct sync_t {
+	int done;
+	struct cisbank_result_t result;
+	char message[BUFMAX/4];
+};
+
+// a page of a history, filled in by history_cb
+struct history_page_t {
+	struct sync_t sync;
+	struct history_t history;
+};
+
+//
+// PROTOTYPES
+//
+
+static int conn_connect(struct conn_t *);
+static int conn_fail(struct cisbank_t *, struct conn_t *);
+static int conn_flush(struct cisbank_t *, struct conn_t *);
+static int conn_read(struct cisbank_t *, struct conn_t *);
+static void decode_addrstr(char *, char *, unsigned short *, int *);
+static int expire_ops(struct cisbank_t *, double *);
+static void history_cb(struct cisbank_result_t *, void *);
+static int is_local_addr(struct in_addr);
+static int lookup_service(const char *, char *, struct sockaddr_in *, int *);
+static double now_ms();
+static void parse_string(char *, char * [], int, char *);
+static struct conn_t * pick_conn(struct cisbank_t *, int);
+static int reply_done(struct cisbank_t *, struct conn_t *, struct pkt_t *);
+static void scan_cb(struct cisbank_result_t *, void *);
+static int submit(struct cisbank_t *, int, struct pkt_t *, int, cisbank_cb_t, void *);
+static int submit_error(struct cisbank_t *);
+static void sync_cb(struct cisbank_result_t *, void *);
+static int sync_wait(struct cisbank_t *, struct sync_t *);
+
+//
+// METHODS
+//
+
+/**
+ * Decodes an address string storing the IP address in \'ip\' and
+ * the port in \'port\'.
+ * @param addrstr A pointer to a buffer containing the address
+ * string received from the server.
+ * @param ip A pointer to stored the IP address in.
+ * @param port A pointer to stored the port number in.
+ * @param local A pointer to store whether the server offers the
+ * local transport in.
+ */
+static void decode_addrstr(char * addrstr, char *ip, unsigned short * port, int * local) {
+	char * tokens[7];
+	tokens[6] = NULL;
+	parse_string(addrstr, tokens, 7, ",");
+
+	// BUG REPORT - snprintf does not work here
+	//	will print 127.0.1 into ip not 127.0.1.1
+	for (int i = 0; i < 4; i++) {
+		strcat(ip, tokens[i]);
+		if (i < 3) {
+			strcat(ip, ".");
+		}
+	}
+	*port = (atoi(tokens[4]) * 256) + atoi(tokens[5]);
+	*local = tokens[6] != NULL && strcmp(tokens[6], LOCAL_FLAG) == 0;
+}
+
+/**
+ * Checks if an address belongs to this host, only this host can
+ * bind to it.
+ * @param addr The address to check.
+ * @returns 1 if the address is local, 0 otherwise.
+ */
+static int is_local_addr(struct in_addr addr) {
+	int sk;
+	if ((sk = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		return 0;
+	}
+
+	struct sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(CLIENT_PORT);
+	local.sin_addr = addr;
+
+	int rval = bind(sk, (struct sockaddr *)&local, sizeof(local)) == 0;
+	close(sk);
+	return rval;
+}
+
+/**
+ * Splits a string into tokens, reentrant so handles on other threads
+ * can parse at the same time.
+ * @param src The buffer containing the string to parse.
+ * @param dest The destination buffer for src tokens.
+ * @param n The number of tokens to store in dest.
+ * @param delim The tokenization delimeter.
+ */
+static void parse_string(char * src, char * dest[], int n, char * delim) {
+	int tokens = 0;
+	char * save;
+	char * token = strtok_r(src, delim, &save);
+	do {
+		dest[tokens++] = token;
+	} while (tokens < n && (token = strtok_r(NULL, delim, &save)) != NULL);
+}
+
+/**
+ * Gets the time on the monotonic clock.
+ * @returns The time in ms.
+ */
+static double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Requests a service from the service mapper.
+ * @param mapper_addr The address of the service mapper, NULL to
+ * locate it.
+ * @param service The service to request.
+ * @param dest The destination socket address to intialize.
+ * @returns 0 on success, -1 in error.
+ */
+int cisbank_request_service(const char * mapper_addr, char * service, struct sockaddr_in * dest) {
+	int local;
+	return lookup_service(mapper_addr, service, dest, &local);
+}
+
+/**
+ * Requests a service from the service mapper. The lookup is resent
+ * with a doubling wait until the mapper answers, up to
+ * CISBANK_LOOKUP_TRIES times. A located mapper that stops answering
+ * is located again by broadcast.
+ * @param mapper_addr The address of the service mapper, NULL to
+ * locate it.
+ * @param service The service to request.
+ * @param dest The destination socket address to intialize.
+ * @param is_local Set when the server is on this host and offers the
+ * local transport.
+ * @returns 0 on success, -1 in error.
+ */
+static int lookup_service(const char * mapper_addr, char * service, struct sockaddr_in * dest, int * is_local) {
+	struct sockaddr_in local, remote, from;
+	socklen_t len=sizeof(local), rlen=sizeof(remote), flen=sizeof(from);
+	int sk;
+	char sendbuf[BUFMAX], recvbuf[BUFMAX];
+
+	if ((sk = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		return -1;
+	}
+
+	local.sin_family = AF_INET;
+	local.sin_port = htons(CLIENT_PORT);
+	local.sin_addr.s_addr = INADDR_ANY;
+
+	if (bind(sk, (struct sockaddr *)&local, len) < 0) {
+		close(sk);
+		return -1;
+	}
+
+	int how = mapper_locate(mapper_addr, &remote);
+
+	// enable broadcasting on the socket
+	int broadcast = 1;
+	if (setsockopt(sk, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
+		close(sk);
+		return -1;
+	}
+
+	// construct a packet to send
+	struct pkt_t pkt;
+
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ptype = htons(PTYPE_LOOKUP);
+	snprintf(pkt.body.message, sizeof(pkt.body.message), "GET %s%c", service, '\0');
+	memset(sendbuf, 0, sizeof(sendbuf));
+
+	int wait = CISBANK_LOOKUP_WAIT;
+	for (int try = 0; ; try++, wait *= 2) {
+		if (try == CISBANK_LOOKUP_TRIES) {
+			close(sk);
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		// the mapper drops lookups that waited longer than this try
+		pkt.budget = htons(wait);
+		memcpy(sendbuf, &pkt, sizeof(struct pkt_t));
+
+		// attempt to send a packet
+		if (sendto(sk, sendbuf, sizeof(struct pkt_t), 0, (struct sockaddr *)&remote, rlen) != sizeof(struct pkt_t)) {
+			close(sk);
+			return -1;
+		}
+
+		// attempt to receive a packet, a reply to an earlier try will do
+		struct pollfd pfd = { sk, POLLIN, 0 };
+		if (poll(&pfd, 1, wait) <= 0) {
+			// the mapper moved or died, broadcast for it again
+			if (how == MAPPER_CACHED) {
+				mapper_forget(remote.sin_addr);
+				how = mapper_locate(NULL, &remote);
+			}
+			continue;
+		}
+
+		if (recvfrom(sk, recvbuf, sizeof(struct pkt_t), 0, (struct sockaddr *)&from, &flen) == sizeof(struct pkt_t)) {
+			break;
+		}
+	}
+
+	close(sk);
+
+	// later lookups skip the broadcast
+	if (how == MAPPER_BROADCAST) {
+		mapper_learn(from.sin_addr);
+	}
+
+	// receive over the same packet
+	memcpy(&pkt, recvbuf, sizeof(struct pkt_t));
+	pkt.ptype = ntohs(pkt.ptype);
+
+	// check packet format
+	if (pkt.ptype != PTYPE_LOOKUP) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	// decode the pkt contents
+	char raddr[24];
+	unsigned short rport;
+	memset(raddr, 0, sizeof(raddr));
+	decode_addrstr(pkt.body.message, raddr, &rport, is_local);
+
+	// set the fields in the dest socket address
+	memset(dest, 0, sizeof(struct sockaddr_in));
+	dest->sin_family = AF_INET;
+	dest->sin_port = rport; // port's already in big endian
+	dest->sin_addr.s_addr = inet_addr(raddr);
+	*is_local = *is_local && is_local_addr(dest->sin_addr);
+
+	return 0;
+}
+
+/**
+ * Opens a client handle, resolving every shard of the service.
+ * Connections are opened lazily by the first request that uses them.
+ * @param mapper_addr The address of the service mapper, NULL to
+ * locate it.
+ * @param nshards The number of shards the service is split across.
+ * @param poolsize The number of connections to keep to each shard,
+ * 0 for CISBANK_POOLSIZE.
+ * @returns The handle on success, NULL on error.
+ */
+struct cisbank_t * cisbank_open(const char * mapper_addr, int nshards, int poolsize) {
+	if (nshards < 1 || nshards > MAXSHARDS || poolsize < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct cisbank_t * cb = calloc(1, sizeof(struct cisbank_t));
+	if (cb == NULL) {
+		return NULL;
+	}
+
+	cb->nshards = nshards;
+	cb->poolsize = poolsize > 0 ? poolsize : CISBANK_POOLSIZE;
+	cb->timeout = CISBANK_TIMEOUT;
+	if ((cb->conns = calloc(nshards * cb->poolsize, sizeof(struct conn_t))) == NULL) {
+		free(cb);
+		return NULL;
+	}
+
+	char service[20];
+	for (int i = 0; i < nshards; i++) {
+		// sharded services register each shard separately
+		if (nshards > 1) {
+			snprintf(service, sizeof(service), "%s/shard-%d", SERVICE_NAME, i);
+		} else {
+			snprintf(service, sizeof(service), "%s", SERVICE_NAME);
+		}
+
+		struct sockaddr_in remote;
+		int local;
+		if (lookup_service(mapper_addr, service, &remote, &local) < 0) {
+			free(cb->conns);
+			free(cb);
+			return NULL;
+		}
+
+		for (int j = 0; j < cb->poolsize; j++) {
+			struct conn_t * conn = &cb->conns[i * cb->poolsize + j];
+			conn->fd = -1;
+			conn->remote = remote;
+			conn->local = local;
+		}
+	}
+
+	return cb;
+}
+
+/**
+ * Closes a client handle. Requests still in flight are failed with
+ * CISBANK_ENET.
+ * @param cb The handle to close.
+ */
+void cisbank_close(struct cisbank_t * cb) {
+	if (cb == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < cb->nshards * cb->poolsize; i++) {
+		if (cb->conns[i].fd >= 0) {
+			conn_fail(cb, &cb->conns[i]);
+		}
+	}
+
+	free(cb->conns);
+	free(cb);
+}
+
+/**
+ * Gets the server message of the last failed sync request.
+ * @param cb The client handle.
+ * @returns The message, empty if there is none.
+ */
+const char * cisbank_lasterror(struct cisbank_t * cb) {
+	return cb->lasterror;
+}
+
+/**
+ * Sets how long each later request may take before it completes with
+ * CISBANK_ETIMEDOUT. The server drops requests it cannot start in
+ * time.
+ * @param cb The client handle.
+ * @param timeout The ms a request may take, at most MAXBUDGET, 0 for
+ * no limit.
+ */
+void cisbank_set_timeout(struct cisbank_t * cb, int timeout) {
+	cb->timeout = timeout < 0 ? 0 : timeout > MAXBUDGET ? MAXBUDGET : timeout;
+}
+
+/**
+ * Gets the number of requests still awaiting a reply.
+ * @param cb The client handle.
+ * @returns The number of pending requests.
+ */
+int cisbank_pending(struct cisbank_t * cb) {
+	return cb->pending;
+}
+
+/**
+ * Starts a non-blocking connect to the connection's shard. Servers
+ * on this host are reached over their unix socket, falling back to
+ * TCP when it is missing or full.
+ * @param conn The connection to open.
+ * @returns 0 on success, -1 on error.
+ */
+static int conn_connect(struct conn_t * conn) {
+	int sk = -1;
+	conn->connecting = 0;
+
+	if (conn->local) {
+		struct sockaddr_un local;
+		memset(&local, 0, sizeof(local));
+		local.sun_family = AF_UNIX;
+		snprintf(local.sun_path, sizeof(local.sun_path), LOCAL_PATH, ntohs(conn->remote.sin_port));
+
+		// unix sockets connect right away or not at all
+		if ((sk = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0
+				&& (fcntl(sk, F_SETFL, fcntl(sk, F_GETFL) | O_NONBLOCK) < 0
+				|| connect(sk, (struct sockaddr *)&local, sizeof(local)) < 0)) {
+			close(sk);
+			sk = -1;
+		}
+	}
+
+	if (sk < 0) {
+		if ((sk = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+			return -1;
+		}
+
+		// requests are small, never hold them back
+		int nodelay = 1;
+		setsockopt(sk, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+		if (fcntl(sk, F_SETFL, fcntl(sk, F_GETFL) | O_NONBLOCK) < 0) {
+			close(sk);
+			return -1;
+		}
+
+		if (connect(sk, (struct sockaddr *)&conn->remote, sizeof(conn->remote)) < 0) {
+			if (errno != EINPROGRESS) {
+				close(sk);
+				return -1;
+			}
+			conn->connecting = 1;
+		}
+	}
+
+	conn->fd = sk;
+	conn->busy = 0;
+	conn->head = conn->count = 0;
+	conn->sendoff = conn->sendlen = 0;
+	conn->recvlen = 0;
+	return 0;
+}
+
+/**
+ * Closes a connection, failing every request in flight on it.
+ * @param cb The client handle.
+ * @param conn The connection that failed.
+ * @returns The number of requests failed.
+ */
+static int conn_fail(struct cisbank_t * cb, struct conn_t * conn) {
+	close(conn->fd);
+	conn->fd = -1;
+	conn->connecting = 0;
+	conn->sendoff = conn->sendlen = 0;
+	conn->recvlen = 0;
+
+	// a shed connection closes right after its busy reply
+	int status = conn->busy ? CISBANK_EBUSY : CISBANK_ENET;
+	conn->busy = 0;
+
+	// detach the ops first, callbacks may submit new requests, the
+	// timed out ones already completed
+	struct op_t ops[CISBANK_MAXINFLIGHT];
+	int count = 0;
+	for (int i = 0; i < conn->count; i++) {
+		struct op_t * op = &conn->ops[(conn->head + i) % CISBANK_MAXINFLIGHT];
+		if (op->cb != NULL) {
+			ops[count++] = *op;
+		}
+	}
+	conn->head = conn->count = 0;
+	cb->pending -= count;
+
+	for (int i = 0; i < count; i++) {
+		struct cisbank_result_t result;
+		memset(&result, 0, sizeof(result));
+		result.status = status;
+		result.acctnum = ops[i].acctnum;
+		result.message = status == CISBANK_EBUSY ? "Server busy, try again later!" : "Connection to server failed!";
+		ops[i].cb(&result, ops[i].arg);
+	}
+
+	return count;
+}
+
+/**
+ * Sends as much of the queued packets as the socket accepts.
+ * @param cb The client handle.
+ * @param conn The connection to flush.
+ * @returns 0 on success, -1 if the connection failed.
+ */
+static int conn_flush(struct cisbank_t * cb, struct conn_t * conn) {
+	while (conn->sendoff < conn->sendlen) {
+		ssize_t net_bytes = send(conn->fd, conn->sendbuf + conn->sendoff,
+				conn->sendlen - conn->sendoff, MSG_NOSIGNAL);
+		if (net_bytes < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			conn_fail(cb, conn);
+			return -1;
+		}
+		conn->sendoff += net_bytes;
+	}
+
+	if (conn->sendoff == conn->sendlen) {
+		conn->sendoff = conn->sendlen = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * Reads replies off a connection and completes their requests.
+ * @param cb The client handle.
+ * @param conn The connection to read.
+ * @returns The number of requests completed, -1 if the connection
+ * failed.
+ */
+static int conn_read(struct cisbank_t * cb, struct conn_t * conn) {
+	int completed = 0;
+
+	while (1) {
+		ssize_t net_bytes = recv(conn->fd, conn->recvbuf + conn->recvlen,
+				sizeof(conn->recvbuf) - conn->recvlen, 0);
+		if (net_bytes < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return completed;
+			}
+			conn_fail(cb, conn);
+			return -1;
+		} else if (net_bytes == 0) { // server closed the connection
+			conn_fail(cb, conn);
+			return -1;
+		}
+		conn->recvlen += net_bytes;
+
+		// complete every whole reply received
+		size_t off = 0;
+		while (conn->recvlen - off >= PKTSIZE) {
+			if (conn->count == 0) { // reply nobody asked for
+				conn_fail(cb, conn);
+				return -1;
+			}
+
+			struct pkt_t pkt;
+			memcpy(&pkt, conn->recvbuf + off, PKTSIZE);
+			off += PKTSIZE;
+			completed += reply_done(cb, conn, &pkt);
+
+			// the callback may have failed the connection
+			if (conn->fd < 0) {
+				return completed;
+			}
+		}
+
+		memmove(conn->recvbuf, conn->recvbuf + off, conn->recvlen - off);
+		conn->recvlen -= off;
+	}
+}
+
+/**
+ * Decodes a reply and hands it to the oldest request's callback.
+ * @param cb The client handle.
+ * @param conn The connection the reply arrived on.
+ * @param pkt The reply, in network byte order.
+ * @returns 1 if a request completed, 0 if the reply was late and
+ * discarded.
+ */
+static int reply_done(struct cisbank_t * cb, struct conn_t * conn, struct pkt_t * pkt) {
+	struct op_t op = conn->ops[conn->head];
+	conn->head = (conn->head + 1) % CISBANK_MAXINFLIGHT;
+	conn->count--;
+	if (op.cb == NULL) { // the request already timed out
+		return 0;
+	}
+	cb->pending--;
+
+	struct cisbank_result_t result;
+	memset(&result, 0, sizeof(result));
+	result.acctnum = op.acctnum;
+
+	pkt->ptype = ntohs(pkt->ptype);
+	pkt->body.message[sizeof(pkt->body.message) - 1] = '\0';
+	conn->busy = pkt->ptype == PTYPE_BUSY;
+	if (pkt->ptype == PTYPE_RECORD) {
+		// convert the fields to local byte order
+		result.status = CISBANK_OK;
+		result.record = pkt->body.record;
+		result.record.acctnum = ntohl(result.record.acctnum);
+		result.record.age = ntohl(result.record.age);
+		int * ip = (int *)&result.record.value;
+		*ip = ntohl(*ip);
+		result.message = "";
+	} else if (pkt->ptype == PTYPE_TRANSFER && ntohl(pkt->body.transfer_result.code) == DB_TRANSFER_RETURN_CODE) {
+		// convert both records to local byte order
+		struct record_t * records[2] = { &result.record, &result.to };
+		for (int i = 0; i < 2; i++) {
+			*records[i] = pkt->body.transfer_result.records[i];
+			records[i]->acctnum = ntohl(records[i]->acctnum);
+			records[i]->age = ntohl(records[i]->age);
+			int * ip = (int *)&records[i]->value;
+			*ip = ntohl(*ip);
+		}
+		result.status = CISBANK_OK;
+		result.message = "";
+	} else if ((pkt->ptype == PTYPE_UPDATE || pkt->ptype == PTYPE_TRANSFER || pkt->ptype == PTYPE_TXN)
+			&& strcmp(pkt->body.message, "OK") == 0) {
+		result.status = CISBANK_OK;
+		result.message = pkt->body.message;
+	} else if (pkt->ptype == PTYPE_SCAN) {
+		// convert the batch to local byte order in place
+		struct scan_t * scan = &pkt->body.scan;
+		scan->cursor = ntohl(scan->cursor);
+		scan->next = ntohl(scan->next);
+		scan->count = ntohl(scan->count);
+		if (scan->count > SCAN_BATCH) {
+			scan->count = SCAN_BATCH;
+		}
+		for (uint32_t i = 0; i < scan->count; i++) {
+			scan->records[i].acctnum = ntohl(scan->records[i].acctnum);
+			scan->records[i].age = ntohl(scan->records[i].age);
+			int * ip = (int *)&scan->records[i].value;
+			*ip = ntohl(*ip);
+		}
+		result.status = CISBANK_OK;
+		result.scan = scan;
+		result.message = "";
+	} else if (pkt->ptype == PTYPE_HISTORY) {
+		// convert the page to local byte order in place
+		struct history_t * history = &pkt->body.history;
+		history->acctnum = ntohl(history->acctnum);
+		history->count = ntohl(history->count);
+		history->to.sec = ntohl(history->to.sec);
+		history->to.usec = ntohl(history->to.usec);
+		if (history->count > HISTORY_MAX) {
+			history->count = HISTORY_MAX;
+		}
+		for (uint32_t i = 0; i < history->count; i++) {
+			struct ledger_ent_t * ent = &history->entries[i];
+			ent->stamp.sec = ntohl(ent->stamp.sec);
+			ent->stamp.usec = ntohl(ent->stamp.usec);
+			int * ip = (int *)&ent->delta;
+			*ip = ntohl(*ip);
+			ip = (int *)&ent->balance;
+			*ip = ntohl(*ip);
+		}
+		result.status = CISBANK_OK;
+		result.history = history;
+		result.message = "";
+	} else if (pkt->ptype == PTYPE_STATS) {
+		result.status = CISBANK_OK;
+		result.message = pkt->body.message;
+	} else if (pkt->ptype == PTYPE_BUSY) {
+		result.status = CISBANK_EBUSY;
+		result.message = pkt->body.message;
+	} else {
+		result.status = CISBANK_ESERVER;
+		result.message = pkt->body.message;
+	}
+
+	op.cb(&result, op.arg);
+	return 1;
+}
+
+/**
+ * Picks the least loaded connection to a shard, connecting it if
+ * needed.
+ * @param cb The client handle.
+ * @param shard The shard the request is for.
+ * @returns The connection, NULL if every connection is full or none
+ * could be opened.
+ */
+static struct conn_t * pick_conn(struct cisbank_t * cb, int shard) {
+	struct conn_t * pool = &cb->conns[shard * cb->poolsize];
+	struct conn_t * best = NULL;
+
+	for (int i = 0; i < cb->poolsize; i++) {
+		struct conn_t * conn = &pool[i];
+
+		// the server closes connections that sat idle, reopen them
+		char byte;
+		if (conn->fd >= 0 && conn->count == 0 && !conn->connecting
+				&& recv(conn->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+			conn_fail(cb, conn);
+		}
+
+		if (conn->fd < 0) {
+			// only open a new connection once the open ones are busy
+			if (best != NULL && best->count == 0) {
+				continue;
+			}
+			if (conn_connect(conn) < 0) {
+				continue;
+			}
+		}
+		if (best == NULL || conn->count < best->count) {
+			best = conn;
+		}
+	}
+
+	if (best == NULL || best->count == CISBANK_MAXINFLIGHT) {
+		return NULL;
+	}
+
+	return best;
+}
+
+/**
+ * Queues a request on a connection to a shard.
+ * @param cb The client handle.
+ * @param shard The shard to send the request to.
+ * @param pkt The request, in network byte order.
+ * @param acctnum The account the request is for.
+ * @param callback The callback to run with the result.
+ * @param arg The user argument handed to the callback.
+ * @returns 0 on success, -1 on error.
+ */
+static int submit(struct cisbank_t * cb, int shard, struct pkt_t * pkt, int acctnum, cisbank_cb_t callback, void * arg) {
+	struct conn_t * conn;
+	double deadline = cb->timeout > 0 ? now_ms() + cb->timeout : 0;
+
+	// wait for a slot when every connection is full
+	while ((conn = pick_conn(cb, shard)) == NULL) {
+		if (cb->pending == 0 || cisbank_poll(cb, -1) < 0) {
+			return -1;
+		}
+	}
+
+	// make room behind the bytes still unsent
+	if (conn->sendlen + PKTSIZE > sizeof(conn->sendbuf)) {
+		memmove(conn->sendbuf, conn->sendbuf + conn->sendoff, conn->sendlen - conn->sendoff);
+		conn->sendlen -= conn->sendoff;
+		conn->sendoff = 0;
+	}
+
+	// tell the server how much of the budget is left after waiting
+	// for a slot
+	if (deadline > 0) {
+		double left = deadline - now_ms();
+		pkt->budget = htons(left < 1 ? 1 : (unsigned short)left);
+	}
+	memcpy(conn->sendbuf + conn->sendlen, pkt, PKTSIZE);
+	conn->sendlen += PKTSIZE;
+
+	struct op_t * op = &conn->ops[(conn->head + conn->count) % CISBANK_MAXINFLIGHT];
+	op->cb = callback;
+	op->arg = arg;
+	op->acctnum = acctnum;
+	op->deadline = deadline;
+	conn->count++;
+	cb->pending++;
+
+	// send right away, anything left goes out from cisbank_poll
+	if (!conn->connecting) {
+		conn_flush(cb, conn);
+	}
+
+	return 0;
+}
+
+/**
+ * Completes the requests past their deadline with CISBANK_ETIMEDOUT.
+ * They stay queued on their connection so their late replies can be
+ * matched and discarded. A connection left with only timed out
+ * requests, the oldest a whole timeout past its deadline, is closed
+ * since the server is not answering.
+ * @param cb The client handle.
+ * @param next Set to the earliest deadline still pending, 0 for none.
+ * @returns The number of requests completed.
+ */
+static int expire_ops(struct cisbank_t * cb, double * next) {
+	int completed = 0;
+	double t = now_ms();
+
+	*next = 0;
+	for (int i = 0; i < cb->nshards * cb->poolsize; i++) {
+		struct conn_t * conn = &cb->conns[i];
+		if (conn->fd < 0 || conn->count == 0) {
+			continue;
+		}
+
+		int live = 0;
+		for (int j = 0; j < conn->count; j++) {
+			struct op_t * op = &conn->ops[(conn->head + j) % CISBANK_MAXINFLIGHT];
+			if (op->cb == NULL) {
+				continue;
+			} else if (op->deadline == 0 || t < op->deadline) {
+				live++;
+				if (op->deadline > 0 && (*next == 0 || op->deadline < *next)) {
+					*next = op->deadline;
+				}
+				continue;
+			}
+
+			// detach the callback first, it may submit new requests
+			cisbank_cb_t callback = op->cb;
+			op->cb = NULL;
+			cb->pending--;
+			completed++;
+
+			struct cisbank_result_t result;
+			memset(&result, 0, sizeof(result));
+			result.status = CISBANK_ETIMEDOUT;
+			result.acctnum = op->acctnum;
+			result.message = "Request timed out!";
+			callback(&result, op->arg);
+
+			// the callback may have failed the connection
+			if (conn->fd < 0) {
+				break;
+			}
+		}
+
+		// nobody waits on the connection and the server is not answering
+		struct op_t * oldest = &conn->ops[conn->head];
+		if (conn->fd >= 0 && live == 0 && conn->count > 0 && t >= oldest->deadline + cb->timeout) {
+			conn_fail(cb, conn);
+		}
+	}
+
+	return completed;
+}
+
+/**
+ * Waits for replies and runs the callbacks of completed requests,
+ * including the requests that timed out.
+ * @param cb The client handle.
+ * @param timeout The most milliseconds to wait, -1 to wait until at
+ * least one request completes.
+ * @returns The number of requests completed, -1 on error.
+ */
+int cisbank_poll(struct cisbank_t * cb, int timeout) {
+	int nconns = cb->nshards * cb->poolsize;
+	struct pollfd pfds[nconns];
+	struct conn_t * polled[nconns];
+
+	if (cb->pending == 0) {
+		return 0;
+	}
+
+	// wake up in time for the earliest deadline
+	double next;
+	int completed = expire_ops(cb, &next);
+	if (completed > 0) {
+		timeout = 0;
+	} else if (next > 0) {
+		int left = (int)(next - now_ms()) + 1;
+		if (timeout < 0 || left < timeout) {
+			timeout = left;
+		}
+	}
+
+	int npfds = 0;
+	for (int i = 0; i < nconns; i++) {
+		struct conn_t * conn = &cb->conns[i];
+		if (conn->fd < 0) {
+			continue;
+		}
+
+		pfds[npfds].fd = conn->fd;
+		pfds[npfds].events = 0;
+		if (conn->count > 0) {
+			pfds[npfds].events |= POLLIN;
+		}
+		if (conn->connecting || conn->sendoff < conn->sendlen) {
+			pfds[npfds].events |= POLLOUT;
+		}
+		pfds[npfds].revents = 0;
+		polled[npfds++] = conn;
+	}
+
+	int ready;
+	if ((ready = poll(pfds, npfds, timeout)) < 0) {
+		return errno == EINTR ? completed : -1;
+	}
+
+	for (int i = 0; i < npfds && ready > 0; i++) {
+		struct conn_t * conn = polled[i];
+		if (pfds[i].revents == 0 || conn->fd != pfds[i].fd) {
+			continue;
+		}
+		ready--;
+
+		if (conn->connecting) {
+			int err = 0;
+			socklen_t errlen = sizeof(err);
+			getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+			if (err != 0) {
+				completed += conn_fail(cb, conn);
+				continue;
+			}
+			conn->connecting = 0;
+		}
+
+		if (pfds[i].revents & (POLLOUT | POLLERR)) {
+			int count = conn->count;
+			if (conn_flush(cb, conn) < 0) {
+				completed += count;
+				continue;
+			}
+		}
+
+		if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+			int count = conn->count;
+			int n = conn_read(cb, conn);
+			completed += n < 0 ? count : n;
+		}
+	}
+
+	completed += expire_ops(cb, &next);
+	return completed;
+}
+
+/**
+ * Queries a record without waiting for the reply.
+ * @param cb The client handle.
+ * @param acctnum The account to query.
+ * @param callback The callback to run with the record.
+ * @param arg The user argument handed to the callback.
+ * @returns 0 on success, -1 on error.
+ */
+int cisbank_query_async(struct cisbank_t * cb, int acctnum, cisbank_cb_t callback, void * arg) {
+	struct pkt_t pkt;
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ptype = htons(PTYPE_QUERY);
+	pkt.body.query.code = htonl(DB_QUERY_CODE);
+	pkt.body.query.acctnum = htonl(acctnum);
+
+	return submit(cb, shard_of(acctnum, cb->nshards), &pkt, acctnum, callback, arg);
+}
+
+/**
+ * Adds a value to a record without waiting for the reply. The reply
+ * carries the record as it was written.
+ * @param cb The client handle.
+ * @param acctnum The account to update.
+ * @param value The value to add to the account.
+ * @param callback The callback to run with the updated record.
+ * @param arg The user argument handed to the callback.
+ * @returns 0 on success, -1 on error.
+ */
+int cisbank_update_async(struct cisbank_t * cb, int acctnum, float value, cisbank_cb_t callback, void * arg) {
+	struct pkt_t pkt;
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ptype = htons(PTYPE_UPDATE);
+	pkt.body.update.code = htonl(DB_UPDATE_RETURN_CODE);
+	pkt.body.update.acctnum = htonl(acctnum);
+	int * ip = (int *)&value;
+	*ip = htonl(*ip);
+	pkt.body.update.value = value;
+
+	return submit(cb, shard_of(acctnum, cb->nshards), &pkt, acctnum, callback, arg);
+}
+
+/**
+ * Moves an amount between two accounts without waiting for the reply.
+ * Both accounts MUST live on the same shard; the transfer fails
+ * rather than overdraw the source. A successful result carries the
+ * source record in record and the destination record in to.
+ * @param cb The client handle.
+ * @param from The account to take the amount from.
+ * @param to The account to add the amount to.
+ * @param amount The amount to move, greater than zero.
+ * @param callback The callback to run with the result.
+ * @param arg The user argument handed to the callback.
+ * @returns 0 on success, -1 on error, errno is EXDEV if the accounts
+ * are on different shards.
+ */
+int cisbank_transfer_async(struct cisbank_t * cb, int from, int to, float amount, cisbank_cb_t callback, void * arg) {
+	int shard = shard_of(from, cb->nshards);
+	if (shard_of(to, cb->nshards) != shard) {
+		errno = EXDEV;
+		return -1;
+	}
+
+	struct pkt_t pkt;
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ptype = htons(PTYPE_TRANSFER);
+	pkt.body.transfer.code = htonl(DB_TRANSFER_RETURN_CODE);
+	pkt.body.transfer.from = htonl(from);
+	pkt.body.transfer.to = htonl(to);
+	int * ip = (int *)&amount;
+	*ip = htonl(*ip);
+	pkt.body.transfer.amount = amount;
+
+	return submit(cb, shard, &pkt, from, callback, arg);
+}
+
+/**
+ * Applies a set of changes atomically without waiting for the reply,
+ * either every change applies or none does. Every account MUST live
+ * on the same shard.
+ * @param cb The client handle.
+ * @param ops The changes.
+ * @param n The number of changes, 1 to TXN_MAXOPS.
+ * @param callback The callback to run with the result.
+ * @param arg The user argument handed to the callback.
+ * @returns 0 on success, -1 on error, errno is EXDEV if the accounts
+ * are on different shards.
+ */
+int cisbank_txn_async(struct cisbank_t * cb, const struct txn_op_t * ops, int n, cisbank_cb_t callback, void * arg) {
+	if (n < 1 || n > TXN_MAXOPS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int shard = shard_of(ops[0].acctnum, cb->nshards);
+	struct pkt_t pkt;
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ptype = htons(PTYPE_TXN);
+	pkt.body.txn.code = htonl(DB_TXN_CODE);
+	pkt.body.txn.count = htonl(n);
+	for (int i = 0; i < n; i++) {
+		if (shard_of(ops[i].acctnum, cb->nshards) != shard) {
+			errno = EXDEV;
+			return -1;
+		}
+
+		float value = ops[i].value;
+		int * ip = (int *)&value;
+		*ip = htonl(*ip);
+		pkt.body.txn.ops[i].acctnum = htonl(ops[i].acctnum);
+		pkt.body.txn.ops[i].value = value;
+	}
+
+	return submit(cb, shard, &pkt, ops[0].acctnum, callback, arg);
+}
+
+/**
+ * Stores the result of a sync request.
+ * @param result The result of the request.
+ * @param arg The sync_t waiting on the request.
+ */
+static void sync_cb(struct cisbank_result_t * result, void * arg) {
+	struct sync_t * sync = arg;
+	sync->result = *result;
+	snprintf(sync->message, sizeof(sync->message), "%s", result->message);
+	sync->done = 1;
+}
+
+/**
+ * Keeps a history page for cisbank_history.
+ * @param result The result of the page request.
+ * @param arg The page.
+ */
+static void history_cb(struct cisbank_result_t * result, void * arg) {
+	struct history_page_t * page = arg;
+	if (result->status == CISBANK_OK) {
+		page->history = *result->history;
+	}
+	sync_cb(result, &page->sync);
+}
+
+/**
+ * Keeps a scan batch until cisbank_scan hands it over.
+ * @param result The result of the batch request.
+ * @param arg The slot of the batch.
+ */
+static void scan_cb(struct cisbank_result_t * result, void * arg) {
+	struct scan_slot_t * slot = arg;
+	slot->status = result->status;
+	if (result->status == CISBANK_OK) {
+		slot->next = result->scan->next;
+		slot->count = result->scan->count;
+		memcpy(slot->records, result->scan->records, slot->count * sizeof(struct record_t));
+	} else {
+		snprintf(slot->message, sizeof(slot->message), "%s", result->message);
+	}
+	slot->done = 1;
+}
+
+/**
+ * Maps a request that could not be sent to a status, keeping a
+ * message for cisbank_lasterror.
+ * @param cb The client handle.
+ * @returns The status of the request.
+ */
+static int submit_error(struct cisbank_t * cb) {
+	if (errno == EXDEV) {
+		snprintf(cb->lasterror, sizeof(cb->lasterror), "Accounts are on different shards!");
+		return CISBANK_EINVAL;
+	} else if (errno == EINVAL) {
+		snprintf(cb->lasterror, sizeof(cb->lasterror), "Invalid number of changes!");
+		return CISBANK_EINVAL;
+	}
+	return CISBANK_ENET;
+}
+
+/**
+ * Polls until a sync request completes.
+ * @param cb The client handle.
+ * @param sync The sync request to wait on.
+ * @returns The status of the request.
+ */
+static int sync_wait(struct cisbank_t * cb, struct sync_t * sync) {
+	while (!sync->done) {
+		if (cisbank_poll(cb, -1) < 0) {
+			return CISBANK_ENET;
+		}
+	}
+
+	if (sync->result.status != CISBANK_OK) {
+		snprintf(cb->lasterror, sizeof(cb->lasterror), "%s", sync->message);
+	}
+
+	return sync->result.status;
+}
+
+/**
+ * Queries a record.
+ * @param cb The client handle.
+ * @param acctnum The account to query.
+ * @param record The structure to write the record back to.
+ * @returns CISBANK_OK on success, a CISBANK_ error code on error.
+ */
+int cisbank_query(struct cisbank_t * cb, int acctnum, struct record_t * record) {
+	struct sync_t sync;
+	memset(&sync, 0, sizeof(sync));
+
+	if (cisbank_query_async(cb, acctnum, sync_cb, &sync) < 0) {
+		return CISBANK_ENET;
+	}
+
+	int status = sync_wait(cb, &sync);
+	if (status == CISBANK_OK) {
+		*record = sync.result.record;
+	}
+
+	return status;
+}
+
+/**
+ * Adds a value to a record.
+ * @param cb The client handle.
+ * @param acctnum The account to update.
+ * @param value The value to add to the account.
+ * @param record The structure to write the updated record to, may be
+ * NULL.
+ * @returns CISBANK_OK on success, a CISBANK_ error code on error.
+ */
+int cisbank_update(struct cisbank_t * cb, int acctnum, float value, struct record_t * record) {
+	struct sync_t sync;
+	memset(&sync, 0, sizeof(sync));
+
+	if (cisbank_update_async(cb, acctnum, value, sync_cb, &sync) < 0) {
+		return CISBANK_ENET;
+	}
+
+	int status = sync_wait(cb, &sync);
+	if (status == CISBANK_OK && record != NULL) {
+		*record = sync.result.record;
+	}
+
+	return status;
+}
+
+/**
+ * Moves an amount between two accounts on the same shard.
+ * @param cb The client handle.
+ * @param from The account to take the amount from.
+ * @param to The account to add the amount to.
+ * @param amount The amount to move, greater than zero.
+ * @param records The structures to write the source, then the
+ * destination record to as the transfer committed them, may be NULL.
+ * @returns CISBANK_OK on success, a CISBANK_ error code on error.
+ */
+int cisbank_transfer(struct cisbank_t * cb, int from, int to, float amount, struct record_t * records) {
+	struct sync_t sync;
+	memset(&sync, 0, sizeof(sync));
+
+	if (cisbank_transfer_async(cb, from, to, amount, sync_cb, &sync) < 0) {
+		return submit_error(cb);
+	}
+
+	int status = sync_wait(cb, &sync);
+	if (status == CISBANK_OK && records != NULL) {
+		records[0] = sync.result.record;
+		records[1] = sync.result.to;
+	}
+
+	return status;
+}
+
+/**
+ * Applies a set of changes to accounts on the same shard atomically.
+ * @param cb The client handle.
+ * @param ops The changes.
+ * @param n The number of changes, 1 to TXN_MAXOPS.
+ * @returns CISBANK_OK on success, a CISBANK_ error code on error.
+ */
+int cisbank_txn(struct cisbank_t * cb, const struct txn_op_t * ops, int n) {
+	struct sync_t sync;
+	memset(&sync, 0, sizeof(sync));
+
+	if (cisbank_txn_async(cb, ops, n, sync_cb, &sync) < 0) {
+		return submit_error(cb);
+	}
+
+	return sync_wait(cb, &sync);
+}
+
+/**
+ * Reads a section of a shard's server counters.
+ * @param cb The client handle.
+ * @param shard The shard to ask.
+ * @param section The section of counters, empty for the default.
+ * @param dest The buffer to write the counters to.
+ * @param len The length of the destination buffer.
+ * @returns CISBANK_OK on success, a CISBANK_ error code on error.
+ */
+int cisbank_stats(struct cisbank_t * cb, int shard, const char * section, char * dest, size_t len) {
+	if (shard < 0 || shard >= cb->nshards) {
+		return CISBANK_ESERVER;
+	}
+
+	struct pkt_t pkt;
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ptype = htons(PTYPE_STATS);
+	snprintf(pkt.body.message, sizeof(pkt.body.message), "%s", section ? section : "");
+
+	struct sync_t sync;
+	memset(&sync, 0, sizeof(sync));
+	if (submit(cb, shard, &pkt, 0, sync_cb, &sync) < 0) {
+		return CISBANK_ENET;
+	}
+
+	int status = sync_wait(cb, &sync);
+	if (status == CISBANK_OK) {
+		snprintf(dest, len, "%s", sync.message);
+	}
+
+	return status;
+}
+
+/**
+ * Reads every record of a shard in store order. CISBANK_SCAN_WINDOW
+ * batch requests are kept in flight over the shard's connections and
+ * the batches are handed to the callback in order; a batch is only
+ * requested once the one a window before it was handed over, so a slow
+ * callback holds the scan back instead of letting replies pile up.
+ * Records appended while the scan runs may or may not be seen.
+ * @param cb The client handle.
+ * @param shard The shard to scan.
+ * @param callback The callback to run with every batch, returning
+ * nonzero to stop the scan.
+ * @param arg The user argument handed to the callback.
+ * @returns CISBANK_OK once the scan reached the end or was stopped, a
+ * CISBANK_ error code on error.
+ */
+int cisbank_scan(struct cisbank_t * cb, int shard, cisbank_scan_cb_t callback, void * arg) {
+	if (shard < 0 || shard >= cb->nshards) {
+		return CISBANK_ESERVER;
+	}
+
+	struct scan_slot_t slots[CISBANK_SCAN_WINDOW];
+	uint32_t sent = 0, handed = 0; // batches requested, batches handed over
+	int status = CISBANK_OK, end = 0;
+
+	while (!end) {
+		while (sent - handed < CISBANK_SCAN_WINDOW) {
+			struct pkt_t pkt;
+			memset(&pkt, 0, sizeof(pkt));
+			pkt.ptype = htons(PTYPE_SCAN);
+			pkt.body.scan.cursor = htonl(sent * SCAN_BATCH);
+
+			struct scan_slot_t * slot = &slots[sent % CISBANK_SCAN_WINDOW];
+			slot->done = 0;
+			if (submit(cb, shard, &pkt, 0, scan_cb, slot) < 0) {
+				status = CISBANK_ENET;
+				snprintf(cb->lasterror, sizeof(cb->lasterror), "Connection to server failed!");
+				end = 1;
+				break;
+			}
+			sent++;
+		}
+
+		for (struct scan_slot_t * slot; !end && handed < sent
+				&& (slot = &slots[handed % CISBANK_SCAN_WINDOW])->done; handed++) {
+			if (slot->status != CISBANK_OK) {
+				status = slot->status;
+				snprintf(cb->lasterror, sizeof(cb->lasterror), "%s", slot->message);
+				end = 1;
+			} else if ((slot->count > 0 && callback(slot->records, slot->count, arg) != 0)
+					|| slot->next == SCAN_END) {
+				end = 1;
+			}
+		}
+
+		if (!end && cisbank_poll(cb, -1) < 0) {
+			status = CISBANK_ENET;
+			end = 1;
+		}
+	}
+
+	// the batches still in flight point into the slots, wait them out
+	//	or fail the shard's connections, which completes them
+	for (uint32_t i = handed; i < sent; i++) {
+		while (!slots[i % CISBANK_SCAN_WINDOW].done) {
+			if (cisbank_poll(cb, -1) < 0) {
+				for (int c = 0; c < cb->poolsize; c++) {
+					struct conn_t * conn = &cb->conns[shard * cb->poolsize + c];
+					if (conn->fd >= 0) {
+						conn_fail(cb, conn);
+					}
+				}
+			}
+		}
+	}
+
+	return status;
+}
+
+/**
+ * Reads the ledger of an account over a time range, newest entries
+ * first. The range is read a page at a time, every page asked for
+ * once the callback took the one before.
+ * @param cb The client handle.
+ * @param acctnum The account.
+ * @param from The start of the range in seconds since the epoch.
+ * @param to The end of the range in seconds since the epoch, not
+ * included.
+ * @param callback The callback to run with every page of entries,
+ * returning nonzero to stop.
+ * @param arg The user argument handed to the callback.
+ * @returns CISBANK_OK once the range was read or the callback stopped,
+ * a CISBANK_ error code on error.
+ */
+int cisbank_history(struct cisbank_t * cb, int acctnum, uint32_t from, uint32_t to,
+		cisbank_history_cb_t callback, void * arg) {
+	struct stamp_t end = { to, 0 };
+	while (1) {
+		struct pkt_t pkt;
+		memset(&pkt, 0, sizeof(pkt));
+		pkt.ptype = htons(PTYPE_HISTORY);
+		pkt.body.history.acctnum = htonl(acctnum);
+		pkt.body.history.from.sec = htonl(from);
+		pkt.body.history.to.sec = htonl(end.sec);
+		pkt.body.history.to.usec = htonl(end.usec);
+
+		struct history_page_t page;
+		memset(&page, 0, sizeof(page));
+		if (submit(cb, shard_of(acctnum, cb->nshards), &pkt, acctnum, history_cb, &page) < 0) {
+			return CISBANK_ENET;
+		}
+
+		int status = sync_wait(cb, &page.sync);
+		if (status != CISBANK_OK) {
+			return status;
+		} else if (page.history.count > 0 && callback(page.history.entries, page.history.count, arg) != 0) {
+			return CISBANK_OK;
+		} else if (page.history.count < HISTORY_MAX) {
+			return CISBANK_OK;
+		}
+		end = page.history.to;
+	}
+}
@@ -0,0 +1,170 @@
+/**
+ * Implements the block codec of the cold tier, see lz.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz.h"
+
+//
+// PROTOTYPES
+//
+
+static uint8_t * put_len(uint8_t *, size_t);
+static uint8_t * put_sequence(uint8_t *, const uint8_t *, size_t, size_t, size_t);
+
+//
+// METHODS
+//
+
+/**
+ * Writes the bytes that continue a length whose nibble was 15.
+ * @param p Where to write them.
+ * @param len The length less 15.
+ * @returns The byte after them.
+ */
+static uint8_t * put_len(uint8_t * p, size_t len) {
+	for (; len >= 255; len -= 255) {
+		*p++ = 255;
+	}
+	*p++ = len;
+	return p;
+}
+
+/**
+ * Writes a sequence.
+ * @param p Where to write it.
+ * @param lits The literals.
+ * @param nlits The number of literals.
+ * @param dist The distance of the match, 0 for the last sequence.
+ * @param mlen The length of the match.
+ * @returns The byte after the sequence.
+ */
+static uint8_t * put_sequence(uint8_t * p, const uint8_t * lits, size_t nlits, size_t dist, size_t mlen) {
+	uint8_t * token = p++;
+	size_t m = dist > 0 ? mlen - LZ_MIN_MATCH : 0;
+	*token = (nlits < 15 ? nlits : 15) << 4 | (m < 15 ? m : 15);
+	if (nlits >= 15) {
+		p = put_len(p, nlits - 15);
+	}
+	memcpy(p, lits, nlits);
+	p += nlits;
+
+	if (dist > 0) {
+		*p++ = dist & 0xff;
+		*p++ = dist >> 8;
+		if (m >= 15) {
+			p = put_len(p, m - 15);
+		}
+	}
+	return p;
+}
+
+/**
+ * Compresses a block.
+ * @param src The block.
+ * @param len Its length.
+ * @param dst Where to write the compressed block, LZ_BOUND(len) bytes.
+ * @returns The compressed length.
+ */
+size_t lz_compress(const void * src, size_t len, void * dst) {
+	const uint8_t * in = src;
+	uint8_t * out = dst;
+	uint32_t table[1 << LZ_HASH_BITS];
+	memset(table, 0xff, sizeof(table));
+
+	size_t anchor = 0, i = 0;
+	while (i + LZ_MIN_MATCH <= len) {
+		uint32_t word;
+		memcpy(&word, in + i, sizeof(word));
+		uint32_t h = (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t cand = table[h];
+		table[h] = i;
+
+		if (cand == UINT32_MAX || i - cand > LZ_MAX_DIST || memcmp(in + cand, in + i, LZ_MIN_MATCH) != 0) {
+			i++;
+			continue;
+		}
+
+		size_t mlen = LZ_MIN_MATCH;
+		while (i + mlen < len && in[cand + mlen] == in[i + mlen]) {
+			mlen++;
+		}
+		out = put_sequence(out, in + anchor, i - anchor, i - cand, mlen);
+		i += mlen;
+		anchor = i;
+	}
+
+	out = put_sequence(out, in + anchor, len - anchor, 0, 0);
+	return out - (uint8_t *)dst;
+}
+
+/**
+ * Decompresses a block, checking every length and distance against
+ * both buffers.
+ * @param src The compressed block.
+ * @param len Its length.
+ * @param dst Where to write the block.
+ * @param cap The room at dst.
+ * @returns The length of the block, -1 if it is corrupt or does not
+ * fit.
+ */
+ssize_t lz_decompress(const void * src, size_t len, void * dst, size_t cap) {
+	const uint8_t * in = src, * end = in + len;
+	uint8_t * out = dst, * out_end = out + cap;
+
+	while (in < end) {
+		uint8_t token = *in++;
+		size_t nlits = token >> 4, mlen = token & 15;
+		if (nlits == 15) {
+			uint8_t b;
+			do {
+				if (in == end) {
+					return -1;
+				}
+				nlits += b = *in++;
+			} while (b == 255);
+		}
+		if (nlits > (size_t)(end - in) || nlits > (size_t)(out_end - out)) {
+			return -1;
+		}
+		memcpy(out, in, nlits);
+		in += nlits;
+		out += nlits;
+
+		// the last sequence has no match
+		if (in == end) {
+			break;
+		}
+
+		if (end - in < 2) {
+			return -1;
+		}
+		size_t dist = in[0] | in[1] << 8;
+		in += 2;
+		if (mlen == 15) {
+			uint8_t b;
+			do {
+				if (in == end) {
+					return -1;
+				}
+				mlen += b = *in++;
+			} while (b == 255);
+		}
+		mlen += LZ_MIN_MATCH;
+		if (dist == 0 || dist > (size_t)(out - (uint8_t *)dst) || mlen > (size_t)(out_end - out)) {
+			return -1;
+		}
+
+		// byte by byte, a match may overlap its own output
+		for (const uint8_t * from = out - dist; mlen > 0; mlen--) {
+			*out++ = *from++;
+		}
+	}
+
+	return out - (uint8_t *)dst;
+}
@@ -0,0 +1,36 @@
+/**
+ * Block compression of the cold tier, see tier.h: a byte oriented
+ * LZ77 codec laid out like LZ4 blocks. A block is a run of sequences,
+ * each a token, its literals and a match: the token holds the literal
+ * count in its high nibble and the match length less LZ_MIN_MATCH in
+ * its low nibble, a nibble of 15 continuing in bytes added on until
+ * one is below 255; the match is a 2 byte little endian distance back
+ * into the output. The last sequence holds literals only. Matches are
+ * found through a hash of the next LZ_MIN_MATCH bytes, the last
+ * position seen for each hash, so compression is one pass with a
+ * table on the stack.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <sys/types.h>
+
+// lz defines
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_DIST 65535
+
+// the most a block of n bytes compresses to
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+//
+// PROTOTYPES
+//
+
+size_t lz_compress(const void *, size_t, void *);
+ssize_t lz_decompress(const void *, size_t, void *, size_t);
+
+#endif
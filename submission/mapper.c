@@ -0,0 +1,200 @@
+/**
+ * Implements locating the service mapper, see mapper.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Accept a port with a given mapper address.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapper.h"
+#include "proto.h"
+
+//
+// PROTOTYPES
+//
+
+static int broadcast_addr(struct in_addr *);
+static const char * cache_path();
+static int read_cache(const char *, struct in_addr *);
+
+//
+// METHODS
+//
+
+/**
+ * Finds the broadcast address of the first interface that is up and
+ * can broadcast.
+ * @param dest The address to write the broadcast address to.
+ * @returns 0 on success, -1 if no interface can broadcast.
+ */
+static int broadcast_addr(struct in_addr * dest) {
+	struct ifaddrs * ifas;
+	if (getifaddrs(&ifas) < 0) {
+		return -1;
+	}
+
+	int rval = -1;
+	for (struct ifaddrs * ifa = ifas; ifa != NULL && rval < 0; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != AF_INET || ifa->ifa_broadaddr == NULL
+				|| !(ifa->ifa_flags & IFF_UP) || !(ifa->ifa_flags & IFF_BROADCAST)
+				|| (ifa->ifa_flags & IFF_LOOPBACK)) {
+			continue;
+		}
+
+		*dest = ((struct sockaddr_in *)ifa->ifa_broadaddr)->sin_addr;
+		rval = 0;
+	}
+
+	freeifaddrs(ifas);
+	return rval;
+}
+
+/**
+ * Names the cache of the mapper address, in $XDG_RUNTIME_DIR, else in
+ * the home directory, so no other user can plant or remove it.
+ * @returns The path, NULL if the user has neither directory.
+ */
+static const char * cache_path() {
+	static char path[PATH_MAX];
+	if (path[0] == '\0') {
+		const char * dir = getenv("XDG_RUNTIME_DIR");
+		if (dir == NULL || dir[0] == '\0') {
+			dir = getenv("HOME");
+		}
+		if (dir == NULL || dir[0] == '\0'
+				|| snprintf(path, sizeof(path), "%s/%s", dir, MAPPER_CACHE) >= (int)sizeof(path)) {
+			path[0] = '\0';
+			return NULL;
+		}
+	}
+	return path;
+}
+
+/**
+ * Drops the cached mapper address, it stopped answering. The cache is
+ * only dropped while it still holds that address, a process that
+ * learned a new one since keeps it.
+ * @param addr The address that stopped answering.
+ */
+void mapper_forget(struct in_addr addr) {
+	const char * path = cache_path();
+	struct in_addr cached;
+	if (path != NULL && read_cache(path, &cached) == 0 && cached.s_addr == addr.s_addr) {
+		unlink(path);
+	}
+}
+
+/**
+ * Caches the address a mapper answered a broadcast from. The cache
+ * is replaced whole, so readers never see a partial address. The
+ * temporary file is created afresh, readable by the user only.
+ * @param addr The unicast address of the mapper.
+ */
+void mapper_learn(struct in_addr addr) {
+	const char * path = cache_path();
+	if (path == NULL) {
+		return; // the cache is only an optimization
+	}
+
+	char tmp[PATH_MAX + 16];
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+	// left behind by a process that died with our pid
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST && unlink(tmp) == 0) {
+		fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	}
+	if (fd < 0) {
+		return;
+	}
+
+	char line[INET_ADDRSTRLEN + 1];
+	int len = snprintf(line, sizeof(line), "%s\n", inet_ntoa(addr));
+	int failed = write(fd, line, len) != len;
+	if (close(fd) < 0 || failed || rename(tmp, path) < 0) {
+		unlink(tmp);
+	}
+}
+
+/**
+ * Picks the address to send a mapper request to: the given address,
+ * else the cached address of the mapper, else the broadcast address
+ * of the subnet. A host that cannot broadcast has no subnet, its
+ * mapper can only be local.
+ * @param mapper_addr The address from the command line, addr or
+ * addr:port, NULL to locate the mapper.
+ * @param dest The socket address to initialize, mapper port included.
+ * @returns One of the MAPPER_ values, broadcast destinations need
+ * SO_BROADCAST.
+ */
+int mapper_locate(const char * mapper_addr, struct sockaddr_in * dest) {
+	memset(dest, 0, sizeof(*dest));
+	dest->sin_family = AF_INET;
+	dest->sin_port = htons(MAPPER_PORT);
+
+	if (mapper_addr != NULL) {
+		// a mapper instance on another port, several share a host
+		char addr[INET_ADDRSTRLEN];
+		int port;
+		if (sscanf(mapper_addr, "%15[^:]:%d", addr, &port) == 2) {
+			dest->sin_addr.s_addr = inet_addr(addr);
+			dest->sin_port = htons(port);
+		} else {
+			dest->sin_addr.s_addr = inet_addr(mapper_addr);
+		}
+		return MAPPER_GIVEN;
+	}
+
+	const char * path = cache_path();
+	if (path != NULL && read_cache(path, &dest->sin_addr) == 0) {
+		return MAPPER_CACHED;
+	}
+
+	if (broadcast_addr(&dest->sin_addr) < 0) {
+		dest->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+	return MAPPER_BROADCAST;
+}
+
+/**
+ * Reads the cached mapper address. The cache must be a regular file
+ * of the user that no one else can write, anything else is ignored.
+ * @param path The cache.
+ * @param dest The address to write the cached address to.
+ * @returns 0 on success, -1 if there is no trusted cache.
+ */
+static int read_cache(const char * path, struct in_addr * dest) {
+	int fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat st;
+	char line[INET_ADDRSTRLEN + 1];
+	ssize_t len = -1;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == geteuid()
+			&& (st.st_mode & (S_IWGRP | S_IWOTH)) == 0) {
+		len = read(fd, line, sizeof(line) - 1);
+	}
+	close(fd);
+
+	if (len <= 0) {
+		return -1;
+	}
+	line[len] = '\0';
+	line[strcspn(line, "\n")] = '\0';
+	return inet_aton(line, dest) ? 0 : -1;
+}
@@ -0,0 +1,36 @@
+/**
+ * Locates the service mapper for clients and servers. Without an
+ * address from the command line the mapper is found by broadcasting
+ * on the subnet of the first broadcast capable interface. The address
+ * the mapper answers from is cached in MAPPER_CACHE, under
+ * $XDG_RUNTIME_DIR or else the home directory, so later requests, from
+ * any process of the user, go to it directly and only broadcast again
+ * once it stops answering. A cache the user does not own is ignored. A given address may carry
+ * the port of a mapper instance, addr:port.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Accept a port with a given mapper address.
+ */
+
+#ifndef MAPPER_H
+#define MAPPER_H
+
+#include <netinet/in.h>
+
+// mapper defines
+#define MAPPER_CACHE ".cisbank-mapper" // unicast address of the mapper, per user
+
+// how a mapper address was found
+#define MAPPER_GIVEN 0 // from the command line, used as is
+#define MAPPER_CACHED 1 // learned from an earlier reply
+#define MAPPER_BROADCAST 2 // the broadcast address of the subnet
+
+//
+// PROTOTYPES
+//
+
+void mapper_forget(struct in_addr);
+void mapper_learn(struct in_addr);
+int mapper_locate(const char *, struct sockaddr_in *);
+
+#endif
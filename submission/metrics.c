@@ -0,0 +1,131 @@
+/**
+ * Implements the shared server counters, see metrics.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Report the Bloom filter.
+ *			   - Report the record reads.
+ *			   - Report the hot accounts.
+ *			   - Report the scans.
+ *			   - Report the ledger.
+ *			   - Report the compact image.
+ *			   - Report the cold tier.
+ *			   - Report the capture.
+ *			   - Report the coalesced queries.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+
+// describes a counter for reporting
+struct metric_desc_t {
+	const char * section; // group the counter is reported in
+	const char * name;
+	size_t offset; // offset of the counter in metrics_t
+};
+
+#define METRIC(section, field) { section, #field, offsetof(struct metrics_t, field) }
+
+// every reported counter, grouped by section
+static const struct metric_desc_t metric_descs[] = {
+	METRIC("io", connections),
+	METRIC("io", local_conns),
+	METRIC("io", requests),
+	METRIC("io", writevs),
+	METRIC("io", copies),
+	METRIC("io", copy_bytes),
+	METRIC("uring", uring_enters),
+	METRIC("uring", uring_sqes),
+	METRIC("admit", queued_conns),
+	METRIC("admit", shed_conns),
+	METRIC("admit", shed_requests),
+	METRIC("admit", limiter_recovered),
+	METRIC("deadline", expired_requests),
+	METRIC("deadline", late_requests),
+	METRIC("deadline", idle_conns),
+	METRIC("store", txns),
+	METRIC("store", txn_aborts),
+	METRIC("store", log_bytes),
+	METRIC("store", log_checkpoints),
+	METRIC("store", read_retries),
+	METRIC("store", locked_reads),
+	METRIC("store", scan_batches),
+	METRIC("store", scan_records),
+	METRIC("bloom", bloom_bytes),
+	METRIC("bloom", bloom_keys),
+	METRIC("bloom", bloom_fpr_ppm),
+	METRIC("bloom", bloom_rejects),
+	METRIC("bloom", bloom_false_pos),
+	METRIC("hot", hot_accounts),
+	METRIC("hot", hot_updates),
+	METRIC("hot", hot_rounds),
+	METRIC("hot", hot_combined),
+	METRIC("ledger", ledger_entries),
+	METRIC("ledger", ledger_segments),
+	METRIC("ledger", ledger_dropped),
+	METRIC("ledger", ledger_reads),
+	METRIC("compact", compact_accounts),
+	METRIC("compact", compact_names),
+	METRIC("compact", compact_bytes),
+	METRIC("compact", compact_hits),
+	METRIC("tier", tier_cold_records),
+	METRIC("tier", tier_cold_bytes),
+	METRIC("tier", tier_block_reads),
+	METRIC("tier", tier_promotions),
+	METRIC("capture", capture_requests),
+	METRIC("capture", capture_bytes),
+	METRIC("capture", capture_lost),
+	METRIC("coalesce", coalesce_lookups),
+	METRIC("coalesce", coalesce_merged),
+};
+
+#define NMETRICS (sizeof(metric_descs) / sizeof(metric_descs[0]))
+
+struct metrics_t * metrics = NULL;
+
+/**
+ * Maps the shared counters. MUST be called before the server forks.
+ * @returns 0 on success, -1 on error.
+ */
+int metrics_init() {
+	void * addr = mmap(NULL, sizeof(struct metrics_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+
+	metrics = addr;
+	return 0;
+}
+
+/**
+ * Formats a section of counters as "section: name=value ...".
+ * @param section The section to format, empty for the first section.
+ * @param dest The buffer to write the counters to.
+ * @param len The length of the destination buffer.
+ * @returns 0 on success, -1 if the section does not exist.
+ */
+int metrics_format(const char * section, char * dest, size_t len) {
+	if (section == NULL || section[0] == '\0') {
+		section = metric_descs[0].section;
+	}
+
+	size_t off = snprintf(dest, len, "%s:", section);
+	int found = 0;
+	for (size_t i = 0; i < NMETRICS && off < len; i++) {
+		if (strcmp(metric_descs[i].section, section) != 0) {
+			continue;
+		}
+
+		unsigned long value = __atomic_load_n(
+				(unsigned long *)((char *)metrics + metric_descs[i].offset), __ATOMIC_RELAXED);
+		off += snprintf(dest + off, len - off, " %s=%lu", metric_descs[i].name, value);
+		found = 1;
+	}
+
+	return found ? 0 : -1;
+}
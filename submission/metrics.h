@@ -0,0 +1,122 @@
+/**
+ * Server counters. The counters live in a shared mapping created
+ * before the server forks, so every worker process adds to the same
+ * set and any worker can report them.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Add io_uring counters.
+ *			   - Add admission counters.
+ *			   - Add deadline counters.
+ *			   - Add local connection counter.
+ *			   - Add store counters.
+ *			   - Add Bloom filter counters and gauges, METRIC_SET.
+ *			   - Add record read counters.
+ *			   - Add hot account counters.
+ *			   - Add scan counters.
+ *			   - Add ledger counters.
+ *			   - Add compact image counters and gauges.
+ *			   - Add cold tier counters and gauges.
+ *			   - Add capture counters.
+ *			   - Add coalescing counters.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+// server counters, only ever changed through METRIC_ADD
+struct metrics_t {
+	// io
+	unsigned long connections; // connections served
+	unsigned long local_conns; // connections over the unix socket
+	unsigned long requests; // requests served
+	unsigned long writevs; // gathered sends of responses
+	unsigned long copies; // partial packets moved within an I/O buffer
+	unsigned long copy_bytes; // bytes moved within an I/O buffer
+
+	// uring
+	unsigned long uring_enters; // io_uring_enter syscalls
+	unsigned long uring_sqes; // operations queued on the ring
+
+	// admit
+	unsigned long queued_conns; // connections that waited for a worker
+	unsigned long shed_conns; // connections refused with a busy reply
+	unsigned long shed_requests; // requests over a client's rate
+	unsigned long limiter_recovered; // rate limiter locks taken over from dead workers
+
+	// deadline
+	unsigned long expired_requests; // dropped, budget spent before they started
+	unsigned long late_requests; // answered after their budget ran out
+	unsigned long idle_conns; // connections closed for sending nothing
+
+	// store
+	unsigned long txns; // transactions run, updates included
+	unsigned long txn_aborts; // transactions that changed nothing
+	unsigned long log_bytes; // bytes appended to the redo log
+	unsigned long log_checkpoints; // times the redo log was emptied
+	unsigned long read_retries; // record reads repeated over a concurrent write
+	unsigned long locked_reads; // record reads that took the record lock
+	unsigned long scan_batches; // batches of records read by scans
+	unsigned long scan_records; // records read by scans
+
+	// bloom
+	unsigned long bloom_bytes; // memory of the account filters
+	unsigned long bloom_keys; // accounts added to the filters
+	unsigned long bloom_fpr_ppm; // estimated false positives per million misses
+	unsigned long bloom_rejects; // misses answered without a scan
+	unsigned long bloom_false_pos; // misses the filter let through to a scan
+
+	// hot
+	unsigned long hot_accounts; // accounts whose updates are combined
+	unsigned long hot_updates; // updates of hot accounts
+	unsigned long hot_rounds; // combining rounds, one commit each
+	unsigned long hot_combined; // updates committed by another worker's round
+
+	// ledger
+	unsigned long ledger_entries; // changes appended to the ledger
+	unsigned long ledger_segments; // segments started
+	unsigned long ledger_dropped; // changes the ledger could not take
+	unsigned long ledger_reads; // segments read back
+
+	// compact image
+	unsigned long compact_accounts; // gauge, accounts in the image
+	unsigned long compact_names; // gauge, distinct names in the image
+	unsigned long compact_bytes; // gauge, memory of the image
+	unsigned long compact_hits; // queries answered from the image
+
+	// cold tier
+	unsigned long tier_cold_records; // gauge, records in the cold tier
+	unsigned long tier_cold_bytes; // gauge, size of the cold tier
+	unsigned long tier_block_reads; // cold blocks read and decompressed
+	unsigned long tier_promotions; // cold records appended to the store
+
+	// capture
+	unsigned long capture_requests; // requests captured
+	unsigned long capture_bytes; // bytes appended to the capture file
+	unsigned long capture_lost; // buffers of entries lost to failed writes
+
+	// coalescing
+	unsigned long coalesce_lookups; // lookups run for the queries of an account
+	unsigned long coalesce_merged; // queries answered by the lookup of another
+};
+
+// the shared counters, NULL until metrics_init
+extern struct metrics_t * metrics;
+
+// adds to a counter, safe across worker processes
+#define METRIC_ADD(field, n) \
+	__atomic_fetch_add(&metrics->field, (n), __ATOMIC_RELAXED)
+
+// sets a gauge, safe across worker processes
+#define METRIC_SET(field, n) \
+	__atomic_store_n(&metrics->field, (n), __ATOMIC_RELAXED)
+
+//
+// PROTOTYPES
+//
+
+int metrics_format(const char *, char *, size_t);
+int metrics_init();
+
+#endif
@@ -0,0 +1,200 @@
+/**
+ * Wire protocol shared by the client, server and service mapper.
+ * Changelog:
+ *	10/18/2026 - Created from the copies in client.c, server.c
+ *				 and servicemap.c.
+ *			   - Add PTYPE_STATS admin request.
+ *			   - Add PTYPE_BUSY load-shedding reply.
+ *			   - Add the request budget, carried in the padding
+ *				 after ptype so the packet size does not change.
+ *			   - Add the local transport socket path and flag.
+ *			   - Add PTYPE_TRANSFER and PTYPE_TXN requests.
+ *			   - Add DB_UPDATE_RETURN_CODE, an update answered with the
+ *				 updated record.
+ *			   - Drop the hard-coded broadcast addresses, the mapper
+ *				 is located through mapper.h.
+ *			   - Add PTYPE_SYNC for service mapper peers.
+ *			   - Add PTYPE_SCAN, batches of records in store order.
+ *			   - Add PTYPE_HISTORY, ledger entries of an account.
+ */
+
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stdint.h>
+
+// protocol defines
+#define BUFMAX 1024
+#define SERVER_PORT 7777
+#define MAPPER_PORT 21896
+#define SERVICE_NAME "CISBANK"
+#define MAXSHARDS 64
+#define MAXBUDGET 65535 // largest request budget in ms
+
+// co-located clients connect to a unix socket named after the server
+// port, servers offering it append LOCAL_FLAG to their address string
+#define LOCAL_PATH "/tmp/cisbank-%hu.sock"
+#define LOCAL_FLAG "L"
+
+// packet code defines
+#define PTYPE_REGISTER 0 // packet contains service register msg
+#define PTYPE_LOOKUP 10 // packet contains service lookup msg
+#define PTYPE_QUERY 20 // packet contains query msg
+#define PTYPE_UPDATE 30 // packet contains update msg
+#define PTYPE_RECORD 40 // packet contains record msg
+#define PTYPE_ERROR 50
+#define PTYPE_STATS 60 // packet contains server counters msg
+#define PTYPE_BUSY 70 // server shed the request, retry later
+#define PTYPE_TRANSFER 80 // packet contains transfer msg
+#define PTYPE_TXN 90 // packet contains transaction msg
+#define PTYPE_SYNC 100 // service mapper peers gossip registrations
+#define PTYPE_SCAN 110 // packet contains scan msg
+#define PTYPE_HISTORY 120 // packet contains history msg
+
+// database command codes
+#define DB_QUERY_CODE 1000
+#define DB_UPDATE_CODE 1001
+#define DB_TRANSFER_CODE 1002
+#define DB_TXN_CODE 1003
+#define DB_UPDATE_RETURN_CODE 1004 // update answered with a PTYPE_RECORD
+#define DB_TRANSFER_RETURN_CODE 1005 // transfer answered with both records
+
+// most records changed by one transaction, fills the packet body
+#define TXN_MAXOPS 31
+
+// most records in a scan batch, fills the packet body
+#define SCAN_BATCH 7
+#define SCAN_END 0xffffffff // cursor past the last record
+
+// most ledger entries in a history reply, fills the packet body
+#define HISTORY_MAX 14
+
+//
+// packet stuff
+//
+
+// database query type
+struct query_t {
+	int code;
+	int acctnum;
+};
+
+// database update type
+struct update_t {
+	int code;
+	int acctnum;
+	float value;
+};
+
+// database transfer type, fails rather than overdraw the source
+struct transfer_t {
+	int code;
+	int from;
+	int to;
+	float amount;
+};
+
+// one change of a transaction
+struct txn_op_t {
+	int acctnum;
+	float value; // added to the account
+};
+
+// database transaction type, every change applies or none does
+struct txn_t {
+	int code;
+	int count;
+	struct txn_op_t ops[TXN_MAXOPS];
+};
+
+// database record type
+struct record_t {
+	int acctnum;
+	char name[20];
+	float value;
+	int age;
+};
+
+// transfer result type, answers a DB_TRANSFER_RETURN_CODE transfer
+//	with both records as it committed them
+struct transfer_result_t {
+	int code; // DB_TRANSFER_RETURN_CODE
+	struct record_t records[2]; // the source, then the destination
+};
+
+// scan type, a request names the cursor of the batch it wants and
+//	is answered with the batch, cursors are record positions in the
+//	store so the server keeps no state between batches
+struct scan_t {
+	uint32_t cursor; // the first record of the batch
+	uint32_t next; // the cursor of the next batch, SCAN_END after the last
+	uint32_t count; // records in the batch
+	struct record_t records[SCAN_BATCH];
+};
+
+// a point in time, seconds and microseconds since the epoch
+struct stamp_t {
+	uint32_t sec;
+	uint32_t usec;
+};
+
+// one change of an account, stamps of an account never repeat
+struct ledger_ent_t {
+	struct stamp_t stamp;
+	float delta; // added to the account
+	float balance; // the value after the change
+};
+
+// history type, a request names an account and a time range
+//	[from, to) and is answered with the newest entries of the range,
+//	newest first; to asks for the page before a reply, set it to
+//	the reply's to
+struct history_t {
+	int acctnum;
+	uint32_t count; // entries in the reply
+	struct stamp_t from;
+	struct stamp_t to; // in a reply, the stamp of its oldest entry
+	struct ledger_ent_t entries[HISTORY_MAX];
+};
+
+// allows for sending/receiving fixed sized chunks to/from clients
+// all of these refer to the same region in memory
+union body_t {
+	// used for commands, messages, random data, etc...
+	//	behavior is undefined if this is not NULL terminated
+	char message[BUFMAX/4]; // MUST BE NULL TERMINATED
+	struct query_t query;
+	struct update_t update;
+	struct transfer_t transfer;
+	struct transfer_result_t transfer_result;
+	struct txn_t txn;
+	struct record_t record;
+	struct scan_t scan;
+	struct history_t history;
+};
+
+// send this type to/from clients
+struct pkt_t {
+	unsigned short ptype; // what data type is stored in the packet
+	unsigned short budget; // ms the sender waits for the reply, 0 for no limit
+	union body_t body; // the data stored in the packet
+};
+
+/**
+ * Maps an account number to the shard that owns it.
+ * @param acctnum The account number to map.
+ * @param n The total number of shards.
+ * @returns The shard owning the account, 0 <= shard < n.
+ */
+static inline int shard_of(int acctnum, int n) {
+	// murmur3 finalizer, spreads sequential account numbers evenly
+	uint32_t h = (uint32_t)acctnum;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return (int)(h % (uint32_t)n);
+}
+
+#endif
@@ -14,10 +14,40 @@
  *			   - No longer use addr_info_t type.
  *	03/28/2020 - Get server working 100%.
  *	03/30/2020 - Complete testing of server.c
+ *	10/18/2026 - Add hash-partitioned shard mode, each shard
+ *				 registers as CISBANK/shard-<n>.
+ *			   - Add command line options for port, mapper and db file.
+ *			   - Move the wire protocol into proto.h.
+ *			   - Serve requests until the client closes the connection.
+ *			   - Answer requests in place in a per-connection I/O
+ *				 buffer, gather pipelined responses with writev.
+ *			   - Add shared server counters and PTYPE_STATS.
+ *			   - Add io_uring backend, selected with -b uring.
+ *			   - Add pre-forked worker pool, selected with -b prefork.
+ *			   - Reap every exited child in the SIGCHLD handler.
+ *			   - Add admission control: concurrency limit, bounded
+ *				 connection queue, per-client rate limit, tunable
+ *				 backlog and PTYPE_BUSY replies for shed work.
+ *			   - Add request deadlines, idle timeout and retried
+ *				 registration with the service mapper.
+ *			   - Serve co-located clients over a unix socket, offered
+ *				 to clients through the service mapper.
+ *			   - Move the record code into store.c, add PTYPE_TRANSFER
+ *				 and PTYPE_TXN atomic multi-record requests.
+ *			   - Add request tracing, started with -T or tracedump.
+ *			   - Locate the service mapper unless it is given.
+ *			   - Report the account access telemetry through PTYPE_STATS.
+ *			   - Add PTYPE_SCAN, exports of the store in batches.
+ *			   - Add PTYPE_HISTORY, the ledger of an account.
+ *			   - Answer queries from a compact image of the store, -C.
+ *			   - Capture the requests received to a file, -P.
  */
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <arpa/inet.h>
 #include <netinet/ip.h>
 #include <netdb.h>
@@ -28,206 +58,167 @@
 #include <string.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+
+#include "admit.h"
+#include "capture.h"
+#include "ledger.h"
+#include "mapper.h"
+#include "metrics.h"
+#include "proto.h"
+#include "server.h"
+#include "sketch.h"
+#include "store.h"
+#include "trace.h"
 
 // server defines
-#define BACKLOG 5
-#define BUFMAX 1024
-#define SERVER_PORT 7777
-#define MAPPER_PORT 21896
+#define BACKLOG 128
 #define DBFILE "db20"
-
-// various broadcast addresses
-#define DOT0_BC_ADDR "192.168.0.255" // home
-#define DOT1_BC_ADDR "192.168.1.255" // home
-#define LLAB_BC_ADDR "137.148.205.255" // use when submitting
-
-// the broadcast address (set to one of the above)
-#define BROADCAST_ADDR LLAB_BC_ADDR
-
-// packet code defines
-#define PTYPE_REGISTER 0 // packet contains service register msg
-#define PTYPE_LOOKUP 10 // packet contains service lookup msg
-#define PTYPE_QUERY 20 // packet contains query msg
-#define PTYPE_UPDATE 30 // packet contains update msg
-#define PTYPE_RECORD 40 // packet contains record msg
-#define PTYPE_ERROR 50
-
-// database command codes
-#define DB_QUERY_CODE 1000
-#define DB_UPDATE_CODE 1001
+#define MAXCONNS 128 // default connections served at once
+#define MAXQUEUE 128 // default connections waiting for a worker
+#define QUEUE_TIMEOUT 500 // default ms a queued connection may wait
+#define IDLE_TIMEOUT 30000 // default ms a connection may send nothing
+#define REGISTER_TRIES 4 // registrations sent before giving up
+#define REGISTER_WAIT 250 // ms to wait for the first reply, doubles per try
+#define NWORKERS 4 // default size of the pre-forked worker pool
+#define MAXWORKERS 256
+#define RESPAWN_WAIT 1 // s before retrying a failed respawn, doubles per failure
+#define RESPAWN_MAX_WAIT 32 // most s between respawn retries
+
+// I/O buffer of the connection served by a child
+static union iobuf_t iobuf;
+
+// when the child serving a connection was forked, for its trace
+static uint64_t forked = 0;
 
 //
-// packet stuff
+// server configuration - set from the command line
 //
 
-// database query type
-struct query_t {
-	int code;
-	int acctnum;
-};
-
-// database update type
-struct update_t {
-	int code;
-	int acctnum;
-	float value;
-};
-
-// database record type
-struct record_t {
-	int acctnum;
-	char name[20];
-	float value;
-	int age;
-};
-
-// allows for sending/receiving fixed sized chunks to/from clients
-// all of these refer to the same region in memory
-union body_t {
-	char message[BUFMAX/4];
-	struct query_t query;
-	struct update_t update;
-	struct record_t record;
-};
-
-// send this type to.from clients - best to define in header file
-struct pkt_t {
-	unsigned short ptype;
-	union body_t body;
-};
+char * dbfile = DBFILE;
+int shard_id = 0; // the shard owned by this server
+int nshards = 1; // the total number of shards
+int max_conns = MAXCONNS; // connections served at once
+int max_queue = MAXQUEUE; // accepted connections waiting to be served
+int queue_timeout = QUEUE_TIMEOUT; // ms a queued connection may wait
+int idle_timeout = IDLE_TIMEOUT; // ms a connection may send nothing
+static char * mapper_addr = NULL; // located when not given
+static unsigned short server_port = SERVER_PORT;
+static int backend = BACKEND_FORK;
+static int sqpoll_cpu = -1; // io_uring kernel polling thread cpu, -1 for none
+static int nworkers = NWORKERS; // size of the pre-forked worker pool
+static int backlog = BACKLOG;
+static double rate_limit = 0; // requests per second per client, 0 for none
+static int rate_burst = 0; // requests a client may burst above the rate
+static int local_transport = 1; // serve co-located clients over a unix socket
+static char local_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int local_sk = -1; // unix socket listener, -1 when not offered
+static int sync_commits = 0; // flush the redo log before answering
+static int compact_image = 0; // keep a compact image of the store in memory
+static int tracing = 0; // record request spans from the start
+static char * capture_path = NULL; // capture the requests received to this file
+
+// children serving connections, fork backend only
+static volatile sig_atomic_t active_children = 0;
+
+// set by the signal handler, acted on by the prefork supervisor
+static volatile sig_atomic_t child_exited = 0;
+static volatile sig_atomic_t shutdown_requested = 0;
 
 //
 // PROTOTYPES
 //
 
+int accept_conn(int, int, struct sockaddr_in *);
 int advertise_service(char *);
+int drop_expired(struct pkt_t *, double);
+void encode_commit(struct pkt_t *, unsigned short, int);
 int get_service_addr(char *, size_t);
 void get_service_port(unsigned short, unsigned short *, unsigned short *);
 int main(int, char * []);
+void note_late(struct pkt_t *, double);
+double now_ms();
+int open_local();
+struct in_addr peer_addr(int);
 void parse_string(char *, char * [], int, char *);
-int query_record(struct query_t, struct record_t *);
+int prefork_serve(int, int);
+void print_usage(char *);
+void run_worker(int);
+int serve_conn(int);
 void signal_handler(int);
-int update_record(struct update_t);
+pid_t spawn_worker(int);
+void start_child(int, int);
+int writev_all(int, struct iovec *, int);
 
 //
 // METHODS
 //
 
-void signal_handler(int sig) {
-	if (sig == SIGCHLD) {
-		wait(0);
-	}
-}	
-
 /**
- * Queries a record in the database.
- * @param query The structure containing query information.
- * @param record The structure to write the record back to.
- * @returns 0 on success, -1 on error.
+ * Handles SIGCHLD and the shutdown signals. The fork backend reaps
+ * its children here, the prefork supervisor reaps (and respawns)
+ * from its own loop.
+ * @param sig The signal received.
  */
-int query_record(struct query_t query, struct record_t * record) {
-	int acctnum = query.acctnum;
-
-	int fd = open(DBFILE, O_RDONLY);
-	if (fd < 0) {
-		perror("open error");
-		return -1;
-	}
-
-	ssize_t bytes_read = 0;
-	do {
-		bytes_read = read(fd, record, sizeof(struct record_t));
-	} while (bytes_read > 0 && record->acctnum != acctnum);
-	
-	close(fd);
+void signal_handler(int sig) {
+	int saved_errno = errno;
 
-	if (record->acctnum != acctnum) {
-		return -1;
+	if (sig == SIGCHLD) {
+		if (backend == BACKEND_PREFORK) {
+			child_exited = 1;
+		} else {
+			// several children may exit for a single signal
+			while (waitpid(-1, NULL, WNOHANG) > 0) {
+				active_children--;
+			}
+		}
+	} else {
+		shutdown_requested = 1;
 	}
 
-	return 0;
+	errno = saved_errno;
 }
 
 /**
- * Updates a record in the database.
- * @param update The structure containing update information.
- * @returns 0 on success, -1 on error.
+ * Prints command line usage.
+ * @param prog The name the program was invoked with.
  */
-int update_record(struct update_t update) {
-	int acctnum = update.acctnum;
-	float value = update.value;
-	
-	int fd = open(DBFILE, O_RDWR);
-	if (fd < 0) {
-		perror("open error");
-		return -1;
-	}
-
-	// check for the record
-	struct record_t record;
-	ssize_t bytes_read = 0;
-	do {
-		bytes_read = read(fd, &record, sizeof(struct record_t));
-	} while (bytes_read > 0 && record.acctnum != acctnum);
-
-	// make sure the record was found
-	if (record.acctnum != acctnum) {
-		perror("record error");
-		close(fd);
-		return -1;
-	}
-
-	// attempt to lock the record
-	if (lockf(fd, F_LOCK, -sizeof(struct record_t)) < 0) {
-		perror("lockf error");
-		close(fd);
-		return -1;
-	}
-
-	// seek to the read position
-	if (lseek(fd, -sizeof(struct record_t), SEEK_CUR) < 0) {
-		perror("lseek error");
-		lockf(fd, F_ULOCK, -sizeof(struct record_t));
-		close(fd);
-		return -1;
-	}
-
-	// read the record again, may have changed
-	if ((bytes_read = read(fd, &record, sizeof(struct record_t))) < 0) {
-		perror("read error");
-		lockf(fd, F_ULOCK, sizeof(struct record_t));
-		close(fd);
-		return -1;
-	}
-
-	// update the record locally
-	record.value += value;
-	
-	// seek to the write position
-	if (lseek(fd, -sizeof(struct record_t), SEEK_CUR) < 0) {
-		perror("lseek error");
-		lockf(fd, F_ULOCK, -sizeof(struct record_t));
-		close(fd);
-		return -1;
-	}
-
-	// write the record back
-	if (write(fd, &record, sizeof(struct record_t)) < 0) {
-		perror("write error");
-		lockf(fd, F_ULOCK, sizeof(struct record_t));
-		close(fd);
-		return -1;
-	}
-
-	// attempt to unlock the record
-	if (lockf(fd, F_ULOCK, -sizeof(struct record_t)) < 0) {
-		perror("lockf error");
-		close(fd);
-		return -1;
-	}
-
-	close(fd);
-	return 0;
+void print_usage(char * prog) {
+	printf("usage: %s [-d dbfile] [-m mapper_addr] [-p port] [-i shard -n nshards]\n", prog);
+	printf("\t[-b fork|prefork|uring] [-w nworkers] [-Q cpu]\n");
+	printf("\t[-B backlog] [-c maxconns] [-q queue] [-t timeout] [-r rate] [-R burst]\n");
+	printf("\t[-I idle] [-P capfile] [-C] [-L] [-S] [-T]\n");
+	printf("\t-d The database file to serve (default %s).\n", DBFILE);
+	printf("\t-m The address[:port] of the service mapper (default located by\n");
+	printf("\t   broadcast, then cached in ~/%s or under $XDG_RUNTIME_DIR).\n", MAPPER_CACHE);
+	printf("\t-p The port to serve on (default %d + shard).\n", SERVER_PORT);
+	printf("\t-i The shard owned by this server, 0 <= shard < nshards.\n");
+	printf("\t-n The number of shards the accounts are split across.\n");
+	printf("\t-b The I/O backend (default fork), uring falls back to fork\n");
+	printf("\t   when the kernel does not support it.\n");
+	printf("\t-w The number of prefork workers (default %d), each serves\n", NWORKERS);
+	printf("\t   one connection at a time.\n");
+	printf("\t-Q Run the io_uring submission queue polling thread on cpu.\n");
+	printf("\t-B The listen backlog (default %d).\n", BACKLOG);
+	printf("\t-c The most connections served at once (default %d).\n", MAXCONNS);
+	printf("\t-q The most connections waiting to be served (default %d),\n", MAXQUEUE);
+	printf("\t   connections beyond it are shed with a busy reply.\n");
+	printf("\t-t The ms a queued connection may wait (default %d).\n", QUEUE_TIMEOUT);
+	printf("\t-r The requests per second allowed per client address\n");
+	printf("\t   (default unlimited), requests beyond it get a busy reply.\n");
+	printf("\t-R The requests a client may burst above the rate.\n");
+	printf("\t-I The ms a connection may send nothing before it is closed\n");
+	printf("\t   (default %d), 0 for no limit.\n", IDLE_TIMEOUT);
+	printf("\t-P Capture every request received to capfile, see bench replay.\n");
+	printf("\t-C Keep a compact image of the store in memory and answer\n");
+	printf("\t   queries from it.\n");
+	printf("\t-L Do not serve co-located clients over the unix socket\n");
+	printf("\t   %s.\n", LOCAL_PATH);
+	printf("\t-S Flush the redo log to disk before answering a change.\n");
+	printf("\t-T Trace requests from the start, see tracedump.\n");
 }
 
 /**
@@ -279,8 +270,8 @@ void get_service_port(unsigned short port, unsigned short * quotient, unsigned s
  * @returns 0 on success, -1 on error.
  */
 int advertise_service(char * service) {
-	struct sockaddr_in local, remote;
-	socklen_t len=sizeof(local), rlen=sizeof(remote);
+	struct sockaddr_in local, remote, from;
+	socklen_t len=sizeof(local), rlen=sizeof(remote), flen=sizeof(from);
 	int sk;
 	char sendbuf[BUFMAX], recvbuf[BUFMAX];
 
@@ -294,8 +285,8 @@ int advertise_service(char * service) {
 
 	// configure the local socket address
 	local.sin_family = AF_INET;
-	local.sin_port = htons(SERVER_PORT);
-	local.sin_family = INADDR_ANY;
+	local.sin_port = htons(server_port);
+	local.sin_addr.s_addr = INADDR_ANY;
 
 	if (bind(sk, (struct sockaddr *)&local, len) < 0) {
 		perror("bind error");
@@ -304,9 +295,7 @@ int advertise_service(char * service) {
 	}
 
 	// configure the remote socket address
-	remote.sin_family = AF_INET;
-	remote.sin_port = htons(MAPPER_PORT);
-	remote.sin_addr.s_addr = inet_addr(BROADCAST_ADDR);
+	int how = mapper_locate(mapper_addr, &remote);
 
 	// enable broadcasting on the socket
 	int broadcast = 1;
@@ -318,6 +307,7 @@ int advertise_service(char * service) {
 
 	// create the sending pkt
 	struct pkt_t pkt;
+	memset(&pkt, 0, sizeof(pkt));
 	pkt.ptype = htons(PTYPE_REGISTER);
 
 	// get the service address
@@ -329,48 +319,73 @@ int advertise_service(char * service) {
 
 	// get the service port
 	unsigned short quotient, remainder;
-	get_service_port(htons(SERVER_PORT), &quotient, &remainder);
+	get_service_port(htons(server_port), &quotient, &remainder);
 
-	// build the service address string
+	// build the service address string, the local flag is left off
+	//	when the address is too long to carry it
 	char * tokens[4];
 	char tempaddr[24];
 	parse_string(servaddr, tokens, 4, ".");
-	snprintf(tempaddr, sizeof(tempaddr), "%s,%s,%s,%s,%d,%d%c", 
+	snprintf(tempaddr, sizeof(tempaddr), "%s,%s,%s,%s,%d,%d%s%c", 
 			tokens[0], tokens[1], tokens[2], tokens[3], 
-			quotient, remainder, '\0');
+			quotient, remainder, local_transport ? "," LOCAL_FLAG : "", '\0');
 
 	// finish building the packet
 	memset(pkt.body.message, 0, sizeof(pkt.body.message));
 	snprintf(pkt.body.message, sizeof(pkt.body.message), 
 		"PUT %s %s", service, tempaddr);
-	memcpy(sendbuf, &pkt, sizeof(struct pkt_t));
 
-	// attempt to send the register packet
+	// send the register packet until the mapper answers, backing off
+	// between tries since the mapper or the network may be slow
 	ssize_t net_bytes = 0;
-	if ((net_bytes = sendto(sk, sendbuf, sizeof(struct pkt_t), 
-			0, (struct sockaddr *)&remote, rlen)) < 0) {
-		perror("sendto error");
-		close(sk);
-		return -1;
-	}
+	int wait = REGISTER_WAIT;
+	for (int try = 0; ; try++, wait *= 2) {
+		if (try == REGISTER_TRIES) {
+			close(sk);
+			errno = ETIMEDOUT;
+			return -1;
+		}
 
-	if (net_bytes != sizeof(struct pkt_t)) {
-		perror("sendto error");
-		close(sk);
-		return -1;
-	}
+		pkt.budget = htons(wait);
+		memcpy(sendbuf, &pkt, sizeof(struct pkt_t));
+		if ((net_bytes = sendto(sk, sendbuf, sizeof(struct pkt_t), 
+				0, (struct sockaddr *)&remote, rlen)) < 0) {
+			perror("sendto error");
+			close(sk);
+			return -1;
+		}
 
-	// aawait the register response
-	if ((net_bytes = recvfrom(sk, recvbuf, sizeof(struct pkt_t), 0, (struct sockaddr *)&remote, &rlen)) < 0) {
-		perror("recvfrom error");
-		close(sk);
-		return -1;
+		if (net_bytes != sizeof(struct pkt_t)) {
+			perror("sendto error");
+			close(sk);
+			return -1;
+		}
+
+		// await the register response
+		struct pollfd pfd = { sk, POLLIN, 0 };
+		if (poll(&pfd, 1, wait) <= 0) {
+			// the mapper moved or died, broadcast for it again
+			if (how == MAPPER_CACHED) {
+				mapper_forget(remote.sin_addr);
+				how = mapper_locate(NULL, &remote);
+			}
+			continue;
+		}
+
+		if ((net_bytes = recvfrom(sk, recvbuf, sizeof(struct pkt_t), 0, (struct sockaddr *)&from, &flen)) < 0) {
+			perror("recvfrom error");
+			close(sk);
+			return -1;
+		}
+
+		if (net_bytes == sizeof(struct pkt_t)) {
+			break;
+		}
 	}
 
-	if (net_bytes != sizeof(struct pkt_t)) {
-		perror("recvfrom error");
-		close(sk);
-		return -1;
+	// later registrations and lookups skip the broadcast
+	if (how == MAPPER_BROADCAST) {
+		mapper_learn(from.sin_addr);
 	}
 
 	// receive over the same packet
@@ -397,23 +412,815 @@ int advertise_service(char * service) {
 	return 0;
 }
 
-int main(int argc, char * argv[]) {
-	// register the signal handler
-	if (signal(SIGCHLD, signal_handler) < 0) {
+/**
+ * Encodes an error response.
+ * @param pkt The packet to overwrite with the response.
+ * @param message The error message.
+ */
+void encode_error(struct pkt_t * pkt, const char * message) {
+	pkt->ptype = htons(PTYPE_ERROR);
+	memset(pkt->body.message, 0, sizeof(pkt->body.message));
+	strncpy(pkt->body.message, message, sizeof(pkt->body.message) - 1);
+}
+
+/**
+ * Encodes a record response.
+ * @param pkt The packet to overwrite with the response.
+ * @param record The record in local byte order, may alias the packet.
+ */
+void encode_record(struct pkt_t * pkt, struct record_t * record) {
+	pkt->body.record = *record;
+	pkt->ptype = htons(PTYPE_RECORD);
+	pkt->body.record.acctnum = htonl(pkt->body.record.acctnum);
+	pkt->body.record.age = htonl(pkt->body.record.age);
+	int * ip = (int *)&pkt->body.record.value;
+	*ip = htonl(*ip);
+}
+
+/**
+ * Gets the time on the monotonic clock.
+ * @returns The time in ms.
+ */
+double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Drops a request whose budget ran out before the server got to
+ * it, the client has given up on it so the store is not touched.
+ * The request is still answered to keep replies in order.
+ * @param pkt The request packet in network byte order.
+ * @param start When the request was received, in ms.
+ * @returns 1 if the request was dropped, 0 otherwise.
+ */
+int drop_expired(struct pkt_t * pkt, double start) {
+	unsigned short budget = ntohs(pkt->budget);
+	if (budget == 0 || now_ms() - start < budget) {
+		return 0;
+	}
+
+	encode_error(pkt, "Request deadline exceeded!");
+	METRIC_ADD(expired_requests, 1);
+	return 1;
+}
+
+/**
+ * Counts a request that was answered after its budget ran out.
+ * @param pkt The answered packet, the budget is left untouched.
+ * @param start When the request was received, in ms.
+ */
+void note_late(struct pkt_t * pkt, double start) {
+	unsigned short budget = ntohs(pkt->budget);
+	if (budget != 0 && now_ms() - start >= budget) {
+		METRIC_ADD(late_requests, 1);
+	}
+}
+
+/**
+ * Opens the unix socket listener for co-located clients, replacing
+ * the socket a previous server on the same port left behind.
+ * @returns The listening socket on success, -1 on error.
+ */
+int open_local() {
+	struct sockaddr_un local;
+	memset(&local, 0, sizeof(local));
+	local.sun_family = AF_UNIX;
+	snprintf(local.sun_path, sizeof(local.sun_path), LOCAL_PATH, server_port);
+	snprintf(local_path, sizeof(local_path), "%s", local.sun_path);
+
+	int sk;
+	if ((sk = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket error");
+		return -1;
+	}
+
+	unlink(local_path);
+	if (bind(sk, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		perror("bind error");
+		close(sk);
+		return -1;
+	}
+
+	// anyone on the host may connect, as anyone may over TCP
+	chmod(local_path, 0666);
+
+	if (listen(sk, backlog) < 0) {
+		perror("listen error");
+		close(sk);
+		unlink(local_path);
+		return -1;
+	}
+
+	return sk;
+}
+
+/**
+ * Gets the address a connection is rate limited under. Clients on
+ * the unix socket share the loopback address.
+ * @param sk The connected socket.
+ * @returns The client address.
+ */
+struct in_addr peer_addr(int sk) {
+	struct sockaddr_in remote;
+	socklen_t rlen = sizeof(remote);
+	memset(&remote, 0, sizeof(remote));
+	getpeername(sk, (struct sockaddr *)&remote, &rlen);
+
+	if (remote.sin_family != AF_INET) {
+		remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+	return remote.sin_addr;
+}
+
+/**
+ * Waits for a connection on the TCP or the unix socket listener.
+ * @param listen_sk The TCP listening socket.
+ * @param timeout The most ms to wait, -1 for no limit.
+ * @param remote The client address, loopback for local clients.
+ * @returns The connected socket, -1 on timeout or error.
+ */
+int accept_conn(int listen_sk, int timeout, struct sockaddr_in * remote) {
+	struct pollfd pfds[2] = { { listen_sk, POLLIN, 0 }, { local_sk, POLLIN, 0 } };
+	if (poll(pfds, local_sk < 0 ? 1 : 2, timeout) <= 0) {
+		return -1;
+	}
+
+	int sk;
+	socklen_t rlen = sizeof(*remote);
+	if (pfds[0].revents & POLLIN) {
+		sk = accept(listen_sk, (struct sockaddr *)remote, &rlen);
+	} else {
+		if ((sk = accept(local_sk, NULL, NULL)) >= 0) {
+			remote->sin_family = AF_INET;
+			remote->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			METRIC_ADD(local_conns, 1);
+		}
+	}
+
+	// another worker may have taken the connection
+	if (sk < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+		perror("accept error");
+	}
+	return sk;
+}
+
+/**
+ * Encodes the response to a change of the store.
+ * @param pkt The packet to overwrite with the response.
+ * @param ptype The request type, echoed on success.
+ * @param rval The result of the change, 0 or a STORE_ error code.
+ */
+void encode_commit(struct pkt_t * pkt, unsigned short ptype, int rval) {
+	if (rval == 0) {
+		pkt->ptype = htons(ptype);
+		memset(pkt->body.message, 0, sizeof(pkt->body.message));
+		strcpy(pkt->body.message, "OK");
+	} else if (rval == STORE_ENOTFOUND) {
+		encode_error(pkt, "Record not found!");
+	} else if (rval == STORE_EFUNDS) {
+		encode_error(pkt, "Insufficient funds!");
+	} else {
+		encode_error(pkt, "Transaction failed!");
+	}
+}
+
+/**
+ * Handles a request packet, overwriting it with the response.
+ * @param pkt The request packet in network byte order. Holds the
+ * response in network byte order on return.
+ */
+void handle_pkt(struct pkt_t * pkt) {
+	pkt->ptype = ntohs(pkt->ptype);
+
+	if (pkt->ptype == PTYPE_QUERY) {
+		pkt->body.query.code = ntohl(pkt->body.query.code);
+		if (pkt->body.query.code == DB_QUERY_CODE) {
+			pkt->body.query.acctnum = ntohl(pkt->body.query.acctnum);
+			if (shard_of(pkt->body.query.acctnum, nshards) != shard_id) {
+				pkt->ptype = PTYPE_ERROR;
+				strcpy(pkt->body.message, "Account not owned by this shard!");
+			} else if (query_record(pkt->body.query, &pkt->body.record) == 0) {
+				encode_record(pkt, &pkt->body.record);
+			} else { // error
+				pkt->ptype = PTYPE_ERROR;
+				strcpy(pkt->body.message, "Record not found!");
+			}
+		} else { // error
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "DB code does not match QUERY code!");
+		}
+	} else if (pkt->ptype == PTYPE_UPDATE) {
+		pkt->body.update.code = ntohl(pkt->body.update.code);
+		if (pkt->body.update.code == DB_UPDATE_CODE || pkt->body.update.code == DB_UPDATE_RETURN_CODE) {
+			pkt->body.update.acctnum = ntohl(pkt->body.update.acctnum);
+			int * ip = (int*)&pkt->body.update.value;
+			*ip = ntohl(*ip);
+
+			struct record_t record;
+			if (shard_of(pkt->body.update.acctnum, nshards) != shard_id) {
+				pkt->ptype = PTYPE_ERROR;
+				strcpy(pkt->body.message, "Account not owned by this shard!");
+			} else if (update_record(pkt->body.update, &record) != 0) {
+				pkt->ptype = PTYPE_ERROR;
+				strcpy(pkt->body.message, "Record not found!");
+			} else if (pkt->body.update.code == DB_UPDATE_RETURN_CODE) {
+				// read your write, no second query needed
+				encode_record(pkt, &record);
+			} else {
+				pkt->ptype = htons(PTYPE_UPDATE);
+				memset(pkt->body.message, 0, sizeof(pkt->body.message));
+				strcpy(pkt->body.message, "OK");
+			}
+		} else { // error
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "DB code does not match UPDATE code!");
+		}
+	} else if (pkt->ptype == PTYPE_TRANSFER) {
+		pkt->body.transfer.code = ntohl(pkt->body.transfer.code);
+		int code = pkt->body.transfer.code;
+		if (code == DB_TRANSFER_CODE || code == DB_TRANSFER_RETURN_CODE) {
+			int * ip = (int*)&pkt->body.transfer.amount;
+			*ip = ntohl(*ip);
+			float amount = pkt->body.transfer.amount;
+
+			struct txn_op_t ops[2];
+			ops[0].acctnum = ntohl(pkt->body.transfer.from);
+			ops[0].value = -amount;
+			ops[1].acctnum = ntohl(pkt->body.transfer.to);
+			ops[1].value = amount;
+
+			if (!(amount > 0)) { // catches NaN too
+				pkt->ptype = PTYPE_ERROR;
+				strcpy(pkt->body.message, "Transfer amount must be positive!");
+			} else if (shard_of(ops[0].acctnum, nshards) != shard_id || shard_of(ops[1].acctnum, nshards) != shard_id) {
+				pkt->ptype = PTYPE_ERROR;
+				strcpy(pkt->body.message, "Account not owned by this shard!");
+			} else {
+				struct record_t records[2];
+				encode_commit(pkt, PTYPE_TRANSFER, store_txn(ops, 2, 1, records));
+
+				// both records as committed, no queries needed to show them
+				if (code == DB_TRANSFER_RETURN_CODE && pkt->ptype == htons(PTYPE_TRANSFER)) {
+					pkt->body.transfer_result.code = htonl(code);
+					for (int i = 0; i < 2; i++) {
+						struct record_t * record = &pkt->body.transfer_result.records[i];
+						*record = records[i];
+						record->acctnum = htonl(record->acctnum);
+						record->age = htonl(record->age);
+						int * ip = (int *)&record->value;
+						*ip = htonl(*ip);
+					}
+				}
+			}
+		} else { // error
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "DB code does not match TRANSFER code!");
+		}
+	} else if (pkt->ptype == PTYPE_TXN) {
+		pkt->body.txn.code = ntohl(pkt->body.txn.code);
+		int count = ntohl(pkt->body.txn.count);
+		if (pkt->body.txn.code != DB_TXN_CODE) {
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "DB code does not match TXN code!");
+		} else if (count < 1 || count > TXN_MAXOPS) {
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "Invalid TXN change count!");
+		} else {
+			// copy the changes out, the response overwrites them
+			struct txn_op_t ops[TXN_MAXOPS];
+			int owned = 1;
+			for (int i = 0; i < count; i++) {
+				ops[i].acctnum = ntohl(pkt->body.txn.ops[i].acctnum);
+				int * ip = (int*)&pkt->body.txn.ops[i].value;
+				*ip = ntohl(*ip);
+				ops[i].value = pkt->body.txn.ops[i].value;
+				owned = owned && shard_of(ops[i].acctnum, nshards) == shard_id;
+			}
+
+			if (!owned) {
+				pkt->ptype = PTYPE_ERROR;
+				strcpy(pkt->body.message, "Account not owned by this shard!");
+			} else {
+				encode_commit(pkt, PTYPE_TXN, store_txn(ops, count, 0, NULL));
+			}
+		}
+	} else if (pkt->ptype == PTYPE_SCAN) {
+		uint32_t cursor = ntohl(pkt->body.scan.cursor), next;
+		int count = store_scan(cursor, pkt->body.scan.records, SCAN_BATCH, &next);
+		if (count < 0) {
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "Store could not be read!");
+		} else {
+			pkt->ptype = htons(PTYPE_SCAN);
+			pkt->body.scan.cursor = htonl(cursor);
+			pkt->body.scan.next = htonl(next);
+			pkt->body.scan.count = htonl(count);
+			for (int i = 0; i < count; i++) {
+				struct record_t * record = &pkt->body.scan.records[i];
+				record->acctnum = htonl(record->acctnum);
+				record->age = htonl(record->age);
+				int * ip = (int *)&record->value;
+				*ip = htonl(*ip);
+			}
+		}
+	} else if (pkt->ptype == PTYPE_HISTORY) {
+		struct history_t * history = &pkt->body.history;
+		struct stamp_t from = { ntohl(history->from.sec), ntohl(history->from.usec) };
+		struct stamp_t to = { ntohl(history->to.sec), ntohl(history->to.usec) };
+		int acctnum = ntohl(history->acctnum), count;
+
+		if (shard_of(acctnum, nshards) != shard_id) {
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "Account not owned by this shard!");
+		} else if ((count = ledger_history(acctnum, from, to, history->entries, HISTORY_MAX)) < 0) {
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "Ledger could not be read!");
+		} else {
+			// the next page ends where this one does
+			pkt->ptype = htons(PTYPE_HISTORY);
+			history->count = htonl(count);
+			if (count > 0) {
+				to = history->entries[count - 1].stamp;
+			}
+			history->to.sec = htonl(to.sec);
+			history->to.usec = htonl(to.usec);
+			for (int i = 0; i < count; i++) {
+				struct ledger_ent_t * ent = &history->entries[i];
+				ent->stamp.sec = htonl(ent->stamp.sec);
+				ent->stamp.usec = htonl(ent->stamp.usec);
+				int * ip = (int *)&ent->delta;
+				*ip = htonl(*ip);
+				ip = (int *)&ent->balance;
+				*ip = htonl(*ip);
+			}
+		}
+	} else if (pkt->ptype == PTYPE_STATS) {
+		// the request names the section of counters to report
+		char section[32];
+		pkt->body.message[sizeof(pkt->body.message) - 1] = '\0';
+		snprintf(section, sizeof(section), "%s", pkt->body.message);
+		memset(pkt->body.message, 0, sizeof(pkt->body.message));
+
+		if (metrics_format(section, pkt->body.message, sizeof(pkt->body.message)) == 0
+				|| sketch_format(section, pkt->body.message, sizeof(pkt->body.message)) == 0) {
+			pkt->ptype = htons(PTYPE_STATS);
+		} else { // error
+			pkt->ptype = PTYPE_ERROR;
+			strcpy(pkt->body.message, "Unknown STATS section!");
+		}
+	} else {
+		pkt->ptype = PTYPE_ERROR;
+		strcpy(pkt->body.message, "Invalid COMMAND code received!");
+	}
+
+	if (pkt->ptype == PTYPE_ERROR) {
+		pkt->ptype = htons(pkt->ptype);
+	}
+}
+
+/**
+ * Writes every buffer to a socket, retrying short writes.
+ * @param sk The socket to write to.
+ * @param iov The buffers to write, consumed by the call.
+ * @param iovcnt The number of buffers.
+ * @returns 0 on success, -1 on error.
+ */
+int writev_all(int sk, struct iovec * iov, int iovcnt) {
+	while (iovcnt > 0) {
+		ssize_t net_bytes = writev(sk, iov, iovcnt);
+		if (net_bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		// skip the buffers that were written
+		while (iovcnt > 0 && (size_t)net_bytes >= iov->iov_len) {
+			net_bytes -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + net_bytes;
+			iov->iov_len -= net_bytes;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Serves requests on a connection until the client closes it. Each
+ * recv may carry several pipelined requests, they are decoded and
+ * answered in place in the I/O buffer and the responses go out in a
+ * single writev. Only a trailing partial packet is ever copied.
+ * @param sk The connected socket.
+ * @returns 0 when the client closed the connection, -1 on error.
+ */
+int serve_conn(int sk) {
+	struct iovec iov[IOBUF_PKTS];
+	size_t len = 0;
+
+	struct sockaddr_in remote;
+	remote.sin_addr = peer_addr(sk);
+	printf("Service Requested from %s\n", inet_ntoa(remote.sin_addr));
+	fflush(stdout);
+
+	METRIC_ADD(connections, 1);
+	TRACE_END(TRACE_FORK, forked);
+	forked = 0;
+	uint32_t conn = capture_conn();
+
+	while (1) {
+		// close connections that stop sending rather than hold the child
+		struct pollfd pfd = { sk, POLLIN, 0 };
+		int ready = poll(&pfd, 1, idle_timeout > 0 ? idle_timeout : -1);
+		if (ready < 0 && errno == EINTR) {
+			continue;
+		} else if (ready == 0) {
+			METRIC_ADD(idle_conns, 1);
+			return len == 0 ? 0 : -1;
+		}
+
+		uint64_t t = TRACE_START();
+		ssize_t net_bytes = recv(sk, iobuf.bytes + len, sizeof(iobuf.bytes) - len, 0);
+		TRACE_END(TRACE_RECV, t);
+		if (net_bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("recv error");
+			return -1;
+		} else if (net_bytes == 0) { // client closed the connection
+			return len == 0 ? 0 : -1;
+		}
+		len += net_bytes;
+		double start = now_ms();
+
+		// answer every whole request received, within the client's rate
+		// and deadline
+		int npkts = len / PKTSIZE;
+		capture_pkts(conn, iobuf.pkts, npkts);
+		int admitted = admit_take(remote.sin_addr, npkts);
+		for (int i = 0; i < npkts; i++) {
+			if (i < admitted) {
+				if (!drop_expired(&iobuf.pkts[i], start)) {
+					t = TRACE_START();
+					handle_pkt(&iobuf.pkts[i]);
+					TRACE_END(TRACE_HANDLE, t);
+					note_late(&iobuf.pkts[i], start);
+				}
+			} else {
+				encode_busy(&iobuf.pkts[i]);
+			}
+			iov[i].iov_base = &iobuf.pkts[i];
+			iov[i].iov_len = PKTSIZE;
+		}
+
+		if (npkts > 0) {
+			METRIC_ADD(requests, npkts);
+			METRIC_ADD(writevs, 1);
+			t = TRACE_START();
+			int rval = writev_all(sk, iov, npkts);
+			TRACE_END(TRACE_SEND, t);
+			if (rval < 0) {
+				perror("send error");
+				return -1;
+			}
+		}
+
+		// keep the partial request for the next recv
+		size_t used = npkts * PKTSIZE;
+		if (used > 0 && len > used) {
+			memmove(iobuf.bytes, iobuf.bytes + used, len - used);
+			METRIC_ADD(copies, 1);
+			METRIC_ADD(copy_bytes, len - used);
+		}
+		len -= used;
+	}
+}
+
+/**
+ * Serves connections accepted on the shared listening sockets, one
+ * at a time, until the worker is killed.
+ * @param listen_sk The listening socket shared by every worker.
+ */
+void run_worker(int listen_sk) {
+	struct sockaddr_in remote;
+	int sk;
+
+	while (1) {
+		if ((sk = accept_conn(listen_sk, -1, &remote)) < 0) {
+			continue;
+		}
+
+		// a failed connection only costs that connection
+		serve_conn(sk);
+		capture_flush();
+		close(sk);
+	}
+}
+
+/**
+ * Forks a worker process.
+ * @param listen_sk The listening socket shared by every worker.
+ * @returns The pid of the worker, -1 on error.
+ */
+pid_t spawn_worker(int listen_sk) {
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		trace_child();
+
+		// workers don't fork, leave signals to the supervisor
+		sigset_t mask;
+		sigemptyset(&mask);
+		signal(SIGCHLD, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+
+		run_worker(listen_sk);
+		exit(0);
+	} else if (pid < 0) {
+		perror("fork error");
+	}
+
+	return pid;
+}
+
+/**
+ * Runs the prefork supervisor. Keeps a pool of long lived workers
+ * accepting on the shared listening socket and respawns any that
+ * die, until SIGTERM or SIGINT. A slot whose respawn failed to fork
+ * stays empty and is retried after RESPAWN_WAIT, doubling per failure
+ * up to RESPAWN_MAX_WAIT.
+ * @param listen_sk The listening socket.
+ * @param n The number of workers in the pool.
+ * @returns 0 on shutdown, -1 on error.
+ */
+int prefork_serve(int listen_sk, int n) {
+	pid_t workers[MAXWORKERS];
+	time_t started[MAXWORKERS];
+
+	// only take signals while waiting for them
+	sigset_t mask, oldmask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+	sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+	if (signal(SIGTERM, signal_handler) == SIG_ERR || signal(SIGINT, signal_handler) == SIG_ERR) {
 		perror("signal error");
+		return -1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		if ((workers[i] = spawn_worker(listen_sk)) < 0) {
+			return -1;
+		}
+		started[i] = time(NULL);
+	}
+
+	printf("Serving with %d prefork workers\n", n);
+	fflush(stdout);
+
+	int wait = 0, empty = 0; // s between respawn retries, slots without a worker
+	time_t retry = 0; // when to try the empty slots again
+	while (!shutdown_requested) {
+		while (!child_exited && !shutdown_requested && (empty == 0 || time(NULL) < retry)) {
+			if (empty == 0) {
+				sigsuspend(&oldmask);
+			} else {
+				struct timespec ts = { retry - time(NULL), 0 };
+				pselect(0, NULL, NULL, NULL, &ts, &oldmask);
+			}
+		}
+		child_exited = 0;
+
+		// several workers may exit for a single signal
+		int status;
+		pid_t pid;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (int i = 0; i < n; i++) {
+				if (workers[i] != pid) {
+					continue;
+				}
+
+				if (WIFSIGNALED(status)) {
+					printf("worker %d killed by signal %d\n", pid, WTERMSIG(status));
+				} else {
+					printf("worker %d exited with %d\n", pid, WEXITSTATUS(status));
+				}
+
+				// don't spin on a worker that dies right away
+				if (!shutdown_requested && time(NULL) - started[i] < 1) {
+					sleep(1);
+				}
+				workers[i] = -1;
+				break;
+			}
+		}
+
+		if (shutdown_requested || time(NULL) < retry) {
+			continue;
+		}
+
+		empty = 0;
+		for (int i = 0; i < n; i++) {
+			if (workers[i] > 0) {
+				continue;
+			} else if ((workers[i] = spawn_worker(listen_sk)) < 0) {
+				empty++;
+			} else {
+				started[i] = time(NULL);
+			}
+		}
+
+		if (empty > 0) {
+			wait = wait == 0 ? RESPAWN_WAIT : wait * 2 > RESPAWN_MAX_WAIT ? RESPAWN_MAX_WAIT : wait * 2;
+			retry = time(NULL) + wait;
+			printf("%d worker slots empty, retrying in %ds\n", empty, wait);
+			fflush(stdout);
+		} else {
+			wait = 0;
+		}
+	}
+
+	// stop the pool
+	for (int i = 0; i < n; i++) {
+		if (workers[i] > 0) {
+			kill(workers[i], SIGTERM);
+		}
+	}
+	while (waitpid(-1, NULL, 0) > 0);
+
+	return 0;
+}
+
+/**
+ * Forks a child to serve a connection, fork backend only.
+ * @param listen_sk The listening socket, closed in the child.
+ * @param sk The connected socket, closed in the parent.
+ */
+void start_child(int listen_sk, int sk) {
+	// don't hand buffered output to the child
+	fflush(stdout);
+
+	// the count MUST be raised before the child can be reaped
+	sigset_t mask, oldmask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+	forked = TRACE_START();
+	pid_t cpid = fork();
+	if (cpid > 0) { // parent
+		active_children++;
+		sigprocmask(SIG_SETMASK, &oldmask, NULL);
+		close(sk);
+	} else if (cpid == 0) { // child
+		trace_child();
+		sigprocmask(SIG_SETMASK, &oldmask, NULL);
+		close(listen_sk);
+		if (local_sk >= 0) {
+			close(local_sk);
+		}
+
+		// serve requests until the client closes the connection
+		int rval = serve_conn(sk);
+
+		capture_flush();
+		close(sk);
+		exit(rval < 0 ? 1 : 0);
+	} else {
+		sigprocmask(SIG_SETMASK, &oldmask, NULL);
+		perror("fork error");
+		admit_shed(sk);
+	}
+}
+
+int main(int argc, char * argv[]) {
+	int opt, port = -1;
+	while ((opt = getopt(argc, argv, "d:m:p:i:n:b:Q:w:B:c:q:t:r:R:I:P:CLSTh")) != -1) {
+		switch (opt) {
+			case 'b':
+				if (strcmp(optarg, "fork") == 0) {
+					backend = BACKEND_FORK;
+				} else if (strcmp(optarg, "prefork") == 0) {
+					backend = BACKEND_PREFORK;
+				} else if (strcmp(optarg, "uring") == 0) {
+					backend = BACKEND_URING;
+				} else {
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'Q': sqpoll_cpu = atoi(optarg); break;
+			case 'w': nworkers = atoi(optarg); break;
+			case 'B': backlog = atoi(optarg); break;
+			case 'c': max_conns = atoi(optarg); break;
+			case 'q': max_queue = atoi(optarg); break;
+			case 't': queue_timeout = atoi(optarg); break;
+			case 'I': idle_timeout = atoi(optarg); break;
+			case 'P': capture_path = optarg; break;
+			case 'C': compact_image = 1; break;
+			case 'L': local_transport = 0; break;
+			case 'S': sync_commits = 1; break;
+			case 'T': tracing = 1; break;
+			case 'r': rate_limit = atof(optarg); break;
+			case 'R': rate_burst = atoi(optarg); break;
+			case 'd': dbfile = optarg; break;
+			case 'm': mapper_addr = optarg; break;
+			case 'p': port = atoi(optarg); break;
+			case 'i': shard_id = atoi(optarg); break;
+			case 'n': nshards = atoi(optarg); break;
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (nshards < 1 || nshards > MAXSHARDS || shard_id < 0 || shard_id >= nshards) {
+		fprintf(stderr, "invalid shard %d of %d\n", shard_id, nshards);
+		return 1;
+	}
+
+	if (nworkers < 1 || nworkers > MAXWORKERS) {
+		fprintf(stderr, "invalid number of workers %d\n", nworkers);
+		return 1;
+	}
+
+	if (backlog < 1 || max_conns < 1 || max_queue < 0 || queue_timeout < 0 || idle_timeout < 0 || rate_limit < 0) {
+		fprintf(stderr, "invalid admission limits\n");
+		return 1;
+	}
+
+	// shards default to consecutive ports so they can share a host
+	server_port = port > 0 ? port : SERVER_PORT + shard_id;
+
+	// the counters and rate limiter are shared with every child
+	if (metrics_init() < 0 || admit_init(rate_limit, rate_burst ? rate_burst : (int)rate_limit) < 0) {
+		return 1;
+	}
+
+	// so is the access telemetry, which is optional
+	if (sketch_init() < 0) {
+		fprintf(stderr, "access telemetry unavailable\n");
+	}
+
+	// repair the store from the redo log before serving it
+	if (store_init(sync_commits, compact_image) < 0) {
 		return 1;
 	}
-	
+
+	// tracing is optional, serve without it
+	if (trace_init(server_port, tracing) < 0) {
+		fprintf(stderr, "request tracing unavailable\n");
+	}
+
+	// a capture asked for is not optional
+	if (capture_path != NULL && capture_init(capture_path) < 0) {
+		return 1;
+	}
+
+	// register the signal handler, without SA_RESTART so a child
+	//	exiting wakes accept to start a queued connection
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = signal_handler;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGCHLD, &sa, NULL) < 0) {
+		perror("sigaction error");
+		return 1;
+	}
+
+	// a client that gave up and closed its connection must not kill
+	//	the process answering it, the send fails with EPIPE instead
+	signal(SIGPIPE, SIG_IGN);
+
+	// sharded servers advertise the shard they own
+	char service[20];
+	if (nshards > 1) {
+		snprintf(service, sizeof(service), "%s/shard-%d", SERVICE_NAME, shard_id);
+	} else {
+		snprintf(service, sizeof(service), "%s", SERVICE_NAME);
+	}
+
 	// advertise the service to the service mapper
-	if (advertise_service("CISBANK") < 0) {
+	if (advertise_service(service) < 0) {
 		perror("advertise error");
 		return 1;
 	}
 
 	struct sockaddr_in local, remote;
-	socklen_t len=sizeof(local), rlen=sizeof(remote);
+	socklen_t len=sizeof(local);
 	int old_sk, new_sk; // old_sk=parent, new_sk=child
-	char sendbuf[BUFMAX], recvbuf[BUFMAX];
 
 	if ((old_sk = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
 		perror("socket error");
@@ -421,7 +1228,7 @@ int main(int argc, char * argv[]) {
 	}
 
 	local.sin_family = AF_INET;
-	local.sin_port = htons(SERVER_PORT);
+	local.sin_port = htons(server_port);
 	local.sin_addr.s_addr = INADDR_ANY;
 
 	if (bind(old_sk, (struct sockaddr *)&local, len) < 0) {
@@ -430,97 +1237,67 @@ int main(int argc, char * argv[]) {
 		return 1;
 	}
 
-	if (listen(old_sk, BACKLOG) < 0) {
+	if (listen(old_sk, backlog) < 0) {
 		perror("listen error");
 		close(old_sk);
 		return 1;
 	}
 
-	while (1) {
-		if ((new_sk = accept(old_sk, (struct sockaddr *)&remote, &rlen)) < 0) {
-			perror("accept error");
-			continue;
+	// co-located clients skip the TCP stack, they fall back to TCP
+	//	if the unix socket is missing
+	if (local_transport && (local_sk = open_local()) < 0) {
+		fprintf(stderr, "local transport unavailable\n");
+	}
+
+	if (backend == BACKEND_PREFORK) {
+		// workers race to accept, the losers must not block
+		fcntl(old_sk, F_SETFL, fcntl(old_sk, F_GETFL) | O_NONBLOCK);
+		if (local_sk >= 0) {
+			fcntl(local_sk, F_SETFL, fcntl(local_sk, F_GETFL) | O_NONBLOCK);
 		}
 
-		pid_t cpid = fork();
-		if (cpid > 0) { // parent
-			close(new_sk);
-		} else if (cpid == 0) { // child
-			close(old_sk);
+		int rval = prefork_serve(old_sk, nworkers);
+		close(old_sk);
+		if (local_sk >= 0) {
+			close(local_sk);
+			unlink(local_path);
+		}
+		return rval < 0 ? 1 : 0;
+	}
 
-			ssize_t net_bytes = 0;
-			if ((net_bytes = recv(new_sk, recvbuf, sizeof(struct pkt_t), 0)) != sizeof(struct pkt_t)) {
-				printf("recv error");
-				close(new_sk);
-				exit(1);
-			}
-			
-			printf("Service Requested from %s\n", inet_ntoa(remote.sin_addr));
-
-			struct pkt_t pkt;
-			memcpy(&pkt, recvbuf, sizeof(struct pkt_t));
-			pkt.ptype = ntohs(pkt.ptype);
-
-			if (pkt.ptype == PTYPE_QUERY) {
-				pkt.body.query.code = ntohl(pkt.body.query.code);
-				if (pkt.body.query.code == DB_QUERY_CODE) {
-					pkt.body.query.acctnum = ntohl(pkt.body.query.acctnum);
-					if (query_record(pkt.body.query, &pkt.body.record) == 0) {
-						pkt.ptype = htons(PTYPE_RECORD);
-						pkt.body.record.acctnum = htonl(pkt.body.record.acctnum);
-						pkt.body.record.age = htonl(pkt.body.record.age);
-						int * ip = (int *)&pkt.body.record.value;
-						*ip = htonl(*ip);
-					} else { // error
-						pkt.ptype = PTYPE_ERROR;
-						strcpy(pkt.body.message, "Record not found!");
-					}
-				} else { // error
-					pkt.ptype = PTYPE_ERROR;
-					strcpy(pkt.body.message, "DB code does not match QUERY code!");
-				}
-			} else if (pkt.ptype == PTYPE_UPDATE) {
-				pkt.body.update.code = ntohl(pkt.body.update.code);
-				if (pkt.body.update.code == DB_UPDATE_CODE) {
-					pkt.body.update.acctnum = ntohl(pkt.body.update.acctnum);
-					int * ip = (int*)&pkt.body.update.value;
-					*ip = ntohl(*ip);
-
-					if (update_record(pkt.body.update) == 0) {
-						pkt.ptype = htons(PTYPE_UPDATE);
-						memset(pkt.body.message, 0, sizeof(pkt.body.message));
-						strcpy(pkt.body.message, "OK");
-					} else { // error
-						pkt.ptype = PTYPE_ERROR;
-						strcpy(pkt.body.message, "Record not found!");
-					}
-				} else { // error
-					pkt.ptype = PTYPE_ERROR;
-					strcpy(pkt.body.message, "DB code does not match UPDATE code!");
-				}
-			} else {
-				pkt.ptype = PTYPE_ERROR;
-				strcpy(pkt.body.message, "Invalid COMMAND code received!");
-			}
+	// only returns when io_uring is unavailable
+	if (backend == BACKEND_URING) {
+		uring_serve(old_sk, local_sk, sqpoll_cpu);
+		printf("io_uring unavailable, using the fork backend\n");
+	}
 
-			if (pkt.ptype == PTYPE_ERROR) {
-				pkt.ptype = htons(pkt.ptype);
-			}
+	struct connq_t connq;
+	if (connq_init(&connq, max_queue, queue_timeout) < 0) {
+		close(old_sk);
+		return 1;
+	}
 
-			memcpy(sendbuf, &pkt, sizeof(struct pkt_t));
-			if (send(new_sk, sendbuf, sizeof(struct pkt_t), 0) != sizeof(struct pkt_t)) {
-				perror("send error");
-				close(new_sk);
-				exit(1);
-			}
+	sigset_t chldmask;
+	sigemptyset(&chldmask);
+	sigaddset(&chldmask, SIGCHLD);
 
-			close(new_sk);
-			exit(0);
-		} else {
-			perror("fork error");
-			close(new_sk);
+	while (1) {
+		// start queued connections as children finish
+		while (active_children < max_conns && (new_sk = connq_pop(&connq)) >= 0) {
+			start_child(old_sk, new_sk);
+		}
+
+		// wake up to shed queued connections that waited too long
+		if ((new_sk = accept_conn(old_sk, connq_expire(&connq), &remote)) < 0) {
 			continue;
 		}
+
+		// serve, queue or shed the connection
+		if (active_children < max_conns && connq.count == 0) {
+			start_child(old_sk, new_sk);
+		} else if (connq_push(&connq, new_sk) < 0) {
+			admit_shed(new_sk);
+		}
 	}
 
 	close(old_sk);
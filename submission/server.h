@@ -0,0 +1,58 @@
+/**
+ * Declarations shared by the database server and its I/O backends.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Add the prefork backend.
+ *			   - Export the admission limits.
+ *			   - Add request deadlines and the idle timeout.
+ *			   - Add the local unix socket listener.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <netinet/in.h>
+
+#include "proto.h"
+
+// server defines
+#define PKTSIZE sizeof(struct pkt_t)
+#define IOBUF_PKTS 32 // requests read per recv
+
+// I/O backends selectable at startup
+#define BACKEND_FORK 0 // one child process per connection
+#define BACKEND_URING 1 // one io_uring event loop
+#define BACKEND_PREFORK 2 // pool of long lived worker processes
+
+// per-connection I/O buffer, requests are decoded and answered in place
+union iobuf_t {
+	char bytes[IOBUF_PKTS * PKTSIZE];
+	struct pkt_t pkts[IOBUF_PKTS]; // keeps packets aligned
+};
+
+//
+// server configuration - set from the command line
+//
+
+extern char * dbfile;
+extern int shard_id; // the shard owned by this server
+extern int nshards; // the total number of shards
+extern int max_conns; // connections served at once
+extern int max_queue; // accepted connections waiting to be served
+extern int queue_timeout; // ms a queued connection may wait
+extern int idle_timeout; // ms a connection may send nothing, 0 for no limit
+
+//
+// PROTOTYPES
+//
+
+int drop_expired(struct pkt_t *, double);
+void encode_error(struct pkt_t *, const char *);
+void encode_record(struct pkt_t *, struct record_t *);
+void handle_pkt(struct pkt_t *);
+void note_late(struct pkt_t *, double);
+double now_ms();
+struct in_addr peer_addr(int);
+int uring_serve(int, int, int);
+
+#endif
@@ -12,6 +12,19 @@
  *			   - No longer use addr_info_str type.
  *	03/28/2020 - Get servicemap working 100%.
  *	03/30/2020 - Complete testing of servicemap.c
+ *	10/18/2026 - Move the wire protocol into proto.h.
+ *			   - Drop requests that waited in the socket longer than
+ *				 their budget, the sender has already retried.
+ *			   - Add peers that gossip registrations, a snapshot for
+ *				 warm restarts and command line options.
+ *			   - Replace the entry of a service that registers again.
+ * Replication:
+ *	Every instance answers lookups from its own cache. A registration
+ *	is stamped with the time it arrived and pushed to every peer at
+ *	once; each GOSSIP_INTERVAL one peer, in turn, is sent the whole
+ *	cache, so pushes that were lost still spread. The newest stamp of
+ *	a service wins, which makes merging order independent. A starting
+ *	instance loads its snapshot and pulls the cache of every peer.
  */
 
 #include <sys/types.h>
@@ -23,60 +36,20 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+
+#include "proto.h"
 
 // service map defines
-#define BUFMAX 1024
 #define NENTRIES 32
 #define NOT_FOUND NENTRIES + 1
-#define PORT 21896
-
-// packet code defines
-#define PTYPE_REGISTER 0
-#define PTYPE_LOOKUP 10
-#define PTYPE_QUERY 20
-#define PTYPE_UPDATE 30
-#define PTYPE_RECORD 40
-#define PTYPE_ERROR 50
-
-//
-// packet stuff
-//
-
-// database query type
-struct query_t {
-	int code;
-	int acctnum;
-};
-
-// database update type
-struct update_t {
-	int code;
-	int acctnum;
-	float value;
-};
-
-// database record type
-struct record_t {
-	int acctnum;
-	char name[20];
-	float value;
-	int age;
-};
-
-// allows for sending/receiving fixed sized chunks to/from clients
-// all of these refer to the same region in memory
-union body_t {
-	char message[BUFMAX/4]; // can be commands, errors, etc...
-	struct query_t query;
-	struct update_t update;
-	struct record_t record;
-};
-
-// send this type to/from clients - best to define in header file
-struct pkt_t {
-	unsigned short ptype; // what data type is stored in the packet
-	union body_t body; // the data stored in the packet
-};
+#define PORT MAPPER_PORT
+#define MAXPEERS 16
+#define GOSSIP_INTERVAL 2000 // ms between full cache pushes to a peer
+#define MAX_SKEW 60000000000ULL // ns a gossiped registration may be ahead of our clock
+#define SNAP_MAGIC 0x43425350
 
 //
 // service cache stuff
@@ -87,21 +60,50 @@ struct entry_t {
 	char addrstr[24];
 	unsigned short occupied;
 	unsigned long age;
+	uint64_t version; // ns since the epoch the registration arrived
 };
 
 // locally caches services and their addresses for use by 
 //	clients of those services
 static struct entry_t scache[NENTRIES];
 
+// a cache entry as stored in the snapshot
+struct snap_entry_t {
+	char service[20];
+	char addrstr[24];
+	uint64_t version;
+};
+
+//
+// service map configuration - set from the command line
+//
+
+static unsigned short port = PORT;
+static struct sockaddr_in peers[MAXPEERS];
+static int npeers = 0;
+static double pulled[MAXPEERS]; // when each peer was last answered a pull, in ms
+static char * snap_path = NULL; // no snapshot when NULL
+
 //
 // PROTOTYPES
 //
 
 void age_cache();
+int expired(unsigned short, struct msghdr *);
+int find_peer(struct sockaddr_in *);
 char * get_cache(char *);
+int load_snapshot();
+int main(int, char * []);
+double now_ms();
 unsigned int page_cache();
 void parse_string(char *, char * [], int, char *);
-void put_cache(char *, char *);
+int parse_peer(char *, struct sockaddr_in *);
+void print_usage(char *);
+void pull_peers(int);
+void push_cache(int, struct sockaddr_in *);
+void push_entry(int, struct sockaddr_in *, struct entry_t *);
+int put_cache(char *, char *, uint64_t);
+int save_snapshot();
 
 //
 // METHODS
@@ -118,6 +120,32 @@ void age_cache() {
 	}
 }
 
+/**
+ * Checks if a request waited in the socket longer than its budget,
+ * using the time the kernel received it.
+ * @param budget The request budget in ms, 0 for no limit.
+ * @param msg The received message, carrying the receive timestamp.
+ * @return 1 if the request expired, 0 otherwise.
+ */
+int expired(unsigned short budget, struct msghdr * msg) {
+	if (budget == 0) {
+		return 0;
+	}
+
+	for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			struct timespec recvd, now;
+			memcpy(&recvd, CMSG_DATA(cmsg), sizeof(recvd));
+			clock_gettime(CLOCK_REALTIME, &now);
+
+			double waited = (now.tv_sec - recvd.tv_sec) * 1000.0 + (now.tv_nsec - recvd.tv_nsec) / 1000000.0;
+			return waited >= budget;
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Attempts to retrieve an entry from the service cache.
  * @param service A pointer to a buffer containing the service
@@ -181,20 +209,33 @@ void parse_string(char * src, char * dest[], int n, char * delim) {
 }
 
 /**
- * Stores a service/addrstr pair in the service cache.
+ * Stores a service/addrstr pair in the service cache, replacing an
+ * older registration of the service.
  * @param service The LAN unique name of the service.
  * @param addrstr The LAN unique address string of the server 
  * providing the service.
+ * @param version When the registration arrived, in ns since the epoch.
+ * @return 1 if the pair was stored, 0 if the cache holds a newer
+ * registration of the service.
  */
-void put_cache(char * service, char * addrstr) {
+int put_cache(char * service, char * addrstr, uint64_t version) {
 	unsigned int pos = NOT_FOUND;
 
+	for (unsigned int i = 0; i < NENTRIES; i++) {
+		if (scache[i].occupied && strncmp(scache[i].service, service, sizeof(scache[i].service)) == 0) {
+			if (scache[i].version >= version) {
+				return 0;
+			}
+			pos = i;
+			break;
+		}
+	}
+
 	age_cache();
 
-	for (unsigned int i = 0; i < NENTRIES; i++) {
+	for (unsigned int i = 0; i < NENTRIES && pos == NOT_FOUND; i++) {
 		if (!scache[i].occupied) {
 			pos = i;
-			break;
 		}
 	}
 
@@ -208,6 +249,183 @@ void put_cache(char * service, char * addrstr) {
 	strncpy(scache[pos].addrstr, addrstr, sizeof(scache[pos].addrstr));
 	scache[pos].occupied = 1;
 	scache[pos].age = 0;
+	scache[pos].version = version;
+	return 1;
+}
+
+/**
+ * Gets the time on the monotonic clock.
+ * @returns The time in ms.
+ */
+double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Prints command line usage.
+ * @param prog The name the program was invoked with.
+ */
+void print_usage(char * prog) {
+	printf("usage: %s [-p port] [-P peer_addr:port]... [-s snapshot]\n", prog);
+	printf("\t-p The port to serve on (default %d).\n", PORT);
+	printf("\t-P A peer instance to gossip registrations with, up to %d.\n", MAXPEERS);
+	printf("\t-s The file to keep the cache in across restarts.\n");
+}
+
+/**
+ * Parses a peer address of the form addr:port.
+ * @param src The peer address.
+ * @param dest The socket address to initialize.
+ * @return 0 on success, -1 on error.
+ */
+int parse_peer(char * src, struct sockaddr_in * dest) {
+	char addr[INET_ADDRSTRLEN];
+	int peer_port;
+	if (sscanf(src, "%15[^:]:%d", addr, &peer_port) != 2 || peer_port < 1 || peer_port > 65535) {
+		return -1;
+	}
+
+	memset(dest, 0, sizeof(*dest));
+	dest->sin_family = AF_INET;
+	dest->sin_port = htons(peer_port);
+	return inet_aton(addr, &dest->sin_addr) ? 0 : -1;
+}
+
+/**
+ * Finds the peer a packet came from.
+ * @param addr The source address and port of the packet.
+ * @return The index of the peer in peers, -1 if it is not a peer.
+ */
+int find_peer(struct sockaddr_in * addr) {
+	for (int i = 0; i < npeers; i++) {
+		if (peers[i].sin_addr.s_addr == addr->sin_addr.s_addr && peers[i].sin_port == addr->sin_port) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Loads the cache from the snapshot.
+ * @return The number of entries loaded, -1 on error.
+ */
+int load_snapshot() {
+	int fd = open(snap_path, O_RDONLY);
+	if (fd < 0) {
+		return 0; // first start
+	}
+
+	uint32_t hdr[2];
+	struct snap_entry_t entries[NENTRIES];
+	int loaded = 0;
+	if (read(fd, hdr, sizeof(hdr)) == sizeof(hdr) && hdr[0] == SNAP_MAGIC && hdr[1] <= NENTRIES) {
+		ssize_t len = hdr[1] * sizeof(struct snap_entry_t);
+		if (read(fd, entries, len) == len) {
+			for (uint32_t i = 0; i < hdr[1]; i++) {
+				entries[i].service[sizeof(entries[i].service) - 1] = '\0';
+				entries[i].addrstr[sizeof(entries[i].addrstr) - 1] = '\0';
+				loaded += put_cache(entries[i].service, entries[i].addrstr, entries[i].version);
+			}
+		}
+	} else {
+		fprintf(stderr, "%s is not a snapshot, ignored\n", snap_path);
+	}
+
+	close(fd);
+	return loaded;
+}
+
+/**
+ * Writes the cache to the snapshot, replacing it whole so a crash
+ * leaves the old or the new one.
+ * @return 0 on success, -1 on error.
+ */
+int save_snapshot() {
+	if (snap_path == NULL) {
+		return 0;
+	}
+
+	struct snap_entry_t entries[NENTRIES];
+	uint32_t hdr[2] = { SNAP_MAGIC, 0 };
+	memset(entries, 0, sizeof(entries));
+	for (unsigned int i = 0; i < NENTRIES; i++) {
+		if (scache[i].occupied) {
+			memcpy(entries[hdr[1]].service, scache[i].service, sizeof(entries[0].service));
+			memcpy(entries[hdr[1]].addrstr, scache[i].addrstr, sizeof(entries[0].addrstr));
+			entries[hdr[1]].version = scache[i].version;
+			hdr[1]++;
+		}
+	}
+
+	char tmp[BUFMAX/4];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", snap_path);
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	ssize_t len = hdr[1] * sizeof(struct snap_entry_t);
+	if (write(fd, hdr, sizeof(hdr)) != sizeof(hdr) || write(fd, entries, len) != len
+			|| fsync(fd) < 0 || rename(tmp, snap_path) < 0) {
+		perror("snapshot error");
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+/**
+ * Sends one cache entry to a peer. Peers don't answer pushes.
+ * @param sk The service map socket.
+ * @param peer The peer to send to.
+ * @param entry The entry.
+ */
+void push_entry(int sk, struct sockaddr_in * peer, struct entry_t * entry) {
+	struct pkt_t pkt;
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ptype = htons(PTYPE_SYNC);
+	snprintf(pkt.body.message, sizeof(pkt.body.message), "PUSH %s %s %llu",
+			entry->service, entry->addrstr, (unsigned long long)entry->version);
+
+	if (sendto(sk, &pkt, sizeof(pkt), 0, (struct sockaddr *)peer, sizeof(*peer)) < 0) {
+		perror("sendto error");
+	}
+}
+
+/**
+ * Sends the whole cache to a peer.
+ * @param sk The service map socket.
+ * @param peer The peer to send to.
+ */
+void push_cache(int sk, struct sockaddr_in * peer) {
+	for (unsigned int i = 0; i < NENTRIES; i++) {
+		if (scache[i].occupied) {
+			push_entry(sk, peer, &scache[i]);
+		}
+	}
+}
+
+/**
+ * Asks every peer for its whole cache, answered with pushes.
+ * @param sk The service map socket.
+ */
+void pull_peers(int sk) {
+	struct pkt_t pkt;
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ptype = htons(PTYPE_SYNC);
+	strcpy(pkt.body.message, "PULL");
+
+	for (int i = 0; i < npeers; i++) {
+		if (sendto(sk, &pkt, sizeof(pkt), 0, (struct sockaddr *)&peers[i], sizeof(peers[i])) < 0) {
+			perror("sendto error");
+		}
+	}
 }
 
 /**
@@ -218,16 +436,39 @@ void put_cache(char * service, char * addrstr) {
 int main(int argc, char * argv[]) {
 	struct sockaddr_in local, remote;
 	socklen_t len=sizeof(local), rlen=sizeof(remote);
-	int sk;
+	int sk, opt;
 	char sendbuf[BUFMAX], recvbuf[BUFMAX];
 
+	while ((opt = getopt(argc, argv, "p:P:s:h")) != -1) {
+		switch (opt) {
+			case 'p': port = atoi(optarg); break;
+			case 's': snap_path = optarg; break;
+			case 'P':
+				if (npeers == MAXPEERS || parse_peer(optarg, &peers[npeers]) < 0) {
+					fprintf(stderr, "invalid peer %s\n", optarg);
+					return 1;
+				}
+				npeers++;
+				break;
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	// warm restart, peers fill in what changed while we were down
+	int loaded;
+	if (snap_path != NULL && (loaded = load_snapshot()) > 0) {
+		printf("Loaded %d services from %s\n", loaded, snap_path);
+	}
+
 	if ((sk = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
 		perror("socket error");
 		return 1;
 	}
 
 	local.sin_family = AF_INET;
-	local.sin_port = htons(PORT);
+	local.sin_port = htons(port);
 	local.sin_addr.s_addr = INADDR_ANY;
 
 	if (bind(sk, (struct sockaddr *)&local, len) < 0) {
@@ -236,7 +477,30 @@ int main(int argc, char * argv[]) {
 		return 1;
 	}
 
+	// stamp each request with its arrival so stale ones can be dropped
+	int stamp = 1;
+	if (setsockopt(sk, SOL_SOCKET, SO_TIMESTAMPNS, &stamp, sizeof(stamp)) < 0) {
+		perror("setsockopt error");
+	}
+
+	pull_peers(sk);
+	double next_gossip = now_ms() + GOSSIP_INTERVAL;
+	int next_peer = 0;
+
 	while (1) {
+		// push the whole cache to the next peer in turn
+		double now = now_ms();
+		if (npeers > 0 && now >= next_gossip) {
+			push_cache(sk, &peers[next_peer]);
+			next_peer = (next_peer + 1) % npeers;
+			next_gossip = now + GOSSIP_INTERVAL;
+		}
+
+		struct pollfd pfd = { sk, POLLIN, 0 };
+		if (poll(&pfd, 1, npeers > 0 ? (int)(next_gossip - now) + 1 : -1) <= 0) {
+			continue;
+		}
+
 		// these get written to/read from sendbuf/recvbuf
 		struct pkt_t pkt;
 		
@@ -244,8 +508,19 @@ int main(int argc, char * argv[]) {
 		memset(sendbuf, 0, sizeof(sendbuf));
 		memset(recvbuf, 0, sizeof(recvbuf));
 
+		char ctlbuf[CMSG_SPACE(sizeof(struct timespec))];
+		struct iovec iov = { recvbuf, sizeof(struct pkt_t) };
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &remote;
+		msg.msg_namelen = rlen;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = ctlbuf;
+		msg.msg_controllen = sizeof(ctlbuf);
+
 		ssize_t net_bytes = 0;
-		if ((net_bytes = recvfrom(sk, recvbuf, sizeof(struct pkt_t), 0, (struct sockaddr *)&remote, &rlen)) < 0) {
+		if ((net_bytes = recvmsg(sk, &msg, 0)) < 0) {
 			perror("recvfrom error");
 			continue;
 		}
@@ -257,14 +532,65 @@ int main(int argc, char * argv[]) {
 
 		memcpy(&pkt, recvbuf, sizeof(struct pkt_t));
 		pkt.ptype = ntohs(pkt.ptype);
+		pkt.body.message[sizeof(pkt.body.message) - 1] = '\0';
+
+		// peers gossip without replies, anyone else is ignored
+		if (pkt.ptype == PTYPE_SYNC) {
+			int peer = find_peer(&remote);
+			if (peer < 0) {
+				printf("Dropped gossip from %s, not a peer\n", inet_ntoa(remote.sin_addr));
+				continue;
+			}
+
+			char * tokens[4] = { NULL, NULL, NULL, NULL };
+			parse_string(pkt.body.message, tokens, 4, " ");
+
+			// a registration stamped far ahead of our clock would never be replaced
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			uint64_t latest = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + MAX_SKEW;
+
+			// a restarting peer pulls once, more often only amplifies a spoofed source
+			if (tokens[0] != NULL && strcmp(tokens[0], "PULL") == 0) {
+				if (pulled[peer] == 0 || now_ms() - pulled[peer] >= GOSSIP_INTERVAL) {
+					pulled[peer] = now_ms();
+					push_cache(sk, &peers[peer]);
+				}
+			} else if (tokens[0] != NULL && strcmp(tokens[0], "PUSH") == 0 && tokens[3] != NULL
+					&& strtoull(tokens[3], NULL, 10) <= latest
+					&& put_cache(tokens[1], tokens[2], strtoull(tokens[3], NULL, 10))) {
+				printf("Learned %s at %s from %s\n", tokens[1], tokens[2], inet_ntoa(remote.sin_addr));
+				save_snapshot();
+			}
+			continue;
+		}
+
 		printf("Received from %s: %s\n", inet_ntoa(remote.sin_addr), pkt.body.message);
 
+		// the sender gave up on this request and sent another
+		if (expired(ntohs(pkt.budget), &msg)) {
+			printf("Dropped expired request from %s\n", inet_ntoa(remote.sin_addr));
+			continue;
+		}
+
 		if (pkt.ptype == PTYPE_REGISTER) {
 			char * tokens[3];
 			parse_string(pkt.body.message, tokens, 3, " ");
 
 			if (strcmp(tokens[0], "PUT") == 0) {
-				put_cache(tokens[1], tokens[2]);
+				struct timespec ts;
+				clock_gettime(CLOCK_REALTIME, &ts);
+				put_cache(tokens[1], tokens[2], (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+				save_snapshot();
+
+				// peers learn of it now rather than at the next gossip
+				for (int i = 0; i < NENTRIES && npeers > 0; i++) {
+					if (scache[i].occupied && strcmp(scache[i].service, tokens[1]) == 0) {
+						for (int j = 0; j < npeers; j++) {
+							push_entry(sk, &peers[j], &scache[i]);
+						}
+					}
+				}
 
 				pkt.ptype = htons(PTYPE_REGISTER);
 				memset(pkt.body.message, 0, sizeof(pkt.body.message));
@@ -0,0 +1,316 @@
+/**
+ * Implements the access telemetry of the record store, see sketch.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+
+#include "proto.h"
+#include "sketch.h"
+
+#define HLL_REGISTERS (1 << SKETCH_HLL_BITS)
+#define LOCK_SPINS 64 // yields waiting for the top table before checking on its holder
+
+// an account of the top table
+struct top_t {
+	int acctnum;
+	uint32_t count; // estimated accesses when last seen
+};
+
+// the sketches, shared by every worker
+struct sketch_t {
+	uint64_t reads;
+	uint64_t writes;
+	uint32_t all[SKETCH_DEPTH][SKETCH_WIDTH]; // every access
+	uint32_t written[SKETCH_DEPTH][SKETCH_WIDTH]; // writes only
+	uint8_t hll[HLL_REGISTERS];
+	pid_t top_holder; // the worker changing the top table, 0 for none
+	uint32_t top_min; // the count an account needs to enter the table
+	int ntop;
+	struct top_t top[SKETCH_TOPK];
+};
+
+static struct sketch_t * sketch = NULL;
+
+//
+// PROTOTYPES
+//
+
+static uint32_t cms_estimate(uint32_t [][SKETCH_WIDTH], uint64_t);
+static int cmp_top(const void *, const void *);
+static uint64_t hash_acct(int);
+static double hll_estimate();
+static double natural_log(double);
+static int top_lock(int);
+static void top_offer(int, uint32_t);
+
+//
+// METHODS
+//
+
+/**
+ * Hashes an account, splitmix64 finalizer.
+ * @param acctnum The account.
+ * @returns The hash.
+ */
+static uint64_t hash_acct(int acctnum) {
+	uint64_t h = (uint32_t)acctnum + 0x9e3779b97f4a7c15ULL;
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+/**
+ * Estimates the count of an account in a count-min sketch, the
+ * smallest of its counters.
+ * @param cms The sketch.
+ * @param h The hash of the account.
+ * @returns The estimate.
+ */
+static uint32_t cms_estimate(uint32_t cms[][SKETCH_WIDTH], uint64_t h) {
+	uint32_t h1 = h, h2 = (h >> 32) | 1, est = UINT32_MAX;
+	for (int d = 0; d < SKETCH_DEPTH; d++) {
+		uint32_t n = __atomic_load_n(&cms[d][(h1 + d * h2) % SKETCH_WIDTH], __ATOMIC_RELAXED);
+		if (n < est) {
+			est = n;
+		}
+	}
+	return est;
+}
+
+/**
+ * Orders top table accounts by descending count.
+ */
+static int cmp_top(const void * a, const void * b) {
+	const struct top_t * x = a, * y = b;
+	return (x->count < y->count) - (x->count > y->count);
+}
+
+/**
+ * Locks the top table. A worker that dies holding it never gives it
+ * back, so a caller that would give up, or a waiter after LOCK_SPINS
+ * yields, takes it over from a holder that no longer exists.
+ * @param wait Yield until the table is free, else give up at once.
+ * @returns 0 if locked, -1 if another worker holds it.
+ */
+static int top_lock(int wait) {
+	pid_t self = getpid(), holder = 0;
+	for (int spins = 0; !__atomic_compare_exchange_n(&sketch->top_holder, &holder, self, 0,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED); spins++) {
+		if ((!wait || spins >= LOCK_SPINS) && holder != 0 && kill(holder, 0) < 0 && errno == ESRCH
+				&& __atomic_compare_exchange_n(&sketch->top_holder, &holder, self, 0,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return 0;
+		}
+		if (!wait) {
+			return -1;
+		}
+		holder = 0;
+		sched_yield();
+	}
+	return 0;
+}
+
+/**
+ * Offers an account to the top table. The table is skipped rather
+ * than waited for while another worker changes it.
+ * @param acctnum The account.
+ * @param count Its estimated accesses.
+ */
+static void top_offer(int acctnum, uint32_t count) {
+	if (count <= __atomic_load_n(&sketch->top_min, __ATOMIC_RELAXED)
+			|| top_lock(0) < 0) {
+		return;
+	}
+
+	int i, lo = 0;
+	for (i = 0; i < sketch->ntop && sketch->top[i].acctnum != acctnum; i++) {
+		if (sketch->top[i].count < sketch->top[lo].count) {
+			lo = i;
+		}
+	}
+
+	if (i < sketch->ntop) {
+		sketch->top[i].count = count;
+	} else if (sketch->ntop < SKETCH_TOPK) {
+		sketch->top[sketch->ntop].acctnum = acctnum;
+		sketch->top[sketch->ntop++].count = count;
+	} else if (count > sketch->top[lo].count) {
+		sketch->top[lo].acctnum = acctnum;
+		sketch->top[lo].count = count;
+	}
+
+	// only a full table has a bar to clear
+	uint32_t min = 0;
+	if (sketch->ntop == SKETCH_TOPK) {
+		min = UINT32_MAX;
+		for (i = 0; i < sketch->ntop; i++) {
+			if (sketch->top[i].count < min) {
+				min = sketch->top[i].count;
+			}
+		}
+	}
+	__atomic_store_n(&sketch->top_min, min, __ATOMIC_RELAXED);
+	__atomic_store_n(&sketch->top_holder, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Counts an access of an account.
+ * @param acctnum The account.
+ * @param write The access changes the account.
+ */
+void sketch_note(int acctnum, int write) {
+	if (sketch == NULL) {
+		return;
+	}
+
+	uint64_t h = hash_acct(acctnum);
+	uint32_t h1 = h, h2 = (h >> 32) | 1, est = UINT32_MAX;
+	for (int d = 0; d < SKETCH_DEPTH; d++) {
+		uint32_t col = (h1 + d * h2) % SKETCH_WIDTH;
+		uint32_t n = __atomic_add_fetch(&sketch->all[d][col], 1, __ATOMIC_RELAXED);
+		if (n < est) {
+			est = n;
+		}
+		if (write) {
+			__atomic_fetch_add(&sketch->written[d][col], 1, __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_fetch_add(write ? &sketch->writes : &sketch->reads, 1, __ATOMIC_RELAXED);
+
+	// the register keeps the longest run of leading zeros seen
+	uint8_t * reg = &sketch->hll[h >> (64 - SKETCH_HLL_BITS)];
+	uint8_t rank = __builtin_clzll((h << SKETCH_HLL_BITS) | (1ULL << (SKETCH_HLL_BITS - 1))) + 1;
+	uint8_t old = __atomic_load_n(reg, __ATOMIC_RELAXED);
+	while (rank > old && !__atomic_compare_exchange_n(reg, &old, rank, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	top_offer(acctnum, est);
+}
+
+/**
+ * Computes a natural logarithm, the server does not link libm.
+ * @param x The argument, greater than 0.
+ * @returns ln x.
+ */
+static double natural_log(double x) {
+	int k = 0;
+	for (; x >= 2; x /= 2) {
+		k++;
+	}
+	for (; x < 1; x *= 2) {
+		k--;
+	}
+
+	// ln x = 2 atanh y, y below 1/3 converges quickly
+	double y = (x - 1) / (x + 1), term = y, sum = 0;
+	for (int i = 1; i < 40; i += 2) {
+		sum += term / i;
+		term *= y * y;
+	}
+	return 2 * sum + k * 0.69314718055994531;
+}
+
+/**
+ * Estimates the number of accounts accessed from the HyperLogLog,
+ * counting the empty registers while few are set.
+ * @returns The estimate.
+ */
+static double hll_estimate() {
+	double m = HLL_REGISTERS, sum = 0;
+	int zeros = 0;
+	for (int i = 0; i < HLL_REGISTERS; i++) {
+		uint8_t r = __atomic_load_n(&sketch->hll[i], __ATOMIC_RELAXED);
+		sum += 1.0 / (1ULL << r);
+		zeros += r == 0;
+	}
+
+	double est = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+	if (est <= 2.5 * m && zeros > 0) {
+		est = m * natural_log(m / zeros);
+	}
+	return est;
+}
+
+/**
+ * Formats a section of the telemetry:
+ *	keys: reads=n writes=n write_ppm=n working_set=n working_set_bytes=n
+ *		top_share_ppm=n
+ *	top: acctnum=reads/writes ..., hottest first, as many as fit
+ * @param section The section to format.
+ * @param dest The buffer to write the section to.
+ * @param len The length of the destination buffer.
+ * @returns 0 on success, -1 if the section does not exist.
+ */
+int sketch_format(const char * section, char * dest, size_t len) {
+	if (sketch == NULL || (strcmp(section, "keys") != 0 && strcmp(section, "top") != 0)) {
+		return -1;
+	}
+
+	// copy the table, waiting out the worker changing it
+	struct top_t top[SKETCH_TOPK];
+	top_lock(1);
+	int ntop = sketch->ntop;
+	memcpy(top, sketch->top, sizeof(top));
+	__atomic_store_n(&sketch->top_holder, 0, __ATOMIC_RELEASE);
+	qsort(top, ntop, sizeof(struct top_t), cmp_top);
+
+	uint64_t reads = __atomic_load_n(&sketch->reads, __ATOMIC_RELAXED);
+	uint64_t writes = __atomic_load_n(&sketch->writes, __ATOMIC_RELAXED);
+	if (strcmp(section, "keys") == 0) {
+		uint64_t total = reads + writes, hottest = 0;
+		for (int i = 0; i < ntop; i++) {
+			hottest += top[i].count;
+		}
+
+		uint64_t ws = hll_estimate() + 0.5;
+		snprintf(dest, len, "keys: reads=%lu writes=%lu write_ppm=%lu working_set=%lu working_set_bytes=%lu "
+				"top_share_ppm=%lu", (unsigned long)reads, (unsigned long)writes,
+				(unsigned long)(total ? writes * 1000000 / total : 0), (unsigned long)ws,
+				(unsigned long)(ws * sizeof(struct record_t)),
+				(unsigned long)(total ? (hottest < total ? hottest : total) * 1000000 / total : 0));
+		return 0;
+	}
+
+	size_t off = snprintf(dest, len, "top:");
+	for (int i = 0; i < ntop; i++) {
+		uint64_t h = hash_acct(top[i].acctnum);
+		uint32_t all = cms_estimate(sketch->all, h), written = cms_estimate(sketch->written, h);
+
+		// stop at the last account that fits whole
+		char entry[48];
+		int n = snprintf(entry, sizeof(entry), " %d=%u/%u", top[i].acctnum, all > written ? all - written : 0,
+				written);
+		if (off + n >= len) {
+			break;
+		}
+		memcpy(dest + off, entry, n + 1);
+		off += n;
+	}
+	return 0;
+}
+
+/**
+ * Maps the sketches. MUST be called before the server forks.
+ * @returns 0 on success, -1 on error.
+ */
+int sketch_init() {
+	void * addr = mmap(NULL, sizeof(struct sketch_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+
+	sketch = addr;
+	return 0;
+}
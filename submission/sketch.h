@@ -0,0 +1,36 @@
+/**
+ * Access telemetry of the record store. Every query and change of an
+ * account is counted in streaming sketches that live in a shared
+ * mapping created before the server forks, so every worker feeds the
+ * same sketches at a few atomic adds per access and fixed memory:
+ *	- count-min sketches of all accesses and of writes, which estimate
+ *	  the accesses of any account, never below the real count;
+ *	- a table of the SKETCH_TOPK accounts with the most accesses;
+ *	- a HyperLogLog of the accounts accessed, the working set.
+ * They are reported through PTYPE_STATS as the "keys" and "top"
+ * sections and count from the start of the server.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stddef.h>
+
+// sketch defines
+#define SKETCH_DEPTH 4 // rows of a count-min sketch
+#define SKETCH_WIDTH 4096 // counters per row, estimates are off by about
+						  //	2 / SKETCH_WIDTH of all accesses
+#define SKETCH_TOPK 16 // hottest accounts tracked
+#define SKETCH_HLL_BITS 12 // 2^bits registers, about 1.6% error
+
+//
+// PROTOTYPES
+//
+
+int sketch_format(const char *, char *, size_t);
+int sketch_init();
+void sketch_note(int, int);
+
+#endif
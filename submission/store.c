@@ -0,0 +1,1811 @@
+/**
+ * Implements the record store of the database server, see store.h.
+ * Changelog:
+ *	10/18/2026 - Created from the record code in server.c.
+ *			   - Add transactions and the redo log, updates run as
+ *				 single record transactions.
+ *			   - Hand back the changed records, read under the same
+ *				 locks as the write.
+ *			   - Trace the scan, lock, log and write phases.
+ *			   - Reject missing accounts through a Bloom filter.
+ *			   - Map the store, read records under sequence counters
+ *				 instead of locks.
+ *			   - Combine the updates of hot accounts.
+ *			   - Count the accesses of every account.
+ *			   - Binary search the sorted start of the store through
+ *				 its index.
+ *			   - Add batched scans that read the store ahead.
+ *			   - Append every committed change to the ledger.
+ *			   - Answer queries from the compact image when built.
+ *			   - Promote the accounts of the cold tier on access and
+ *				 stamp every record served.
+ *			   - Coalesce the lookups of concurrent queries of an
+ *				 account.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "compact.h"
+#include "ledger.h"
+#include "metrics.h"
+#include "server.h"
+#include "sketch.h"
+#include "store.h"
+#include "tier.h"
+#include "trace.h"
+
+// a redo log entry header, followed by count log_rec_t
+struct log_hdr_t {
+	uint32_t magic;
+	uint32_t count;
+	uint32_t checksum; // of the records that follow
+};
+
+// the new value of one record and where it goes
+struct log_rec_t {
+	int64_t offset;
+	struct record_t record;
+};
+
+// Bloom filter over the accounts of the store or of its cold tier
+struct bloom_t {
+	uint64_t nbits; // a power of two
+	uint64_t covered; // store bytes whose accounts are in the filter
+	uint64_t appended; // store bytes known, moved by every append
+	uint64_t words[]; // nbits / 64
+};
+
+// a record promoted from the cold tier
+struct promo_t {
+	uint64_t key; // HOT_KEY of the account, 0 for a free slot
+	int64_t offset; // of its record in the store
+};
+
+// the records of the store after its sorted ones, so lookups need not
+//	scan for them
+struct promos_t {
+	uint32_t nslots; // a power of two
+	uint32_t full; // a record found no slot, lookups scan again
+	struct promo_t slots[];
+};
+
+// contention of an account, and its pending changes once it is hot
+struct hot_t {
+	uint64_t key; // HOT_KEY of the account, 0 for a free slot
+	int64_t offset; // of the record
+	uint32_t waits; // updates that waited on the record lock
+	uint32_t hot; // updates are combined
+	pid_t combiner; // the worker running the next round, 0 for none
+	uint64_t round; // combining rounds committed
+	uint64_t failed; // the last round that failed to commit
+	uint64_t pending[HOT_STRIPES]; // the last round before it << 32 | float sum
+	uint32_t rseq; // odd while a round copies its record in
+	struct record_t record; // the record as the last round committed it
+};
+
+// the key of an account in the hot table, never 0
+#define HOT_KEY(acctnum) ((1ULL << 32) | (uint32_t)(acctnum))
+
+// a lookup of an account that concurrent queries of it wait for
+struct flight_t {
+	uint64_t key; // FLIGHT_KEY of the lookup running, 0 for a free slot
+	uint64_t seq; // odd while a lookup runs
+	uint64_t result; // the account of the last lookup << 32 | its record + 1, or | 0 if not found
+};
+
+// the key of a lookup in the flight table, names the worker running it
+#define FLIGHT_KEY(acctnum) ((uint64_t)getpid() << 32 | (uint32_t)(acctnum))
+
+static int log_fd = -1; // append only, shared by every worker
+static int bloom_fd = -1; // read only, sizes the store for the filter
+static int sync_commits = 0; // flush the log before a commit returns
+static char log_path[BUFMAX/4];
+static uint64_t * log_len = NULL; // bytes in the redo log, shared
+static int checkpoint_due = 0; // a commit of this worker filled the log
+static struct bloom_t * bloom = NULL; // shared, NULL when unavailable
+static struct bloom_t * cold_bloom = NULL; // of the cold tier, NULL without one
+static uint32_t * seqs = NULL; // sequence counter of every record, shared
+static size_t nseqs = 0; // records covered by the counters
+static struct record_t * map = NULL; // this worker's mapping of the store
+static size_t map_recs = 0; // records in the mapping
+static struct hot_t * hots = NULL; // shared, HOT_SLOTS of them
+static struct flight_t * flights = NULL; // shared, FLIGHT_SLOTS of them
+static int32_t * fences = NULL; // the account of every idx.every-th sorted record
+static size_t nfences = 0;
+static struct index_hdr_t idx; // nsorted is 0 without a usable index
+static struct promos_t * promos = NULL; // shared, NULL without a cold tier
+static uint32_t * stamps = NULL; // last access of every record, shared
+static size_t nstamps = 0; // records covered by the stamps
+
+//
+// PROTOTYPES
+//
+
+static void bloom_add(struct bloom_t *, int);
+static int bloom_catch_up();
+static int bloom_init();
+static struct bloom_t * bloom_new(uint64_t);
+static int bloom_test(const struct bloom_t *, int);
+static void checkpoint();
+static uint32_t checksum(const void *, size_t);
+static int commit(int, struct log_rec_t *, const float *, int);
+static int find_coalesced(int, off_t *);
+static int find_or_promote(const int *, int, off_t *);
+static int find_records(const int *, int, off_t *);
+static int flight_wait(struct flight_t *, int, off_t *);
+static int hot_combine(int, struct hot_t *, struct record_t *);
+static int hot_record(struct hot_t *, struct record_t *);
+static struct hot_t * hot_slot(int, int);
+static int hot_update(struct hot_t *, float, struct record_t *);
+static void hot_wait(int, off_t);
+static off_t index_find(int);
+static int index_load();
+static int lock_record(int, off_t, int);
+static int map_init();
+static int map_store();
+static off_t promo_find(int);
+static void promo_add(int, off_t);
+static off_t promote(int);
+static int read_locked(int, struct log_rec_t *);
+static int read_record(off_t, struct record_t *);
+static int replay_log();
+static int scan_cold(uint32_t, struct record_t *, int, uint32_t *);
+static void stamp(off_t);
+static int tier_init();
+static int try_lock_record(int, off_t);
+static int write_record(int, struct log_rec_t *);
+
+//
+// METHODS
+//
+
+/**
+ * Empties the redo log once the records it holds are on disk. Locks
+ * every record of the store, so no commit is between its log write and
+ * its record writes, syncs the store and truncates the log. Commits
+ * wait for the checkpoint. The caller MUST NOT hold a record lock: the
+ * lock over the store would replace the caller's own, and closing its
+ * descriptor drops them.
+ */
+static void checkpoint() {
+	checkpoint_due = 0;
+	int fd = open(dbfile, O_RDWR);
+	if (fd < 0) {
+		perror("open error");
+		return;
+	}
+
+	struct flock fl;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = PROMOTE_LOCK;
+	if (fcntl(fd, F_SETLKW, &fl) < 0) {
+		perror("lock error");
+		close(fd);
+		return;
+	}
+
+	// another worker may have emptied the log while this one waited
+	uint64_t t = TRACE_START();
+	if (__atomic_load_n(log_len, __ATOMIC_RELAXED) >= LOG_CHECKPOINT_BYTES) {
+		if (fdatasync(fd) < 0 || ftruncate(log_fd, 0) < 0) {
+			perror("checkpoint error"); // the log keeps growing until the next one
+		} else {
+			__atomic_store_n(log_len, 0, __ATOMIC_RELAXED);
+			METRIC_ADD(log_checkpoints, 1);
+		}
+	}
+	TRACE_END(TRACE_LOG, t);
+
+	fl.l_type = F_UNLCK;
+	fcntl(fd, F_SETLK, &fl);
+	close(fd);
+}
+
+/**
+ * Computes the FNV-1a hash of a buffer, used to tell whole log entries
+ * from torn ones.
+ * @param buf The buffer.
+ * @param len The length of the buffer.
+ * @returns The hash.
+ */
+static uint32_t checksum(const void * buf, size_t len) {
+	const unsigned char * p = buf;
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Adds an account to a filter, safe across worker processes.
+ * @param filter The filter.
+ * @param acctnum The account.
+ */
+static void bloom_add(struct bloom_t * filter, int acctnum) {
+	uint64_t h1, h2;
+	bloom_hash(acctnum, &h1, &h2);
+	for (int i = 0; i < BLOOM_HASHES; i++) {
+		uint64_t bit = (h1 + i * h2) & (filter->nbits - 1);
+		__atomic_fetch_or(&filter->words[bit / 64], 1ULL << (bit % 64), __ATOMIC_RELAXED);
+	}
+	METRIC_ADD(bloom_keys, 1);
+}
+
+/**
+ * Tests a filter for an account.
+ * @param filter The filter.
+ * @param acctnum The account.
+ * @returns 0 if the account is not in the filter, 1 if it may be.
+ */
+static int bloom_test(const struct bloom_t * filter, int acctnum) {
+	uint64_t h1, h2;
+	bloom_hash(acctnum, &h1, &h2);
+	for (int i = 0; i < BLOOM_HASHES; i++) {
+		uint64_t bit = (h1 + i * h2) & (filter->nbits - 1);
+		if (!(__atomic_load_n(&filter->words[bit / 64], __ATOMIC_RELAXED) & (1ULL << (bit % 64)))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Adds the accounts of records appended to the store since the filter
+ * last covered it, then refreshes the false positive estimate. Records
+ * appended by workers show in the shared count, records appended by
+ * other programs, such as db write, only in the size of the store.
+ * Workers catching up at once add the same accounts twice, which is
+ * harmless.
+ * @returns 1 if accounts were added, 0 if the store did not grow, -1
+ * on error.
+ */
+static int bloom_catch_up() {
+	uint64_t covered = __atomic_load_n(&bloom->covered, __ATOMIC_ACQUIRE);
+	uint64_t size = __atomic_load_n(&bloom->appended, __ATOMIC_ACQUIRE);
+	struct stat st;
+	if (size < covered + sizeof(struct record_t)) {
+		if (fstat(bloom_fd, &st) < 0) {
+			perror("fstat error");
+			return -1;
+		}
+		size = st.st_size;
+	}
+	if (size < covered + sizeof(struct record_t)) {
+		return 0;
+	}
+
+	struct record_t buf[SCAN_RECS];
+	ssize_t bytes_read;
+	while ((bytes_read = pread(bloom_fd, buf, sizeof(buf), covered)) >= (ssize_t)sizeof(struct record_t)) {
+		int nrecs = bytes_read / sizeof(struct record_t);
+		for (int r = 0; r < nrecs; r++) {
+			bloom_add(bloom, buf[r].acctnum);
+		}
+		covered += nrecs * sizeof(struct record_t);
+	}
+	__atomic_store_n(&bloom->covered, covered, __ATOMIC_RELEASE);
+
+	// a lookup of a missing account passes when all of its bits are set
+	uint64_t set = 0;
+	for (uint64_t i = 0; i < bloom->nbits / 64; i++) {
+		set += __builtin_popcountll(__atomic_load_n(&bloom->words[i], __ATOMIC_RELAXED));
+	}
+	double fill = (double)set / bloom->nbits, fpr = 1;
+	for (int i = 0; i < BLOOM_HASHES; i++) {
+		fpr *= fill;
+	}
+	METRIC_SET(bloom_fpr_ppm, (unsigned long)(fpr * 1000000));
+	return 1;
+}
+
+/**
+ * Builds the filter over the accounts in the store, sized by
+ * bloom_bits.
+ * @returns 0 on success, -1 on error.
+ */
+static int bloom_init() {
+	// never closed, closing would drop the record locks of the worker
+	if ((bloom_fd = open(dbfile, O_RDONLY)) < 0) {
+		perror("open error");
+		return -1;
+	}
+	struct stat st;
+	if (fstat(bloom_fd, &st) < 0) {
+		perror("fstat error");
+		return -1;
+	}
+
+	if ((bloom = bloom_new(st.st_size / sizeof(struct record_t))) == NULL) {
+		return -1;
+	}
+	bloom->appended = st.st_size;
+	if (bloom_catch_up() < 0) {
+		munmap(bloom, sizeof(struct bloom_t) + bloom->nbits / 8);
+		bloom = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Maps an empty filter shared by every worker.
+ * @param nrecs The records it is sized for, see bloom_bits.
+ * @returns The filter, NULL on error.
+ */
+static struct bloom_t * bloom_new(uint64_t nrecs) {
+	uint64_t nbits = bloom_bits(nrecs);
+	size_t len = sizeof(struct bloom_t) + nbits / 8;
+	void * addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return NULL;
+	}
+
+	struct bloom_t * filter = addr;
+	filter->nbits = nbits;
+	METRIC_ADD(bloom_bytes, len);
+	return filter;
+}
+
+/**
+ * Checks if an account may be in the store. Costs a few memory loads
+ * when the filters rule it out, an fstat when the store filter rejects
+ * it, a catch up only when the store grew since the last one, and a lookup of the cold tier only
+ * when its filter lets the account through.
+ * @param acctnum The account.
+ * @returns 0 if the account is not in the store, 1 if it may be.
+ */
+int store_has(int acctnum) {
+	if (bloom == NULL) {
+		return 1;
+	}
+
+	if (!bloom_test(bloom, acctnum) && (bloom_catch_up() <= 0 || !bloom_test(bloom, acctnum))) {
+		// the filter only covers the store, the cold tier has its own
+		struct record_t record;
+		int reads = 0, cold = tier_records() > 0 && (cold_bloom == NULL || bloom_test(cold_bloom, acctnum))
+				&& tier_find(acctnum, &record, &reads) == 0;
+		METRIC_ADD(tier_block_reads, reads);
+		if (cold) {
+			return 1;
+		}
+		METRIC_ADD(bloom_rejects, 1);
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Locks or unlocks one record of the store.
+ * @param fd The store.
+ * @param offset The offset of the record.
+ * @param type F_WRLCK to lock, waiting for other holders, or F_UNLCK.
+ * @returns 0 on success, -1 on error.
+ */
+static int lock_record(int fd, off_t offset, int type) {
+	struct flock fl;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = offset;
+	fl.l_len = sizeof(struct record_t);
+	return fcntl(fd, type == F_UNLCK ? F_SETLK : F_SETLKW, &fl);
+}
+
+/**
+ * Maps the store, again once it grew. Each worker keeps its own
+ * mapping of the same file pages, so writes through any of them, or
+ * through the file, show in all of them.
+ * @returns 1 if the mapping grew, 0 if the store did not grow, -1 on
+ * error.
+ */
+static int map_store() {
+	struct stat st;
+	if (stat(dbfile, &st) < 0) {
+		perror("stat error");
+		return -1;
+	}
+
+	size_t nrecs = st.st_size / sizeof(struct record_t);
+	if (nrecs <= map_recs) {
+		return 0;
+	}
+
+	int fd = open(dbfile, O_RDWR);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	void * addr = mmap(NULL, nrecs * sizeof(struct record_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+
+	if (map != NULL) {
+		munmap(map, map_recs * sizeof(struct record_t));
+	}
+	map = addr;
+	map_recs = nrecs;
+	return 1;
+}
+
+/**
+ * Loads the index of the store, if it has one that fits it.
+ * @returns 1 if the index was loaded, 0 if there is none, -1 on error.
+ */
+static int index_load() {
+	char path[BUFMAX/4];
+	snprintf(path, sizeof(path), "%s%s", dbfile, INDEX_SUFFIX);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+
+	struct index_hdr_t hdr;
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != INDEX_MAGIC || hdr.every == 0
+			|| hdr.nsorted > map_recs) {
+		fprintf(stderr, "%s does not index %s, ignored\n", path, dbfile);
+		close(fd);
+		return 0;
+	}
+
+	size_t n = (hdr.nsorted + hdr.every - 1) / hdr.every;
+	int32_t * keys = malloc(n * sizeof(int32_t) + 1);
+	if (keys == NULL || read(fd, keys, n * sizeof(int32_t)) != (ssize_t)(n * sizeof(int32_t))) {
+		fprintf(stderr, "%s is truncated, ignored\n", path);
+		free(keys);
+		close(fd);
+		return keys == NULL ? -1 : 0;
+	}
+
+	close(fd);
+	fences = keys;
+	nfences = n;
+	idx = hdr;
+	return 1;
+}
+
+/**
+ * Finds an account in the sorted start of the store: a binary search
+ * of the index picks the run of idx.every records it would be in,
+ * a binary search of the mapping finds it in the run. Drops the index
+ * if the run does not start where the index says.
+ * @param acctnum The account.
+ * @returns The offset of its record, -1 if it is not in the sorted
+ * records.
+ */
+static off_t index_find(int acctnum) {
+	if (nfences == 0 || acctnum < fences[0]) {
+		return -1;
+	}
+
+	size_t lo = 0, hi = nfences;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (fences[mid] <= acctnum) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	size_t first = lo * idx.every;
+	if (map[first].acctnum != fences[lo]) {
+		fprintf(stderr, "index of %s is stale, scanning instead\n", dbfile);
+		nfences = 0;
+		idx.nsorted = 0;
+		return -1;
+	}
+
+	size_t last = first + idx.every < idx.nsorted ? first + idx.every : idx.nsorted;
+	while (first < last) {
+		size_t mid = first + (last - first) / 2;
+		if (map[mid].acctnum == acctnum) {
+			return mid * sizeof(struct record_t);
+		} else if (map[mid].acctnum < acctnum) {
+			first = mid + 1;
+		} else {
+			last = mid;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Creates the sequence counters, for twice the records in the store
+ * so appended records get them too, and maps the store.
+ * @returns 0 on success, -1 on error.
+ */
+static int map_init() {
+	struct stat st;
+	if (stat(dbfile, &st) < 0) {
+		perror("stat error");
+		return -1;
+	}
+
+	size_t n = 2 * (st.st_size / sizeof(struct record_t));
+	if (n < SEQ_MIN_RECS) {
+		n = SEQ_MIN_RECS;
+	}
+
+	void * addr = mmap(NULL, n * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+
+	if (map_store() < 0) {
+		munmap(addr, n * sizeof(uint32_t));
+		return -1;
+	}
+
+	seqs = addr;
+	nseqs = n;
+
+	// a missing index only costs scans
+	if (index_load() < 0) {
+		perror("malloc error");
+	}
+	return 0;
+}
+
+/**
+ * Checks if records are read from the mapping of the store.
+ * @returns 1 if they are, 0 if they are read from the file.
+ */
+int store_mapped() {
+	return seqs != NULL;
+}
+
+/**
+ * Finds the records of a set of accounts in one pass over the store.
+ * Account numbers never change, so the mapping is scanned without
+ * sequence counters.
+ * @param acctnums The accounts.
+ * @param n The number of accounts.
+ * @param offs Filled with the offset of the record of every account,
+ * -1 for the accounts not found.
+ * @returns The number of accounts found.
+ */
+static int find_records(const int * acctnums, int n, off_t * offs) {
+	int found = 0;
+	for (int i = 0; i < n; i++) {
+		offs[i] = -1;
+	}
+
+	uint64_t t = TRACE_START();
+	if (seqs != NULL) {
+		for (int i = 0; i < n && idx.nsorted > 0; i++) {
+			if ((offs[i] = index_find(acctnums[i])) >= 0) {
+				found++;
+			}
+		}
+
+		// the table holds every record after the sorted ones until it
+		//	fills up, then they are scanned for again
+		int grown = 0;
+		for (int i = 0; i < n && promos != NULL && found < n; i++) {
+			if (offs[i] < 0 && (offs[i] = promo_find(acctnums[i])) >= 0) {
+				found++;
+				grown |= offs[i] / sizeof(struct record_t) >= map_recs;
+			}
+		}
+		if (grown) {
+			map_store();
+		}
+		if (promos != NULL && !__atomic_load_n(&promos->full, __ATOMIC_ACQUIRE)) {
+			TRACE_END(TRACE_SCAN, t);
+			return found;
+		}
+
+		// scan the records after the sorted ones, going on into the
+		//	records appended since the last mapping
+		size_t r = idx.nsorted;
+		do {
+			// most lookups are of a single account, compared alone
+			for (; n == 1 && r < map_recs && map[r].acctnum != acctnums[0]; r++);
+			for (; r < map_recs && found < n; r++) {
+				for (int i = 0; i < n; i++) {
+					if (offs[i] < 0 && map[r].acctnum == acctnums[i]) {
+						offs[i] = r * sizeof(struct record_t);
+						found++;
+					}
+				}
+			}
+		} while (found < n && map_store() > 0);
+		TRACE_END(TRACE_SCAN, t);
+		return found;
+	}
+
+	int fd = open(dbfile, O_RDONLY);
+	if (fd < 0) {
+		perror("open error");
+		return 0;
+	}
+
+	struct record_t buf[SCAN_RECS];
+	off_t off = 0;
+	ssize_t bytes_read;
+	while (found < n && (bytes_read = pread(fd, buf, sizeof(buf), off)) > 0) {
+		int nrecs = bytes_read / sizeof(struct record_t);
+		for (int r = 0; r < nrecs; r++) {
+			for (int i = 0; i < n; i++) {
+				if (offs[i] < 0 && buf[r].acctnum == acctnums[i]) {
+					offs[i] = off + r * sizeof(struct record_t);
+					found++;
+				}
+			}
+		}
+		off += bytes_read;
+	}
+	close(fd);
+	TRACE_END(TRACE_SCAN, t);
+	return found;
+}
+
+/**
+ * Finds the slot of a promoted record.
+ * @param acctnum The account.
+ * @returns The offset of its record, -1 if it has none.
+ */
+static off_t promo_find(int acctnum) {
+	uint64_t key = HOT_KEY(acctnum);
+	uint32_t h = (uint32_t)acctnum * 0x9e3779b1;
+	for (int i = 0; i < PROMO_PROBES; i++) {
+		struct promo_t * promo = &promos->slots[(h + i) & (promos->nslots - 1)];
+		uint64_t found = __atomic_load_n(&promo->key, __ATOMIC_ACQUIRE);
+		if (found == key) {
+			return promo->offset;
+		} else if (found == 0) {
+			break;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Adds a record after the sorted ones to the table of promoted
+ * records, marking the table full if it has no room. The caller MUST
+ * hold the promotion lock, or be the only process.
+ * @param acctnum The account.
+ * @param offset The offset of its record.
+ */
+static void promo_add(int acctnum, off_t offset) {
+	uint32_t h = (uint32_t)acctnum * 0x9e3779b1;
+	for (int i = 0; i < PROMO_PROBES; i++) {
+		struct promo_t * promo = &promos->slots[(h + i) & (promos->nslots - 1)];
+		if (__atomic_load_n(&promo->key, __ATOMIC_RELAXED) == 0) {
+			promo->offset = offset;
+			__atomic_store_n(&promo->key, HOT_KEY(acctnum), __ATOMIC_RELEASE);
+			return;
+		}
+	}
+
+	if (!__atomic_exchange_n(&promos->full, 1, __ATOMIC_RELEASE)) {
+		fprintf(stderr, "promoted records of %s are scanned for, reload it with dbload -Z\n", dbfile);
+	}
+}
+
+/**
+ * Promotes an account from the cold tier: appends its record to the
+ * store under the promotion lock, unless another worker promoted it
+ * first. The caller MUST NOT hold a record lock, the promotion opens
+ * and closes the store.
+ * @param acctnum The account.
+ * @returns The offset of its record in the store, -1 if it is not in
+ * the cold tier or on error.
+ */
+static off_t promote(int acctnum) {
+	struct record_t record;
+	int reads = 0;
+	int rval = tier_find(acctnum, &record, &reads);
+	METRIC_ADD(tier_block_reads, reads);
+	if (rval < 0) {
+		return -1;
+	}
+
+	int fd = open(dbfile, O_RDWR);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+	if (lock_record(fd, PROMOTE_LOCK, F_WRLCK) < 0) {
+		perror("lock error");
+		close(fd);
+		return -1;
+	}
+
+	// without a table that has every record after the sorted ones,
+	//	they are read again through this descriptor: closing another
+	//	one would drop the lock
+	off_t offset = promos != NULL ? promo_find(acctnum) : -1;
+	struct record_t buf[SCAN_RECS];
+	ssize_t bytes_read;
+	for (off_t off = idx.nsorted * sizeof(struct record_t); offset < 0 && (promos == NULL || promos->full)
+			&& (bytes_read = pread(fd, buf, sizeof(buf), off)) >= (ssize_t)sizeof(struct record_t);
+			off += bytes_read / sizeof(struct record_t) * sizeof(struct record_t)) {
+		for (int r = 0; r < bytes_read / (ssize_t)sizeof(struct record_t); r++) {
+			if (buf[r].acctnum == acctnum) {
+				offset = off + r * sizeof(struct record_t);
+				break;
+			}
+		}
+	}
+
+	struct stat st;
+	if (offset < 0 && fstat(fd, &st) == 0) {
+		offset = st.st_size / sizeof(struct record_t) * sizeof(struct record_t);
+		if (pwrite(fd, &record, sizeof(record), offset) != sizeof(record)) {
+			perror("write error");
+			offset = -1;
+		} else {
+			if (promos != NULL) {
+				promo_add(acctnum, offset);
+			}
+			if (bloom != NULL) {
+				bloom_add(bloom, acctnum);
+				__atomic_store_n(&bloom->appended, offset + sizeof(record), __ATOMIC_RELEASE);
+			}
+			METRIC_ADD(tier_promotions, 1);
+		}
+	}
+
+	lock_record(fd, PROMOTE_LOCK, F_UNLCK);
+	close(fd);
+	return offset;
+}
+
+/**
+ * Stamps a record with the time it was served.
+ * @param offset The offset of the record.
+ */
+static void stamp(off_t offset) {
+	size_t r = offset / sizeof(struct record_t);
+	uint32_t now = time(NULL);
+	if (stamps != NULL && r < nstamps && __atomic_load_n(&stamps[r], __ATOMIC_RELAXED) != now) {
+		__atomic_store_n(&stamps[r], now, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Finds the records of a set of accounts like find_records, promoting
+ * the accounts found in the cold tier, and stamps them.
+ * @param acctnums The accounts.
+ * @param n The number of accounts.
+ * @param offs Filled with the offset of the record of every account,
+ * -1 for the accounts not found.
+ * @returns The number of accounts found.
+ */
+static int find_or_promote(const int * acctnums, int n, off_t * offs) {
+	int found = find_records(acctnums, n, offs);
+	for (int i = 0; i < n && found < n && tier_records() > 0; i++) {
+		if (offs[i] < 0 && (offs[i] = promote(acctnums[i])) >= 0) {
+			found++;
+		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (offs[i] >= 0) {
+			stamp(offs[i]);
+		}
+	}
+	return found;
+}
+
+/**
+ * Waits for the lookup of an account another query is running and
+ * takes its result. Offsets of accounts never change, so the result of
+ * any lookup of the account will do, and a waiter is done once the
+ * lookup that ran when it came has ended, even if the next has begun.
+ * Takes over the slot of a worker that died looking up.
+ * @param flight The slot of the lookup.
+ * @param acctnum The account.
+ * @param offset Set to the offset of its record, -1 if not found.
+ * @returns 1 if found, 0 if not found, -1 if the slot moved on to
+ * another account and the caller has to look up on its own.
+ */
+static int flight_wait(struct flight_t * flight, int acctnum, off_t * offset) {
+	uint64_t seq = __atomic_load_n(&flight->seq, __ATOMIC_ACQUIRE);
+	uint64_t done = seq + (seq & 1 ? 1 : 2); // or the claimed one ends
+	for (int spins = 0; seq < done; spins++) {
+		uint64_t key = __atomic_load_n(&flight->key, __ATOMIC_ACQUIRE);
+		if (!(seq & 1) && (key == 0 || (uint32_t)key != (uint32_t)acctnum)) {
+			break; // it ended before this worker looked
+		} else if (spins < FLIGHT_SPINS) {
+			sched_yield();
+		} else if (key != 0 && kill(key >> 32, 0) < 0 && errno == ESRCH) {
+			if (!(seq & 1) || __atomic_compare_exchange_n(&flight->seq, &seq, seq + 1, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+				__atomic_compare_exchange_n(&flight->key, &key, 0, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+			}
+			return -1;
+		} else {
+			usleep(FLIGHT_NAP_US);
+		}
+		seq = __atomic_load_n(&flight->seq, __ATOMIC_ACQUIRE);
+	}
+
+	uint64_t result = __atomic_load_n(&flight->result, __ATOMIC_ACQUIRE);
+	if ((uint32_t)(result >> 32) != (uint32_t)acctnum) {
+		return -1;
+	}
+
+	METRIC_ADD(coalesce_merged, 1);
+	uint32_t rec = (uint32_t)result;
+	*offset = rec == 0 ? -1 : (off_t)(rec - 1) * (off_t)sizeof(struct record_t);
+	if (*offset >= 0) {
+		stamp(*offset);
+	}
+	return *offset >= 0;
+}
+
+/**
+ * Finds the record of a queried account like find_or_promote, sharing
+ * the lookup with the concurrent queries of the account: the first
+ * runs it in a slot of the flight table, the rest wait for its result.
+ * An account found through the index is not worth a slot, nor one
+ * whose slot is taken by another account.
+ * @param acctnum The account.
+ * @param offset Set to the offset of its record, -1 if not found.
+ * @returns 1 if found, 0 if not found.
+ */
+static int find_coalesced(int acctnum, off_t * offset) {
+	if (seqs != NULL && idx.nsorted > 0 && (*offset = index_find(acctnum)) >= 0) {
+		stamp(*offset);
+		return 1;
+	}
+
+	struct flight_t * flight = NULL;
+	uint32_t h = (uint32_t)acctnum * 0x9e3779b1;
+	for (int i = 0; i < FLIGHT_PROBES && flights != NULL && flight == NULL; i++) {
+		struct flight_t * slot = &flights[(h + i) % FLIGHT_SLOTS];
+		uint64_t key = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+		if (key != 0 && (uint32_t)key == (uint32_t)acctnum) {
+			int rval = flight_wait(slot, acctnum, offset);
+			if (rval >= 0) {
+				return rval;
+			}
+			break;
+		} else if (key == 0 && __atomic_compare_exchange_n(&slot->key, &key, FLIGHT_KEY(acctnum), 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			flight = slot;
+		}
+	}
+
+	if (flight != NULL) {
+		__atomic_fetch_add(&flight->seq, 1, __ATOMIC_ACQ_REL);
+	}
+	int found = find_or_promote(&acctnum, 1, offset);
+	if (flight == NULL) {
+		return found;
+	}
+
+	METRIC_ADD(coalesce_lookups, 1);
+	uint32_t rec = *offset < 0 ? 0 : (uint32_t)(*offset / (off_t)sizeof(struct record_t) + 1);
+	uint64_t result = (uint64_t)(uint32_t)acctnum << 32 | rec;
+	__atomic_store_n(&flight->result, result, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&flight->seq, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&flight->key, 0, __ATOMIC_RELEASE);
+	return found;
+}
+
+/**
+ * Opens the cold tier of the store, if it has one, maps the stamps of
+ * the records and creates the table of promoted records, with room for
+ * as many as the store holds, PROMO_MIN_RECS at least. Records after
+ * the sorted ones go into the table. MUST be called after map_init.
+ * @returns 1 if the store has a cold tier, 0 if it has none, -1 on
+ * error.
+ */
+static int tier_init() {
+	size_t bytes;
+	int rval = tier_open(dbfile, &bytes);
+	if (rval <= 0) {
+		return rval;
+	}
+	METRIC_SET(tier_cold_records, tier_records());
+	METRIC_SET(tier_cold_bytes, bytes);
+
+	// without its filter every miss of the store looks in the cold tier
+	if (bloom != NULL && (cold_bloom = bloom_new(tier_records())) != NULL) {
+		struct record_t buf[SCAN_RECS];
+		int n, reads = 0;
+		for (size_t pos = 0; (n = tier_read(pos, buf, SCAN_RECS, &reads)) > 0; pos += n) {
+			for (int r = 0; r < n; r++) {
+				bloom_add(cold_bloom, buf[r].acctnum);
+			}
+		}
+		METRIC_ADD(tier_block_reads, reads);
+		if (n < 0) {
+			munmap(cold_bloom, sizeof(struct bloom_t) + cold_bloom->nbits / 8);
+			cold_bloom = NULL;
+		}
+	}
+
+	// records appended beyond the stamps count as used at a reload
+	char path[BUFMAX/4];
+	snprintf(path, sizeof(path), "%s%s", dbfile, STAMP_SUFFIX);
+	struct stat st;
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || fstat(fd, &st) < 0
+			|| ((size_t)st.st_size < nseqs * sizeof(uint32_t) && ftruncate(fd, nseqs * sizeof(uint32_t)) < 0)) {
+		perror("stamp file error");
+	} else if (nseqs > 0) {
+		void * addr = mmap(NULL, nseqs * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			perror("mmap error");
+		} else {
+			stamps = addr;
+			nstamps = nseqs;
+			uint32_t now = time(NULL);
+			for (size_t r = st.st_size / sizeof(uint32_t); r < map_recs && r < nstamps; r++) {
+				stamps[r] = now;
+			}
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	// without the mapping lookups scan the whole store anyway
+	if (seqs == NULL) {
+		return 1;
+	}
+
+	size_t nslots = 1;
+	while (nslots < 2 * (map_recs > PROMO_MIN_RECS ? map_recs : PROMO_MIN_RECS)) {
+		nslots *= 2;
+	}
+	size_t len = sizeof(struct promos_t) + nslots * sizeof(struct promo_t);
+	void * addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return 1;
+	}
+
+	promos = addr;
+	promos->nslots = nslots;
+	for (size_t r = idx.nsorted; r < map_recs; r++) {
+		promo_add(map[r].acctnum, r * sizeof(struct record_t));
+	}
+	return 1;
+}
+
+/**
+ * Reads a record without its lock. Tries again while a writer is
+ * changing it, then takes the lock instead, so a reader neither
+ * starves behind a stream of writers nor spins on a writer that died
+ * mid-write.
+ * @param offset The offset of the record.
+ * @param record The structure to read the record into.
+ * @returns 0 on success, -1 on error.
+ */
+static int read_record(off_t offset, struct record_t * record) {
+	size_t r = offset / sizeof(struct record_t);
+	if (seqs != NULL && r < nseqs && r < map_recs) {
+		for (int tries = 0; tries < SEQ_MAX_RETRIES; tries++) {
+			uint32_t seq = __atomic_load_n(&seqs[r], __ATOMIC_ACQUIRE);
+			if (!(seq & 1)) {
+				memcpy(record, &map[r], sizeof(struct record_t));
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				if (__atomic_load_n(&seqs[r], __ATOMIC_RELAXED) == seq) {
+					return 0;
+				}
+			}
+			METRIC_ADD(read_retries, 1);
+		}
+	}
+
+	METRIC_ADD(locked_reads, 1);
+	int fd = open(dbfile, O_RDONLY);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	if (lock_record(fd, offset, F_RDLCK) < 0) {
+		perror("lock error");
+		close(fd);
+		return -1;
+	}
+
+	ssize_t bytes_read = pread(fd, record, sizeof(struct record_t), offset);
+
+	// no writer holds the record, an odd counter is left by a dead one
+	if (seqs != NULL && r < nseqs) {
+		uint32_t seq = __atomic_load_n(&seqs[r], __ATOMIC_RELAXED);
+		if (seq & 1) {
+			__atomic_compare_exchange_n(&seqs[r], &seq, seq + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+		}
+	}
+
+	lock_record(fd, offset, F_UNLCK);
+	close(fd);
+	return bytes_read == sizeof(struct record_t) ? 0 : -1;
+}
+
+/**
+ * Writes a record back, through the mapping when it covers the record.
+ * The sequence counter of the record stays odd until the write is
+ * done. The caller MUST hold the record lock.
+ * @param fd The store, opened for writing.
+ * @param rec The record and its offset.
+ * @returns 0 on success, -1 on error.
+ */
+static int write_record(int fd, struct log_rec_t * rec) {
+	size_t r = rec->offset / sizeof(struct record_t);
+	uint32_t seq = 0;
+	if (seqs != NULL && r < nseqs) {
+		// odd, and moved even if a dead writer left it odd
+		seq = (__atomic_load_n(&seqs[r], __ATOMIC_RELAXED) + 1) | 1;
+		__atomic_store_n(&seqs[r], seq, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
+
+	int rval = 0;
+	if (seqs != NULL && r < map_recs) {
+		memcpy(&map[r], &rec->record, sizeof(struct record_t));
+	} else if (pwrite(fd, &rec->record, sizeof(struct record_t), rec->offset) < 0) {
+		rval = -1;
+	}
+
+	if (seq != 0) {
+		__atomic_store_n(&seqs[r], seq + 1, __ATOMIC_RELEASE);
+	}
+	if (rval == 0) {
+		compact_update(rec->record.acctnum, rec->record.value);
+	}
+	return rval;
+}
+
+/**
+ * Reads a record the caller holds the lock of, no writer can change it
+ * meanwhile.
+ * @param fd The store.
+ * @param rec The offset of the record, and where to read it to.
+ * @returns 0 on success, -1 on error.
+ */
+static int read_locked(int fd, struct log_rec_t * rec) {
+	size_t r = rec->offset / sizeof(struct record_t);
+	if (seqs != NULL && r < map_recs) {
+		rec->record = map[r];
+		return 0;
+	}
+	return pread(fd, &rec->record, sizeof(struct record_t), rec->offset) == sizeof(struct record_t) ? 0 : -1;
+}
+
+/**
+ * Commits new record values with one log write, then writes them
+ * back and appends the changes to the ledger. The caller MUST hold
+ * the locks of the records.
+ * @param fd The store, opened for writing.
+ * @param recs The records and their offsets.
+ * @param deltas The change of every record, NULL if the caller appends
+ * the changes to the ledger itself.
+ * @param count The number of records, at most TXN_MAXOPS.
+ * @returns 0 on success, STORE_EIO on error.
+ */
+static int commit(int fd, struct log_rec_t * recs, const float * deltas, int count) {
+	struct log_hdr_t hdr;
+	char entry[sizeof(struct log_hdr_t) + TXN_MAXOPS * sizeof(struct log_rec_t)];
+	size_t len = count * sizeof(struct log_rec_t);
+
+	hdr.magic = LOG_MAGIC;
+	hdr.count = count;
+	hdr.checksum = checksum(recs, len);
+	memcpy(entry, &hdr, sizeof(hdr));
+	memcpy(entry + sizeof(hdr), recs, len);
+
+	int rval = 0;
+	uint64_t t = TRACE_START();
+	if (write(log_fd, entry, sizeof(hdr) + len) != (ssize_t)(sizeof(hdr) + len)
+			|| (sync_commits && fdatasync(log_fd) < 0)) {
+		perror("log error");
+		rval = STORE_EIO;
+	} else if (log_len != NULL
+			&& __atomic_add_fetch(log_len, sizeof(hdr) + len, __ATOMIC_RELAXED) >= LOG_CHECKPOINT_BYTES) {
+		checkpoint_due = 1;
+	}
+	TRACE_END(TRACE_LOG, t);
+	METRIC_ADD(log_bytes, sizeof(hdr) + len);
+
+	t = TRACE_START();
+	for (int i = 0; i < count && rval == 0; i++) {
+		if (write_record(fd, &recs[i]) < 0) {
+			perror("write error"); // the log replay repairs it
+			rval = STORE_EIO;
+		}
+	}
+	TRACE_END(TRACE_WRITE, t);
+
+	// a change the ledger misses is counted, not failed
+	for (int i = 0; i < count && rval == 0 && deltas != NULL; i++) {
+		ledger_append(recs[i].record.acctnum, deltas[i], recs[i].record.value);
+	}
+	return rval;
+}
+
+/**
+ * Finds the hot table slot of an account.
+ * @param acctnum The account.
+ * @param claim Claim a free slot if the account has none.
+ * @returns The slot, NULL if the account has none.
+ */
+static struct hot_t * hot_slot(int acctnum, int claim) {
+	if (hots == NULL) {
+		return NULL;
+	}
+
+	uint64_t key = HOT_KEY(acctnum);
+	uint32_t h = (uint32_t)acctnum * 0x9e3779b1;
+	for (int i = 0; i < HOT_PROBES; i++) {
+		struct hot_t * hot = &hots[(h + i) % HOT_SLOTS];
+		uint64_t found = __atomic_load_n(&hot->key, __ATOMIC_ACQUIRE);
+		if (found == key) {
+			return hot;
+		} else if (found == 0 && claim) {
+			if (__atomic_compare_exchange_n(&hot->key, &found, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+					|| found == key) {
+				return hot;
+			}
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Notes an update that has to wait for the lock of its record, and
+ * starts combining the updates of the account once that happens often.
+ * Slots are never given back, an account that is hot once stays hot
+ * until the server restarts.
+ * @param acctnum The account.
+ * @param offset The offset of its record.
+ */
+static void hot_wait(int acctnum, off_t offset) {
+	struct hot_t * hot = hot_slot(acctnum, 1);
+	if (hot == NULL) {
+		return;
+	}
+
+	if (__atomic_add_fetch(&hot->waits, 1, __ATOMIC_RELAXED) == HOT_THRESHOLD) {
+		__atomic_store_n(&hot->offset, offset, __ATOMIC_RELAXED);
+		__atomic_store_n(&hot->hot, 1, __ATOMIC_RELEASE);
+		METRIC_ADD(hot_accounts, 1);
+	}
+}
+
+/**
+ * Commits the pending changes of a hot account as the next round. The
+ * caller MUST hold the record lock, rounds only advance under it, so
+ * every stripe is waiting on this round. The change of every stripe is
+ * its own ledger entry, with the balance after it. The committed record
+ * is kept in the slot for the workers whose changes the round carried.
+ * @param fd The store, opened for writing.
+ * @param hot The account.
+ * @param record The structure to write the committed record back to,
+ * may be NULL.
+ * @returns 0 on success, a STORE_ error code on error.
+ */
+static int hot_combine(int fd, struct hot_t * hot, struct record_t * record) {
+	uint64_t round = __atomic_load_n(&hot->round, __ATOMIC_RELAXED) + 1;
+	float deltas[HOT_STRIPES], balances[HOT_STRIPES];
+	for (int s = 0; s < HOT_STRIPES; s++) {
+		uint64_t pending = __atomic_exchange_n(&hot->pending[s], round << 32, __ATOMIC_ACQ_REL);
+		uint32_t bits = (uint32_t)pending;
+		memcpy(&deltas[s], &bits, sizeof(deltas[s]));
+	}
+
+	struct log_rec_t rec;
+	rec.offset = hot->offset;
+	int rval = read_locked(fd, &rec) < 0 ? STORE_EIO : 0;
+	if (rval == 0) {
+		for (int s = 0; s < HOT_STRIPES; s++) {
+			rec.record.value += deltas[s];
+			balances[s] = rec.record.value;
+		}
+		rval = commit(fd, &rec, NULL, 1);
+	}
+
+	// a change the ledger misses is counted, not failed
+	for (int s = 0; s < HOT_STRIPES && rval == 0; s++) {
+		if (deltas[s] != 0) {
+			ledger_append(rec.record.acctnum, deltas[s], balances[s]);
+		}
+	}
+
+	if (rval == 0) {
+		// odd, and moved even if a dead combiner left it odd
+		uint32_t seq = (__atomic_load_n(&hot->rseq, __ATOMIC_RELAXED) + 1) | 1;
+		__atomic_store_n(&hot->rseq, seq, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy(&hot->record, &rec.record, sizeof(struct record_t));
+		__atomic_store_n(&hot->rseq, seq + 1, __ATOMIC_RELEASE);
+		if (record != NULL) {
+			*record = rec.record;
+		}
+	}
+
+	if (rval != 0) {
+		__atomic_store_n(&hot->failed, round, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&hot->round, round, __ATOMIC_RELEASE);
+	METRIC_ADD(hot_rounds, 1);
+	return rval;
+}
+
+/**
+ * Reads the record the last round of a hot account committed, at least
+ * as new as the round the caller waited for.
+ * @param hot The account.
+ * @param record The structure to write the record to.
+ * @returns 0 on success, -1 if a round kept copying meanwhile.
+ */
+static int hot_record(struct hot_t * hot, struct record_t * record) {
+	for (int tries = 0; tries < SEQ_MAX_RETRIES; tries++) {
+		uint32_t seq = __atomic_load_n(&hot->rseq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1)) {
+			memcpy(record, &hot->record, sizeof(struct record_t));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&hot->rseq, __ATOMIC_RELAXED) == seq) {
+				return 0;
+			}
+		}
+		sched_yield();
+	}
+	return -1;
+}
+
+/**
+ * Updates a hot account. Adds the change to the stripe of this worker,
+ * then either finds it committed by the round of another worker or
+ * becomes the combiner of the account, yields once so the workers with
+ * a change ready add it to the round, takes the record lock and
+ * commits the round. Only the combiner takes the lock; the others
+ * yield until a round carries their change, after HOT_SPINS of them
+ * wait on the lock, which also gets past a combiner that died. A worker
+ * whose change a round of another worker carried gets the record that
+ * round committed.
+ * @param hot The account.
+ * @param value The change.
+ * @param record The structure to write the updated record back to,
+ * may be NULL.
+ * @returns 0 on success, a STORE_ error code on error.
+ */
+static int hot_update(struct hot_t * hot, float value, struct record_t * record) {
+	int fd = open(dbfile, O_RDWR);
+	if (fd < 0) {
+		perror("open error");
+		return STORE_EIO;
+	}
+
+	uint64_t * stripe = &hot->pending[getpid() % HOT_STRIPES];
+	uint64_t pending = __atomic_load_n(stripe, __ATOMIC_RELAXED), sum;
+	do {
+		uint32_t bits = (uint32_t)pending;
+		float delta;
+		memcpy(&delta, &bits, sizeof(delta));
+		delta += value;
+		memcpy(&bits, &delta, sizeof(bits));
+		sum = (pending & ~0xffffffffULL) | bits;
+	} while (!__atomic_compare_exchange_n(stripe, &pending, sum, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+	uint64_t round = (pending >> 32) + 1; // the round that commits the change
+	METRIC_ADD(hot_updates, 1);
+
+	int combined = 1, rval = 0;
+	pid_t self = getpid();
+	uint64_t t = TRACE_START();
+	for (int spins = 0; __atomic_load_n(&hot->round, __ATOMIC_ACQUIRE) < round; spins++) {
+		pid_t holder = 0;
+		int combiner = __atomic_compare_exchange_n(&hot->combiner, &holder, self, 0,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+		if (combiner) {
+			sched_yield(); // the round carries whatever the others add meanwhile
+		}
+
+		if (combiner || spins >= HOT_SPINS) {
+			if (lock_record(fd, hot->offset, F_WRLCK) < 0) {
+				perror("lock error");
+				combined = 0;
+				rval = STORE_EIO;
+			} else {
+				// a round may have carried the change while this worker waited
+				if (__atomic_load_n(&hot->round, __ATOMIC_ACQUIRE) < round) {
+					TRACE_END(TRACE_LOCK, t);
+					combined = 0;
+					rval = hot_combine(fd, hot, record);
+				}
+				lock_record(fd, hot->offset, F_UNLCK);
+			}
+
+			if (combiner) {
+				__atomic_store_n(&hot->combiner, 0, __ATOMIC_RELEASE);
+			} else if (kill(holder, 0) < 0 && errno == ESRCH) {
+				__atomic_compare_exchange_n(&hot->combiner, &holder, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+			}
+			break;
+		}
+		sched_yield();
+	}
+	close(fd);
+	if (checkpoint_due) {
+		checkpoint();
+	}
+
+	if (combined) {
+		TRACE_END(TRACE_LOCK, t);
+		METRIC_ADD(hot_combined, 1);
+		if (__atomic_load_n(&hot->failed, __ATOMIC_RELAXED) == round) {
+			rval = STORE_EIO;
+		}
+	}
+
+	// the record of a later round is as good, it carries the change too
+	if (combined && rval == 0 && record != NULL && hot_record(hot, record) < 0
+			&& read_record(hot->offset, record) < 0) {
+		rval = STORE_EIO;
+	}
+	return rval;
+}
+
+/**
+ * Locks one record of the store for writing if no one else holds it.
+ * @param fd The store.
+ * @param offset The offset of the record.
+ * @returns 0 if locked, -1 if held elsewhere or on error.
+ */
+static int try_lock_record(int fd, off_t offset) {
+	struct flock fl;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = offset;
+	fl.l_len = sizeof(struct record_t);
+	return fcntl(fd, F_SETLK, &fl);
+}
+
+/**
+ * Replays the whole entries of the redo log into the store. Entries
+ * hold new record values, so replaying one that was already applied
+ * is harmless. Stops at the first torn entry.
+ * @returns The number of entries replayed, -1 on error.
+ */
+static int replay_log() {
+	int lfd = open(log_path, O_RDONLY);
+	if (lfd < 0) {
+		return 0; // no log yet
+	}
+
+	int fd = open(dbfile, O_RDWR);
+	if (fd < 0) {
+		perror("open error");
+		close(lfd);
+		return -1;
+	}
+
+	int entries = 0;
+	struct log_hdr_t hdr;
+	struct log_rec_t recs[TXN_MAXOPS];
+	while (read(lfd, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+		size_t len = hdr.count * sizeof(struct log_rec_t);
+		if (hdr.magic != LOG_MAGIC || hdr.count > TXN_MAXOPS
+				|| read(lfd, recs, len) != (ssize_t)len || checksum(recs, len) != hdr.checksum) {
+			break;
+		}
+
+		for (uint32_t i = 0; i < hdr.count; i++) {
+			if (pwrite(fd, &recs[i].record, sizeof(struct record_t), recs[i].offset) < 0) {
+				perror("write error");
+				close(fd);
+				close(lfd);
+				return -1;
+			}
+		}
+		entries++;
+	}
+
+	fsync(fd);
+	close(fd);
+	close(lfd);
+	return entries;
+}
+
+/**
+ * Opens the store for changes. Replays the redo log left by the last
+ * run, then starts a fresh one, emptied by a checkpoint whenever it
+ * reaches LOG_CHECKPOINT_BYTES. MUST be called before the server
+ * forks.
+ * @param sync Flush the log to disk before each commit returns.
+ * @param compact Build the compact image of the store.
+ * @returns 0 on success, -1 on error.
+ */
+int store_init(int sync, int compact) {
+	snprintf(log_path, sizeof(log_path), "%s%s", dbfile, LOG_SUFFIX);
+	sync_commits = sync;
+
+	int entries;
+	if ((entries = replay_log()) < 0) {
+		return -1;
+	} else if (entries > 0) {
+		printf("Replayed %d log entries into %s\n", entries, dbfile);
+	}
+
+	// the store now holds everything logged, start over
+	if ((log_fd = open(log_path, O_WRONLY | O_APPEND | O_CREAT | O_TRUNC, 0644)) < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	// without the count the log is only emptied at the next startup
+	void * addr = mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+	} else {
+		log_len = addr;
+	}
+
+	// lookups still work without the filter, only slower
+	if (bloom_init() < 0) {
+		fprintf(stderr, "account filter unavailable\n");
+	}
+
+	// without the mapping records are read from the file under their lock
+	if (map_init() < 0) {
+		fprintf(stderr, "store mapping unavailable\n");
+	}
+
+	// changes still commit without the ledger, they are only not kept
+	if (ledger_init(dbfile) < 0) {
+		fprintf(stderr, "ledger unavailable\n");
+	}
+
+	// the cold accounts could not be told from missing ones without it
+	int tiered = tier_init();
+	if (tiered < 0) {
+		fprintf(stderr, "cold tier of %s unavailable\n", dbfile);
+		return -1;
+	}
+
+	// queries are answered from the store without the image, which
+	//	would not see the accounts of the cold tier
+	struct compact_stats_t stats;
+	if (compact && tiered) {
+		fprintf(stderr, "compact image not built, %s has a cold tier\n", dbfile);
+	} else if (compact && compact_build(dbfile, &stats) < 0) {
+		fprintf(stderr, "compact image unavailable\n");
+	} else if (compact) {
+		METRIC_SET(compact_accounts, stats.accounts);
+		METRIC_SET(compact_names, stats.names);
+		METRIC_SET(compact_bytes, stats.bytes);
+	}
+
+	// without the table every update takes the record lock
+	addr = mmap(NULL, HOT_SLOTS * sizeof(struct hot_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+	} else {
+		hots = addr;
+	}
+
+	// without the table every query runs its own lookup
+	addr = mmap(NULL, FLIGHT_SLOTS * sizeof(struct flight_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+	} else {
+		flights = addr;
+	}
+
+	return 0;
+}
+
+/**
+ * Queries a record in the database.
+ * @param query The structure containing query information.
+ * @param record The structure to write the record back to.
+ * @returns 0 on success, -1 on error.
+ */
+int query_record(struct query_t query, struct record_t * record) {
+	off_t offset;
+
+	if (!store_has(query.acctnum)) {
+		return -1;
+	}
+	sketch_note(query.acctnum, 0);
+
+	if (compact_query(query.acctnum, record) == 0) {
+		METRIC_ADD(compact_hits, 1);
+		return 0;
+	}
+
+	if (find_coalesced(query.acctnum, &offset) == 0) {
+		METRIC_ADD(bloom_false_pos, bloom != NULL);
+		return -1;
+	}
+
+	return read_record(offset, record);
+}
+
+/**
+ * Reads records of the cold tier for store_scan. Accounts promoted to
+ * the store are left out, the scan reads their record in the store.
+ * @param cursor The position of the first record in the cold tier.
+ * @param records The buffer to read the records into.
+ * @param max The most records to read.
+ * @param next Set to the position after the batch.
+ * @returns The number of records read, -1 on error.
+ */
+static int scan_cold(uint32_t cursor, struct record_t * records, int max, uint32_t * next) {
+	int reads = 0, n = tier_read(cursor, records, max, &reads), kept = 0;
+	METRIC_ADD(tier_block_reads, reads);
+	if (n < 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		off_t offset;
+		if ((bloom == NULL || bloom_test(bloom, records[i].acctnum)) && find_records(&records[i].acctnum, 1, &offset) > 0) {
+			continue;
+		}
+		records[kept++] = records[i];
+	}
+
+	*next = cursor + n;
+	METRIC_ADD(scan_records, kept);
+	return kept;
+}
+
+/**
+ * Reads a batch of records in file order, the records of the cold
+ * tier first. A batch that moves a scan into a new SCAN_WINDOW asks the
+ * kernel to read the window after it, so the reader finds the pages
+ * already in. Records of the mapping are read lock free like queries,
+ * the file is read under a record lock over the batch.
+ * @param cursor The position of the first record.
+ * @param records The buffer to read the records into.
+ * @param max The most records to read.
+ * @param next Set to the position after the batch, SCAN_END once the
+ * batch reaches the end of the store.
+ * @returns The number of records read, -1 on error.
+ */
+int store_scan(uint32_t cursor, struct record_t * records, int max, uint32_t * next) {
+	size_t nrecs, n = 0, ncold = tier_records();
+	int fd = -1;
+
+	// the cold tier comes first, its records never move; a batch that
+	//	reaches its end goes on into the store
+	if (cursor < ncold) {
+		int span = ncold - cursor < (size_t)max ? ncold - cursor : (size_t)max;
+		int kept = scan_cold(cursor, records, span, next), more = 0;
+		if (kept >= 0 && span < max) {
+			more = store_scan(ncold, records + kept, max - span, next);
+		} else {
+			METRIC_ADD(scan_batches, 1);
+		}
+		return kept < 0 || more < 0 ? -1 : kept + more;
+	}
+	cursor -= ncold;
+
+	if (seqs != NULL) {
+		// go on into records appended since the last mapping
+		if (cursor + (size_t)max > map_recs && map_store() < 0) {
+			return -1;
+		}
+		nrecs = map_recs;
+
+		for (; n < (size_t)max && cursor + n < nrecs; n++) {
+			if (read_record((cursor + n) * sizeof(struct record_t), &records[n]) < 0) {
+				return -1;
+			}
+		}
+	} else {
+		struct stat st;
+		if ((fd = open(dbfile, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+			perror("open error");
+			if (fd >= 0) {
+				close(fd);
+			}
+			return -1;
+		}
+		nrecs = st.st_size / sizeof(struct record_t);
+		n = cursor < nrecs ? nrecs - cursor : 0;
+		n = n < (size_t)max ? n : (size_t)max;
+
+		struct flock fl;
+		memset(&fl, 0, sizeof(fl));
+		fl.l_type = F_RDLCK;
+		fl.l_whence = SEEK_SET;
+		fl.l_start = (off_t)cursor * sizeof(struct record_t);
+		fl.l_len = n * sizeof(struct record_t);
+		if (n > 0 && (fcntl(fd, F_SETLKW, &fl) < 0 || pread(fd, records, fl.l_len, fl.l_start) != fl.l_len)) {
+			perror("read error");
+			close(fd);
+			return -1;
+		}
+	}
+
+	// read the next window ahead once the batch enters a window
+	size_t ahead = (cursor + n - 1) / SCAN_WINDOW + 1;
+	if (n > 0 && ahead * SCAN_WINDOW < nrecs
+			&& (cursor % SCAN_WINDOW == 0 || cursor / SCAN_WINDOW < ahead - 1)) {
+		size_t len = nrecs - ahead * SCAN_WINDOW;
+		len = (len < SCAN_WINDOW ? len : SCAN_WINDOW) * sizeof(struct record_t);
+		if (fd < 0) {
+			madvise(map + ahead * SCAN_WINDOW, len, MADV_WILLNEED);
+		} else {
+			posix_fadvise(fd, ahead * SCAN_WINDOW * sizeof(struct record_t), len, POSIX_FADV_WILLNEED);
+		}
+	}
+	if (fd >= 0) {
+		close(fd); // drops the lock
+	}
+
+	*next = cursor + n < nrecs ? ncold + cursor + n : SCAN_END;
+	METRIC_ADD(scan_batches, 1);
+	METRIC_ADD(scan_records, n);
+	return n;
+}
+
+/**
+ * Updates a record in the database.
+ * @param update The structure containing update information.
+ * @param record The structure to write the updated record back to,
+ * may be NULL.
+ * @returns 0 on success, -1 on error.
+ */
+int update_record(struct update_t update, struct record_t * record) {
+	struct hot_t * hot = hot_slot(update.acctnum, 0);
+	if (hot != NULL && __atomic_load_n(&hot->hot, __ATOMIC_ACQUIRE)) {
+		sketch_note(update.acctnum, 1);
+		stamp(hot->offset);
+		return hot_update(hot, update.value, record) == 0 ? 0 : -1;
+	}
+
+	struct txn_op_t op = { update.acctnum, update.value };
+	return store_txn(&op, 1, 0, record) == 0 ? 0 : -1;
+}
+
+/**
+ * Applies a set of changes atomically. The records are found in one
+ * scan of the store and locked in file order, so concurrent
+ * transactions cannot deadlock. The new values are committed with a
+ * single log write before any record is written back.
+ * @param ops The changes, changes to the same account are combined.
+ * @param n The number of changes, at most TXN_MAXOPS.
+ * @param no_overdraft Abort if a change would take an account below
+ * zero.
+ * @param records Filled with the changed record of every change, in
+ * the order of ops, as committed. May be NULL.
+ * @returns 0 on success, a STORE_ error code on error.
+ */
+int store_txn(struct txn_op_t * ops, int n, int no_overdraft, struct record_t * records) {
+	struct log_rec_t recs[TXN_MAXOPS];
+	float deltas[TXN_MAXOPS];
+	off_t offs[TXN_MAXOPS];
+	int acctnums[TXN_MAXOPS];
+
+	if (n < 1 || n > TXN_MAXOPS) {
+		return STORE_ENOTFOUND;
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (!store_has(ops[i].acctnum)) {
+			return STORE_ENOTFOUND;
+		}
+		acctnums[i] = ops[i].acctnum;
+	}
+
+	for (int i = 0; i < n; i++) {
+		sketch_note(ops[i].acctnum, 1);
+	}
+
+	// find every record in one pass, before any lock is held: closing
+	//	any descriptor of the store drops this process's locks
+	if (find_or_promote(acctnums, n, offs) < n) {
+		METRIC_ADD(bloom_false_pos, bloom != NULL);
+		return STORE_ENOTFOUND;
+	}
+
+	int fd = open(dbfile, O_RDWR);
+	if (fd < 0) {
+		perror("open error");
+		return STORE_EIO;
+	}
+
+	// sort by offset, combining changes to the same record
+	int count = 0;
+	for (int i = 0; i < n; i++) {
+		int j = count;
+		while (j > 0 && recs[j - 1].offset > offs[i]) {
+			j--;
+		}
+		if (j > 0 && recs[j - 1].offset == offs[i]) {
+			deltas[j - 1] += ops[i].value;
+			continue;
+		}
+
+		memmove(&recs[j + 1], &recs[j], (count - j) * sizeof(struct log_rec_t));
+		memmove(&deltas[j + 1], &deltas[j], (count - j) * sizeof(float));
+		recs[j].offset = offs[i];
+		deltas[j] = ops[i].value;
+		count++;
+	}
+
+	// lock in file order, then read the records again, they may
+	//	have changed since the scan
+	int rval = 0, locked = 0;
+	uint64_t t = TRACE_START();
+	for (; locked < count; locked++) {
+		// updates that keep waiting here get combined instead
+		if (n == 1 && try_lock_record(fd, recs[locked].offset) == 0) {
+			continue;
+		} else if (n == 1) {
+			hot_wait(ops[0].acctnum, recs[locked].offset);
+		}
+
+		if (lock_record(fd, recs[locked].offset, F_WRLCK) < 0) {
+			perror("lock error");
+			rval = STORE_EIO;
+			break;
+		}
+	}
+	TRACE_END(TRACE_LOCK, t);
+
+	for (int i = 0; i < count && rval == 0; i++) {
+		if (read_locked(fd, &recs[i]) < 0) {
+			perror("read error");
+			rval = STORE_EIO;
+		} else if (no_overdraft && deltas[i] < 0 && recs[i].record.value + deltas[i] < 0) {
+			rval = STORE_EFUNDS;
+		}
+		recs[i].record.value += deltas[i];
+	}
+
+	// commit with one log write, then write the records back
+	if (rval == 0) {
+		rval = commit(fd, recs, deltas, count);
+	}
+
+	// nothing can change the records until they are unlocked
+	for (int i = 0; i < n && rval == 0 && records != NULL; i++) {
+		for (int j = 0; j < count; j++) {
+			if (recs[j].offset == offs[i]) {
+				records[i] = recs[j].record;
+			}
+		}
+	}
+
+	for (int i = locked - 1; i >= 0; i--) {
+		lock_record(fd, recs[i].offset, F_UNLCK);
+	}
+	close(fd);
+	if (checkpoint_due) {
+		checkpoint();
+	}
+
+	METRIC_ADD(txns, 1);
+	if (rval != 0) {
+		METRIC_ADD(txn_aborts, 1);
+	}
+	return rval;
+}
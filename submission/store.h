@@ -0,0 +1,183 @@
+/**
+ * Record store of the database server. Records live in a flat file;
+ * every change goes through store_txn, which locks the
+ * records it touches in file order, appends their new values to a
+ * redo log in a single write and then writes them back in place. A
+ * crash between the log write and the record writes is repaired by
+ * replaying the log at startup. Once the log holds LOG_CHECKPOINT_BYTES
+ * the commit that filled it checkpoints: it locks the whole store,
+ * syncs it and empties the log. Every committed change is also
+ * appended to the ledger of its account, see ledger.h.
+ *
+ * A store built by dbload starts with its records sorted by account,
+ * described by an index file next to it: the number of sorted records
+ * and the account of every INDEX_EVERY-th of them. Lookups binary
+ * search that prefix through the index and only scan the records
+ * appended after it. An index that no longer matches the store is
+ * dropped at the first lookup that notices.
+ *
+ * A Bloom filter over the account numbers, shared by every worker,
+ * answers most lookups of missing accounts without a scan. Workers
+ * count the bytes they append to the store in the filter; when the
+ * count has not moved, a miss takes the size of the store from an
+ * fstat on a descriptor held open, so records appended by other
+ * programs are found too. The first miss after the store grew adds the
+ * appended records.
+ *
+ * Workers map the store and read records straight from memory without
+ * taking a lock. Every record carries a sequence counter, shared by
+ * every worker, that a writer makes odd while it rewrites the record.
+ * A reader copies the record and tries again if the counter was odd or
+ * moved meanwhile, so it never sees a half written record and never
+ * holds up a writer. Records appended beyond the counters, and reads
+ * that keep losing to writers, fall back to the record lock.
+ *
+ * Updates of contended accounts are combined. Once an account's
+ * updates have waited on its record lock HOT_THRESHOLD times, an
+ * update adds its change to the worker's stripe of the account. One
+ * worker at a time becomes the combiner, yields once so the others can
+ * add theirs, takes the lock and folds every stripe into the record
+ * with a single commit, so the other writers find their change applied
+ * instead of queueing for the lock. An update still returns only once
+ * its change is committed, so reads see exact balances.
+ *
+ * store_scan hands out the records in file order, a batch at a time,
+ * for exports. The store is read ahead a SCAN_WINDOW at a time as a
+ * scan moves into it, so a full scan streams at disk speed with only
+ * a window of it brought in ahead of the reader.
+ *
+ * A server can keep a compact image of the store in memory, see
+ * compact.h, built at startup. Queries of the accounts in it are
+ * answered from the image without touching the store; changes are
+ * still written to the store and through to the image.
+ *
+ * A store can have a cold tier, see tier.h, that dbload -Z moves the
+ * records nobody used for a while to. The cold accounts have a Bloom
+ * filter of their own, built at startup; an account found in neither
+ * the sorted records nor the filter of the store but let through by
+ * that of the cold tier is looked up there and promoted: its
+ * record is appended to the store under the promotion lock, a lock on
+ * the byte at PROMOTE_LOCK, and entered in a table shared by every
+ * worker, so lookups find it without scanning the records after the
+ * sorted ones. The table has room for as many records as the store
+ * held at startup, PROMO_MIN_RECS at least; once it fills up, lookups
+ * scan again until the store is reloaded. Every record served is
+ * stamped with the time, and scans read the cold tier first.
+ *
+ * Concurrent queries of an account share one lookup of its record. The
+ * first claims the account's slot in a table shared by every worker and
+ * runs the lookup; queries of the account that find the slot claimed
+ * wait for its result, then each reads the record itself, so the
+ * record is as fresh as if it had looked it up alone. Accounts found
+ * through the index, and accounts whose slots are all taken, are looked
+ * up without a slot, so a query that meets no one costs no more than
+ * before.
+ * Changelog:
+ *	10/18/2026 - Created from the record code in server.c.
+ *			   - Add transactions and the redo log.
+ *			   - Hand back the changed records.
+ *			   - Add the account Bloom filter.
+ *			   - Read records lock free from a mapping of the store.
+ *			   - Combine the updates of hot accounts.
+ *			   - Look accounts up through the index of a sorted store.
+ *			   - Add store_scan.
+ *			   - Keep a ledger of every change, see ledger.h.
+ *			   - Add the compact image, see compact.h.
+ *			   - Add the cold tier, see tier.h.
+ *			   - Coalesce the lookups of concurrent queries.
+ */
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+
+#include "proto.h"
+
+// store defines
+#define LOG_SUFFIX ".log" // the redo log sits next to the store
+#define LOG_MAGIC 0x43424c47 // marks the start of a log entry
+#define LOG_CHECKPOINT_BYTES (1 << 22) // log bytes that start a checkpoint, 4 MiB
+#define INDEX_SUFFIX ".idx" // the index sits next to the store
+#define INDEX_MAGIC 0x43424958 // marks an index file
+#define INDEX_EVERY 256 // sorted records per index entry
+#define SCAN_RECS 256 // records read per store read while scanning
+#define SCAN_WINDOW 32768 // records read ahead of a store_scan, 1 MiB
+#define BLOOM_BITS_PER_KEY 10 // about 1% false positives
+#define BLOOM_HASHES 7 // bits set per account
+#define BLOOM_MIN_KEYS 4096 // the filter has room for at least this many
+#define SEQ_MIN_RECS 4096 // the sequence counters cover at least this many
+#define SEQ_MAX_RETRIES 64 // lock free reads of a record before taking its lock
+#define HOT_SLOTS 256 // accounts tracked for contention
+#define HOT_PROBES 8 // slots tried for an account before giving up on it
+#define HOT_STRIPES 16 // change accumulators per hot account
+#define HOT_THRESHOLD 16 // lock waits before an account's updates are combined
+#define HOT_SPINS 100 // yields waiting on a combiner before waiting on the lock
+#define PROMO_MIN_RECS 65536 // the promoted table has room for at least this many
+#define PROMO_PROBES 16 // slots tried for a promoted record before giving up on it
+#define PROMOTE_LOCK ((off_t)1 << 62) // the byte locked while promoting, past any record
+#define FLIGHT_SLOTS 256 // lookups shared at once
+#define FLIGHT_PROBES 4 // slots tried for an account before looking up alone
+#define FLIGHT_SPINS 64 // yields waiting for a lookup before napping
+#define FLIGHT_NAP_US 50 // us between checks once done yielding
+
+// store error codes
+#define STORE_ENOTFOUND -1 // an account is not in the store
+#define STORE_EFUNDS -2 // a transfer would overdraw its source
+#define STORE_EIO -3 // the store or log could not be read or written
+
+// the header of an index file, followed by an int32_t account for
+//	every INDEX_EVERY-th sorted record, starting with the first
+struct index_hdr_t {
+	uint32_t magic;
+	uint32_t every; // sorted records per entry
+	uint64_t nsorted; // records at the start of the store in account order
+};
+
+/**
+ * Hashes an account for the filter. The BLOOM_HASHES bit positions
+ * are h1 + i * h2, two hashes are enough for a Bloom filter.
+ * @param acctnum The account.
+ * @param h1 The first hash.
+ * @param h2 The second hash, odd so every position differs.
+ */
+static inline void bloom_hash(int acctnum, uint64_t * h1, uint64_t * h2) {
+	// splitmix64 finalizer
+	uint64_t h = (uint32_t)acctnum + 0x9e3779b97f4a7c15ULL;
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	*h1 = h & 0xffffffff;
+	*h2 = (h >> 32) | 1;
+}
+
+/**
+ * Sizes the filter of a store for twice as many accounts as it holds,
+ * so appends keep the false positive rate down.
+ * @param nrecs The records in the store.
+ * @returns The bits of the filter, a power of two.
+ */
+static inline uint64_t bloom_bits(uint64_t nrecs) {
+	uint64_t keys = 2 * nrecs, nbits = 64;
+	if (keys < BLOOM_MIN_KEYS) {
+		keys = BLOOM_MIN_KEYS;
+	}
+	while (nbits < keys * BLOOM_BITS_PER_KEY) {
+		nbits *= 2;
+	}
+	return nbits;
+}
+
+//
+// PROTOTYPES
+//
+
+int query_record(struct query_t, struct record_t *);
+int store_has(int);
+int store_init(int, int);
+int store_mapped();
+int store_scan(uint32_t, struct record_t *, int, uint32_t *);
+int store_txn(struct txn_op_t *, int, int, struct record_t *);
+int update_record(struct update_t, struct record_t *);
+
+#endif
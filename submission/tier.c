@@ -0,0 +1,321 @@
+/**
+ * Implements the cold tier of the record store, see tier.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lz.h"
+#include "proto.h"
+#include "tier.h"
+
+#define BLOCK_BYTES (TIER_BLOCK_RECS * sizeof(struct record_t))
+
+static int cold_fd = -1; // read with pread only, shared by every worker
+static struct cold_hdr_t hdr;
+static struct cold_ent_t * ents = NULL; // the index, hdr.nblocks of them
+static size_t cached = SIZE_MAX; // the block in cache, this worker's
+static struct record_t cache[TIER_BLOCK_RECS];
+
+//
+// PROTOTYPES
+//
+
+static void join_block(const uint8_t *, size_t, struct record_t *);
+static int read_block(size_t, int *);
+static void split_block(const struct record_t *, size_t, uint8_t *);
+
+//
+// METHODS
+//
+
+/**
+ * Splits records into columns, so like bytes sit together: the
+ * accounts as deltas from the account before, the names, the values
+ * and the ages.
+ * @param recs The records, sorted by account.
+ * @param n The number of records.
+ * @param cols Where to write the columns, n records long.
+ */
+static void split_block(const struct record_t * recs, size_t n, uint8_t * cols) {
+	uint8_t * names = cols + n * sizeof(int32_t), * values = names + n * sizeof(recs->name);
+	uint8_t * ages = values + n * sizeof(float);
+	for (size_t i = 0; i < n; i++) {
+		uint32_t delta = (uint32_t)recs[i].acctnum - (i > 0 ? (uint32_t)recs[i - 1].acctnum : 0);
+		memcpy(cols + i * sizeof(int32_t), &delta, sizeof(int32_t));
+		memcpy(names + i * sizeof(recs->name), recs[i].name, sizeof(recs->name));
+		memcpy(values + i * sizeof(float), &recs[i].value, sizeof(float));
+		memcpy(ages + i * sizeof(int32_t), &recs[i].age, sizeof(int32_t));
+	}
+}
+
+/**
+ * Joins columns back into records.
+ * @param cols The columns, n records long.
+ * @param n The number of records.
+ * @param recs Where to write the records.
+ */
+static void join_block(const uint8_t * cols, size_t n, struct record_t * recs) {
+	const uint8_t * names = cols + n * sizeof(int32_t), * values = names + n * sizeof(recs->name);
+	const uint8_t * ages = values + n * sizeof(float);
+	uint32_t acctnum = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t delta;
+		memcpy(&delta, cols + i * sizeof(int32_t), sizeof(int32_t));
+		acctnum += delta;
+		recs[i].acctnum = (int32_t)acctnum;
+		memcpy(recs[i].name, names + i * sizeof(recs->name), sizeof(recs->name));
+		memcpy(&recs[i].value, values + i * sizeof(float), sizeof(float));
+		memcpy(&recs[i].age, ages + i * sizeof(int32_t), sizeof(int32_t));
+	}
+}
+
+/**
+ * Reads a block into the cache, unless it is there.
+ * @param b The block.
+ * @param reads Counts the blocks read.
+ * @returns 0 on success, -1 on error.
+ */
+static int read_block(size_t b, int * reads) {
+	if (b == cached) {
+		return 0;
+	}
+
+	static uint8_t packed[LZ_BOUND(BLOCK_BYTES)], cols[BLOCK_BYTES];
+	const struct cold_ent_t * ent = &ents[b];
+	if (ent->len > sizeof(packed) || ent->nrecs > TIER_BLOCK_RECS
+			|| pread(cold_fd, packed, ent->len, ent->off) != (ssize_t)ent->len
+			|| lz_decompress(packed, ent->len, cols, sizeof(cols)) != (ssize_t)(ent->nrecs * sizeof(struct record_t))) {
+		fprintf(stderr, "cold tier block %zu is corrupt\n", b);
+		return -1;
+	}
+
+	join_block(cols, ent->nrecs, cache);
+	cached = b;
+	(*reads)++;
+	return 0;
+}
+
+/**
+ * Opens the cold tier of a store and loads its index. MUST be called
+ * before the server forks.
+ * @param dbfile The store.
+ * @param bytes Set to the size of the cold tier, may be NULL.
+ * @returns 1 if the store has a cold tier, 0 if it has none, -1 on
+ * error.
+ */
+int tier_open(const char * dbfile, size_t * bytes) {
+	char path[BUFMAX/4];
+	snprintf(path, sizeof(path), "%s%s", dbfile, COLD_SUFFIX);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return errno == ENOENT ? 0 : -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != COLD_MAGIC
+			|| hdr.block_recs != TIER_BLOCK_RECS || hdr.index_off + hdr.nblocks * sizeof(struct cold_ent_t)
+			> (uint64_t)st.st_size) {
+		fprintf(stderr, "%s is not a cold tier\n", path);
+		close(fd);
+		return -1;
+	}
+
+	size_t len = hdr.nblocks * sizeof(struct cold_ent_t);
+	struct cold_ent_t * index = malloc(len + 1);
+	if (index == NULL || pread(fd, index, len, hdr.index_off) != (ssize_t)len) {
+		perror("read error");
+		free(index);
+		close(fd);
+		return -1;
+	}
+
+	free(ents);
+	if (cold_fd >= 0) {
+		close(cold_fd);
+	}
+	ents = index;
+	cold_fd = fd;
+	cached = SIZE_MAX;
+	if (bytes != NULL) {
+		*bytes = st.st_size;
+	}
+	return 1;
+}
+
+/**
+ * Counts the records of the cold tier.
+ * @returns The number of records, 0 without a cold tier.
+ */
+size_t tier_records() {
+	return ents != NULL ? hdr.nrecs : 0;
+}
+
+/**
+ * Finds an account in the cold tier: a binary search of the index
+ * picks the block, a binary search of the block finds the record.
+ * @param acctnum The account.
+ * @param record Where to write its record.
+ * @param reads Counts the blocks read.
+ * @returns 0 on success, -1 if the account is not in the cold tier or
+ * on error.
+ */
+int tier_find(int acctnum, struct record_t * record, int * reads) {
+	if (ents == NULL || hdr.nblocks == 0 || acctnum < ents[0].first) {
+		return -1;
+	}
+
+	size_t lo = 0, hi = hdr.nblocks;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ents[mid].first <= acctnum) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	if (acctnum > ents[lo].last || read_block(lo, reads) < 0) {
+		return -1;
+	}
+
+	size_t first = 0, last = ents[lo].nrecs;
+	while (first < last) {
+		size_t mid = first + (last - first) / 2;
+		if (cache[mid].acctnum == acctnum) {
+			*record = cache[mid];
+			return 0;
+		} else if (cache[mid].acctnum < acctnum) {
+			first = mid + 1;
+		} else {
+			last = mid;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Reads cold records in account order.
+ * @param pos The position of the first record.
+ * @param records Where to write the records.
+ * @param max The most records to read.
+ * @param reads Counts the blocks read.
+ * @returns The number of records read, -1 on error.
+ */
+int tier_read(size_t pos, struct record_t * records, int max, int * reads) {
+	int n = 0;
+	while (n < max && pos < tier_records()) {
+		size_t b = pos / hdr.block_recs, i = pos % hdr.block_recs;
+		if (read_block(b, reads) < 0) {
+			return -1;
+		}
+		for (; n < max && i < ents[b].nrecs; i++, pos++) {
+			records[n++] = cache[i];
+		}
+	}
+	return n;
+}
+
+/**
+ * Reads the whole cold tier of a store.
+ * @param dbfile The store.
+ * @param records Set to the records, sorted by account, to be freed by
+ * the caller.
+ * @param n Set to the number of records.
+ * @returns 1 if the store has a cold tier, 0 if it has none, -1 on
+ * error.
+ */
+int tier_load(const char * dbfile, struct record_t ** records, size_t * n) {
+	int rval = tier_open(dbfile, NULL);
+	*records = NULL;
+	*n = 0;
+	if (rval <= 0) {
+		return rval;
+	}
+
+	int reads = 0;
+	if ((*records = malloc(hdr.nrecs * sizeof(struct record_t) + 1)) == NULL) {
+		perror("malloc error");
+		return -1;
+	}
+	for (size_t b = 0; b < hdr.nblocks; b++) {
+		if (read_block(b, &reads) < 0) {
+			free(*records);
+			*records = NULL;
+			return -1;
+		}
+		memcpy(*records + *n, cache, ents[b].nrecs * sizeof(struct record_t));
+		*n += ents[b].nrecs;
+	}
+	return 1;
+}
+
+/**
+ * Writes the cold tier of a store, through a temporary file renamed
+ * over it.
+ * @param dbfile The store.
+ * @param recs The records, sorted by account, one per account.
+ * @param n The number of records.
+ * @returns 0 on success, -1 on error.
+ */
+int tier_write(const char * dbfile, const struct record_t * recs, size_t n) {
+	char path[BUFMAX/4], tmp[BUFMAX/2];
+	snprintf(path, sizeof(path), "%s%s", dbfile, COLD_SUFFIX);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+	struct cold_hdr_t out = { COLD_MAGIC, TIER_BLOCK_RECS, n, (n + TIER_BLOCK_RECS - 1) / TIER_BLOCK_RECS, 0 };
+	struct cold_ent_t * index = malloc(out.nblocks * sizeof(struct cold_ent_t) + 1);
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (index == NULL || fd < 0) {
+		perror("open error");
+		free(index);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+
+	static uint8_t cols[BLOCK_BYTES], packed[LZ_BOUND(BLOCK_BYTES)];
+	uint64_t off = sizeof(out);
+	int rval = 0;
+	for (size_t b = 0; b < out.nblocks && rval == 0; b++) {
+		const struct record_t * block = recs + b * TIER_BLOCK_RECS;
+		size_t nrecs = n - b * TIER_BLOCK_RECS < TIER_BLOCK_RECS ? n - b * TIER_BLOCK_RECS : TIER_BLOCK_RECS;
+		split_block(block, nrecs, cols);
+		size_t len = lz_compress(cols, nrecs * sizeof(struct record_t), packed);
+
+		index[b].first = block[0].acctnum;
+		index[b].last = block[nrecs - 1].acctnum;
+		index[b].nrecs = nrecs;
+		index[b].len = len;
+		index[b].off = off;
+		if (pwrite(fd, packed, len, off) != (ssize_t)len) {
+			rval = -1;
+		}
+		off += len;
+	}
+
+	out.index_off = off;
+	size_t len = out.nblocks * sizeof(struct cold_ent_t);
+	if (rval < 0 || pwrite(fd, index, len, off) != (ssize_t)len || pwrite(fd, &out, sizeof(out), 0) != sizeof(out)
+			|| fsync(fd) < 0) {
+		rval = -1;
+	}
+
+	// closed once whatever failed, a failed close is not retried
+	if (close(fd) < 0 || rval < 0 || rename(tmp, path) < 0) {
+		perror("write error");
+		unlink(tmp);
+		rval = -1;
+	}
+	free(index);
+	return rval;
+}
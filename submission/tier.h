@@ -0,0 +1,68 @@
+/**
+ * Cold tier of the record store. Records of accounts nobody used for a
+ * while are moved by dbload -Z out of the store, which then only holds
+ * the hot tier, into a cold file next to it: blocks of TIER_BLOCK_RECS
+ * records sorted by account, each split into columns, the accounts as
+ * deltas, and compressed with the codec of lz.h. A sparse index of the
+ * first and last account and the place of every block follows the
+ * blocks; the server keeps only the index in memory and reads and
+ * decompresses a block to find a cold account, keeping the last block
+ * read.
+ *
+ * The cold file is written by dbload and only read by the server. A
+ * cold account the server is asked for is promoted: its record is
+ * appended to the store and served from there on, so the copy in the
+ * cold tier goes stale and the store's record always wins. The server
+ * stamps every record it serves with the time in the stamp file next
+ * to the store, one uint32_t per record; dbload -Z demotes the records
+ * whose stamp is older than it is told, keeping the stamps of the
+ * rest.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#ifndef TIER_H
+#define TIER_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "proto.h"
+
+// tier defines
+#define COLD_SUFFIX ".cold" // the cold tier sits next to the store
+#define COLD_MAGIC 0x43424344 // marks a cold tier file
+#define STAMP_SUFFIX ".stm" // the last access of every record of the store
+#define TIER_BLOCK_RECS 256 // records per compressed block, 8 KiB raw
+
+// the header of a cold tier file, followed by the blocks and then the
+//	index, a cold_ent_t per block
+struct cold_hdr_t {
+	uint32_t magic;
+	uint32_t block_recs; // records per block, the last may hold fewer
+	uint64_t nrecs;
+	uint64_t nblocks;
+	uint64_t index_off; // where the index starts
+};
+
+// an entry of the index of a cold tier file
+struct cold_ent_t {
+	int32_t first; // the account of the first record of the block
+	int32_t last; // the account of the last record of the block
+	uint32_t nrecs;
+	uint32_t len; // compressed
+	uint64_t off;
+};
+
+//
+// PROTOTYPES
+//
+
+int tier_find(int, struct record_t *, int *);
+int tier_load(const char *, struct record_t **, size_t *);
+int tier_open(const char *, size_t *);
+int tier_read(size_t, struct record_t *, int, int *);
+size_t tier_records();
+int tier_write(const char *, const struct record_t *, size_t);
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * Implements the shared request trace, see trace.h.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+
+struct trace_t * trace = NULL;
+
+const char * trace_phases[TRACE_NPHASES] = {
+	"fork", "recv", "handle", "scan", "lock", "log", "write", "send"
+};
+
+// the ring of this process and its pid, set again in every child
+static struct trace_ring_t * ring = NULL;
+static pid_t ring_pid = 0;
+
+/**
+ * Picks the ring of a newly forked worker. MUST be called in every
+ * child the server forks.
+ */
+void trace_child() {
+	ring_pid = getpid();
+	if (trace != NULL) {
+		ring = &trace->ring[ring_pid % TRACE_RINGS];
+	}
+}
+
+/**
+ * Creates the shared trace of a server, replacing the one left by an
+ * earlier run on the same port. MUST be called before the server
+ * forks.
+ * @param port The port of the server, names the trace file.
+ * @param enabled Record spans from the start.
+ * @returns 0 on success, -1 on error.
+ */
+int trace_init(unsigned short port, int enabled) {
+	char path[64];
+	snprintf(path, sizeof(path), TRACE_PATH, port);
+
+	// unlink first, a dump tool may still map the old one
+	unlink(path);
+	int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	// the file stays sparse until the rings are written
+	if (ftruncate(fd, sizeof(struct trace_t)) < 0) {
+		perror("ftruncate error");
+		close(fd);
+		return -1;
+	}
+
+	void * addr = mmap(NULL, sizeof(struct trace_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return -1;
+	}
+
+	trace = addr;
+	trace->rings = TRACE_RINGS;
+	trace->events = TRACE_EVENTS;
+	trace->enabled = enabled;
+	__atomic_store_n(&trace->magic, TRACE_MAGIC, __ATOMIC_RELEASE);
+
+	trace_child();
+	return 0;
+}
+
+/**
+ * Maps the shared trace of a running server.
+ * @param port The port of the server.
+ * @returns The trace, NULL on error.
+ */
+struct trace_t * trace_open(unsigned short port) {
+	char path[64];
+	snprintf(path, sizeof(path), TRACE_PATH, port);
+
+	int fd = open(path, O_RDWR);
+	if (fd < 0) {
+		perror("open error");
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct trace_t)) {
+		fprintf(stderr, "%s is not a trace\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	void * addr = mmap(NULL, sizeof(struct trace_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		perror("mmap error");
+		return NULL;
+	}
+
+	struct trace_t * t = addr;
+	if (__atomic_load_n(&t->magic, __ATOMIC_ACQUIRE) != TRACE_MAGIC
+			|| t->rings != TRACE_RINGS || t->events != TRACE_EVENTS) {
+		fprintf(stderr, "%s does not match this build\n", path);
+		munmap(addr, sizeof(struct trace_t));
+		return NULL;
+	}
+
+	return t;
+}
+
+/**
+ * Records a span that ends now. Only called through TRACE_END.
+ * @param phase The phase the span covers.
+ * @param start When the span started, from TRACE_START.
+ */
+void trace_span(int phase, uint64_t start) {
+	uint64_t dur = trace_clock() - start;
+	if (ring == NULL) {
+		return;
+	}
+
+	// claim a slot, the oldest span is overwritten
+	uint64_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+	struct trace_event_t * ev = &ring->events[slot & (TRACE_EVENTS - 1)];
+
+	__atomic_store_n(&ev->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	ev->start = start;
+	ev->dur = dur > UINT32_MAX ? UINT32_MAX : (uint32_t)dur;
+	ev->pid = ring_pid;
+	ev->phase = phase;
+	__atomic_store_n(&ev->seq, slot + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,96 @@
+/**
+ * Request tracing for the database server. Each phase of handling a
+ * request is recorded as a span, its start and duration on the
+ * monotonic clock, into a ring of recent spans. The rings live in a
+ * file mapping shared by every worker and tracedump, which switches
+ * tracing on and off while the server runs and reads the rings back
+ * out. A worker writes to the ring picked by its pid, so workers
+ * rarely share one; when they do, slots are still claimed atomically.
+ * With tracing off a trace point costs one load of the enabled flag.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
+
+// trace defines
+#define TRACE_PATH "/tmp/cisbank-%hu.trace" // named after the server port
+#define TRACE_MAGIC 0x43425452
+#define TRACE_RINGS 16 // rings shared by the workers
+#define TRACE_EVENTS 4096 // spans kept per ring, a power of two
+
+// request phases, a span covers one of them
+#define TRACE_FORK 0 // from fork to the child serving the connection
+#define TRACE_RECV 1 // recv of a batch of requests
+#define TRACE_HANDLE 2 // one request, from decode to encoded reply
+#define TRACE_SCAN 3 // search of the store for the records
+#define TRACE_LOCK 4 // waiting for the record locks
+#define TRACE_LOG 5 // redo log write of a commit
+#define TRACE_WRITE 6 // writing committed records back
+#define TRACE_SEND 7 // writev of a batch of replies
+#define TRACE_NPHASES 8
+
+// one recorded span
+struct trace_event_t {
+	uint64_t seq; // slot number + 1 once written, 0 while being written
+	uint64_t start; // ns on the monotonic clock
+	uint32_t dur; // ns, saturates at about 4s
+	int32_t pid; // the worker
+	uint32_t phase;
+};
+
+// recent spans of the workers writing to the ring
+struct trace_ring_t {
+	uint64_t head; // slots claimed so far
+	char pad[56]; // keep the heads of rings on separate cache lines
+	struct trace_event_t events[TRACE_EVENTS];
+};
+
+// the shared trace file
+struct trace_t {
+	uint32_t magic;
+	uint32_t rings;
+	uint32_t events;
+	int enabled; // record spans while set
+	struct trace_ring_t ring[TRACE_RINGS];
+};
+
+// the shared trace, NULL until trace_init or when unavailable
+extern struct trace_t * trace;
+
+// the names of the phases, indexed by phase
+extern const char * trace_phases[TRACE_NPHASES];
+
+/**
+ * Reads the trace clock.
+ * @returns The time in ns on the monotonic clock.
+ */
+static inline uint64_t trace_clock() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// starts a span, 0 when tracing is off
+#define TRACE_START() \
+	(trace != NULL && __atomic_load_n(&trace->enabled, __ATOMIC_RELAXED) ? trace_clock() : 0)
+
+// ends a span started with TRACE_START, nothing when tracing was off
+#define TRACE_END(phase, start) \
+	do { if (start) trace_span((phase), (start)); } while (0)
+
+//
+// PROTOTYPES
+//
+
+void trace_child();
+int trace_init(unsigned short, int);
+struct trace_t * trace_open(unsigned short);
+void trace_span(int, uint64_t);
+
+#endif
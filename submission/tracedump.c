@@ -0,0 +1,233 @@
+/**
+ * Implements tracedump, which switches the request trace of a running
+ * database server on and off and dumps the recorded spans, either as
+ * Chrome trace JSON (load it in chrome://tracing or Perfetto) or as
+ * per-phase latency histograms.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "proto.h"
+#include "trace.h"
+
+// tracedump defines
+#define HIST_BUCKETS 24 // power of two buckets of us, the last is open
+#define HIST_WIDTH 40 // characters in the longest histogram bar
+
+//
+// tracedump configuration - set from the command line
+//
+
+static unsigned short port = SERVER_PORT;
+
+//
+// PROTOTYPES
+//
+
+int cmp_dur(const void *, const void *);
+int cmp_start(const void *, const void *);
+int main(int, char * []);
+void print_hist(struct trace_event_t *, size_t);
+void print_json(struct trace_event_t *, size_t);
+void print_usage(char *);
+size_t read_events(struct trace_t *, struct trace_event_t *);
+
+//
+// METHODS
+//
+
+/**
+ * Prints command line usage.
+ * @param prog The name the program was invoked with.
+ */
+void print_usage(char * prog) {
+	printf("usage: %s [-p port] <on|off|clear|json|hist>\n", prog);
+	printf("\t-p The port of the server (default %d).\n", SERVER_PORT);
+	printf("\ton Start recording spans.\n");
+	printf("\toff Stop recording spans.\n");
+	printf("\tclear Drop the recorded spans.\n");
+	printf("\tjson Print the spans as Chrome trace JSON.\n");
+	printf("\thist Print latency histograms of every phase.\n");
+}
+
+/**
+ * Orders spans by start time.
+ */
+int cmp_start(const void * a, const void * b) {
+	const struct trace_event_t * x = a, * y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+/**
+ * Orders spans by phase, then duration.
+ */
+int cmp_dur(const void * a, const void * b) {
+	const struct trace_event_t * x = a, * y = b;
+	if (x->phase != y->phase) {
+		return (x->phase > y->phase) - (x->phase < y->phase);
+	}
+	return (x->dur > y->dur) - (x->dur < y->dur);
+}
+
+/**
+ * Copies the whole spans out of every ring. Spans overwritten or
+ * still being written while they are copied are skipped.
+ * @param t The trace.
+ * @param dest The buffer to copy to, room for every slot of every ring.
+ * @returns The number of spans copied.
+ */
+size_t read_events(struct trace_t * t, struct trace_event_t * dest) {
+	size_t n = 0;
+	for (int r = 0; r < TRACE_RINGS; r++) {
+		struct trace_ring_t * ring = &t->ring[r];
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t slot = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+
+		for (; slot < head; slot++) {
+			struct trace_event_t * ev = &ring->events[slot & (TRACE_EVENTS - 1)];
+			if (__atomic_load_n(&ev->seq, __ATOMIC_ACQUIRE) != slot + 1) {
+				continue;
+			}
+
+			dest[n] = *ev;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&ev->seq, __ATOMIC_RELAXED) == slot + 1 && dest[n].phase < TRACE_NPHASES) {
+				n++;
+			}
+		}
+	}
+
+	return n;
+}
+
+/**
+ * Prints spans as Chrome trace JSON complete events, one track per
+ * worker, times in us from the first span.
+ * @param evs The spans.
+ * @param n The number of spans.
+ */
+void print_json(struct trace_event_t * evs, size_t n) {
+	qsort(evs, n, sizeof(*evs), cmp_start);
+	uint64_t base = n > 0 ? evs[0].start : 0;
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	for (size_t i = 0; i < n; i++) {
+		printf("%s\n{\"name\":\"%s\",\"cat\":\"cisbank\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+				i > 0 ? "," : "", trace_phases[evs[i].phase], (evs[i].start - base) / 1000.0,
+				evs[i].dur / 1000.0, evs[i].pid, evs[i].pid);
+	}
+	printf("\n]}\n");
+}
+
+/**
+ * Prints the latency percentiles of every phase followed by a power
+ * of two histogram of its spans.
+ * @param evs The spans.
+ * @param n The number of spans.
+ */
+void print_hist(struct trace_event_t * evs, size_t n) {
+	qsort(evs, n, sizeof(*evs), cmp_dur);
+
+	printf("%-8s %8s %10s %10s %10s %10s %10s\n", "phase", "count", "mean(us)", "p50", "p90", "p99", "max");
+	for (size_t lo = 0, hi; lo < n; lo = hi) {
+		double sum = 0;
+		for (hi = lo; hi < n && evs[hi].phase == evs[lo].phase; hi++) {
+			sum += evs[hi].dur;
+		}
+
+		size_t count = hi - lo;
+		printf("%-8s %8zu %10.2f %10.2f %10.2f %10.2f %10.2f\n", trace_phases[evs[lo].phase], count,
+				sum / count / 1000.0, evs[lo + count * 50 / 100].dur / 1000.0,
+				evs[lo + count * 90 / 100].dur / 1000.0, evs[lo + count * 99 / 100].dur / 1000.0,
+				evs[hi - 1].dur / 1000.0);
+	}
+
+	for (size_t lo = 0, hi; lo < n; lo = hi) {
+		size_t buckets[HIST_BUCKETS] = { 0 }, most = 0;
+		for (hi = lo; hi < n && evs[hi].phase == evs[lo].phase; hi++) {
+			// bucket b > 0 holds [2^(b-1), 2^b) us
+			int b = 0;
+			for (uint32_t us = evs[hi].dur / 1000; us > 0 && b < HIST_BUCKETS - 1; us >>= 1) {
+				b++;
+			}
+			if (++buckets[b] > most) {
+				most = buckets[b];
+			}
+		}
+
+		printf("\n%s\n", trace_phases[evs[lo].phase]);
+		for (int b = 0; b < HIST_BUCKETS; b++) {
+			if (buckets[b] == 0) {
+				continue;
+			}
+			printf("%8lu - %-8lu us %8zu ", b > 0 ? 1UL << (b - 1) : 0UL, 1UL << b, buckets[b]);
+			for (size_t w = 0; w < (buckets[b] * HIST_WIDTH + most - 1) / most; w++) {
+				putchar('#');
+			}
+			putchar('\n');
+		}
+	}
+}
+
+/**
+ * Entry point of tracedump.
+ * @param argc Number of arguments passed via command line.
+ * @param argv Arguments passed via command line.
+ */
+int main(int argc, char * argv[]) {
+	int opt;
+	while ((opt = getopt(argc, argv, "p:h")) != -1) {
+		switch (opt) {
+			case 'p': port = atoi(optarg); break;
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	char * cmd = argv[optind];
+
+	struct trace_t * t = trace_open(port);
+	if (t == NULL) {
+		return 1;
+	}
+
+	if (strcmp(cmd, "on") == 0 || strcmp(cmd, "off") == 0) {
+		__atomic_store_n(&t->enabled, strcmp(cmd, "on") == 0, __ATOMIC_RELAXED);
+	} else if (strcmp(cmd, "clear") == 0) {
+		// spans being written right now may survive, that's harmless
+		for (int r = 0; r < TRACE_RINGS; r++) {
+			for (int i = 0; i < TRACE_EVENTS; i++) {
+				__atomic_store_n(&t->ring[r].events[i].seq, 0, __ATOMIC_RELAXED);
+			}
+		}
+	} else if (strcmp(cmd, "json") == 0 || strcmp(cmd, "hist") == 0) {
+		struct trace_event_t * evs = malloc(sizeof(struct trace_event_t) * TRACE_RINGS * TRACE_EVENTS);
+		if (evs == NULL) {
+			perror("malloc error");
+			return 1;
+		}
+
+		size_t n = read_events(t, evs);
+		if (strcmp(cmd, "json") == 0) {
+			print_json(evs, n);
+		} else {
+			print_hist(evs, n);
+		}
+		free(evs);
+	} else {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,762 @@
+/**
+ * Implements an io_uring backend for the database server. A single
+ * process serves every connection from one event loop; accepts,
+ * receives, gathered sends and the store reads of queries are all
+ * queued on one submission ring and reaped from one completion ring,
+ * so a batch of requests costs a single io_uring_enter. With a
+ * polling cpu the kernel drains the submission ring itself and the
+ * loop only enters the kernel to wait for completions.
+ *
+ * Updates still run synchronously through handle_pkt, the record
+ * lock they wait on cannot be expressed as a ring operation. So do
+ * queries while the store is mapped, a scan of memory makes no
+ * syscalls to queue.
+ * Changelog:
+ *	10/18/2026 - Created initial version.
+ *			   - Apply the admission limits, queue or shed connections
+ *				 beyond max_conns and rate limit each client.
+ *			   - Drop requests past their deadline, close idle
+ *				 connections from a periodic sweep.
+ *			   - Accept co-located clients on the unix socket too.
+ *			   - Trace requests, ring scans and sends.
+ *			   - Skip the scan for accounts the store filter rules out.
+ *			   - Answer queries from the mapped store.
+ *			   - Count the accesses of ring scanned queries.
+ *			   - Capture the requests received.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "admit.h"
+#include "capture.h"
+#include "metrics.h"
+#include "server.h"
+#include "sketch.h"
+#include "store.h"
+#include "trace.h"
+
+// backend defines
+#define URING_ENTRIES 1024 // submission ring size
+#define URING_MAXCONNS 1000 // MUST stay below URING_ENTRIES
+#define URING_IDLE 2000 // ms before the polling thread sleeps
+#define SCANBUF_RECS 256 // records read per store read
+
+// operation types, kept in the low bits of the user data
+#define OP_ACCEPT 0
+#define OP_RECV 1
+#define OP_WRITEV 2
+#define OP_READ 3
+#define OP_TIMEOUT 4
+#define OP_ACCEPT_LOCAL 5
+#define OP_MASK 7
+
+// the mapped submission and completion rings
+struct ring_t {
+	int fd;
+	int sqpoll; // kernel polls the submission ring
+	unsigned * sq_head, * sq_tail, * sq_mask, * sq_flags, * sq_array;
+	struct io_uring_sqe * sqes;
+	unsigned * cq_head, * cq_tail, * cq_mask;
+	struct io_uring_cqe * cqes;
+	unsigned to_submit; // sqes queued since the last enter
+	void * sq_ptr, * cq_ptr;
+	size_t sq_len, cq_len, sqes_len;
+};
+
+// a connection, at most one operation is in flight for it at a time
+struct uconn_t {
+	int fd; // -1 when free
+	struct in_addr addr; // client address, for rate limiting
+	uint32_t capid; // the number of the connection in the capture
+	size_t len; // bytes in iobuf
+	int npkts; // whole requests in iobuf
+	int admitted; // requests within the client's rate, the rest are shed
+	int next; // next request to answer
+	int receiving; // a receive is in flight
+	double active; // ms of the last receive, for the idle timeout
+	double start; // ms the requests in iobuf were received
+	int acctnum; // account a query is scanning for
+	off_t scanoff; // store offset of the next read
+	uint64_t traced; // when the scan or send in flight started, for its trace
+	struct iovec iov[IOBUF_PKTS];
+	int iovoff; // first iovec not yet fully sent
+	struct uconn_t * next_free;
+	union iobuf_t iobuf;
+	struct record_t scanbuf[SCANBUF_RECS];
+};
+
+static struct ring_t ring;
+static struct uconn_t * conns;
+static struct uconn_t * free_conns;
+static struct connq_t connq; // accepted connections waiting for a free conn
+static int nactive = 0; // connections being served
+static int dbfd = -1;
+
+// address of the connection being accepted, one accept is in flight
+static struct sockaddr_in accept_addr;
+static socklen_t accept_addrlen;
+
+// wakes the loop to shed queued connections that waited too long and
+// to close idle connections
+static struct __kernel_timespec expire_ts;
+static int expiring = 0; // a timeout is in flight
+static double next_sweep = 0; // ms of the next idle sweep
+
+//
+// PROTOTYPES
+//
+
+static void answer(struct uconn_t *);
+static struct uconn_t * conn_get();
+static void conn_put(struct uconn_t *);
+static void conn_start(struct uconn_t *, int, struct in_addr);
+static int expire_conns();
+static void on_accept(int, struct in_addr);
+static void on_read(struct uconn_t *, int);
+static void on_recv(struct uconn_t *, int);
+static void on_writev(struct uconn_t *, int);
+static void prep_accept(int);
+static void prep_accept_local(int);
+static void prep_read(struct uconn_t *);
+static void prep_recv(struct uconn_t *);
+static void prep_timeout(int);
+static void prep_writev(struct uconn_t *);
+static int ring_enter(unsigned, unsigned);
+static struct io_uring_sqe * ring_get_sqe();
+static int ring_probe();
+static int ring_setup(unsigned, int);
+
+//
+// METHODS
+//
+
+/**
+ * Creates and maps the rings.
+ * @param entries The number of submission ring entries.
+ * @param sqpoll_cpu The cpu of the kernel polling thread, -1 for none.
+ * @returns 0 on success, -1 if io_uring is unavailable.
+ */
+static int ring_setup(unsigned entries, int sqpoll_cpu) {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	if (sqpoll_cpu >= 0) {
+		p.flags = IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF;
+		p.sq_thread_cpu = sqpoll_cpu;
+		p.sq_thread_idle = URING_IDLE;
+	}
+
+	if ((ring.fd = syscall(__NR_io_uring_setup, entries, &p)) < 0) {
+		perror("io_uring_setup error");
+		return -1;
+	}
+	ring.sqpoll = sqpoll_cpu >= 0;
+
+	ring.sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring.cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring.cq_len > ring.sq_len) {
+			ring.sq_len = ring.cq_len;
+		}
+		ring.cq_len = ring.sq_len;
+	}
+
+	ring.sq_ptr = mmap(NULL, ring.sq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+	if (ring.sq_ptr == MAP_FAILED) {
+		perror("mmap error");
+		close(ring.fd);
+		return -1;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring.cq_ptr = ring.sq_ptr;
+	} else {
+		ring.cq_ptr = mmap(NULL, ring.cq_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+		if (ring.cq_ptr == MAP_FAILED) {
+			perror("mmap error");
+			munmap(ring.sq_ptr, ring.sq_len);
+			close(ring.fd);
+			return -1;
+		}
+	}
+
+	ring.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring.sqes = mmap(NULL, ring.sqes_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+	if (ring.sqes == MAP_FAILED) {
+		perror("mmap error");
+		if (ring.cq_ptr != ring.sq_ptr) {
+			munmap(ring.cq_ptr, ring.cq_len);
+		}
+		munmap(ring.sq_ptr, ring.sq_len);
+		close(ring.fd);
+		return -1;
+	}
+
+	char * sq = ring.sq_ptr, * cq = ring.cq_ptr;
+	ring.sq_head = (unsigned *)(sq + p.sq_off.head);
+	ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring.sq_flags = (unsigned *)(sq + p.sq_off.flags);
+	ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	ring.to_submit = 0;
+
+	return 0;
+}
+
+/**
+ * Checks the kernel supports every operation the backend uses.
+ * @returns 0 on success, -1 if an operation is unsupported.
+ */
+static int ring_probe() {
+	static const int ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_WRITEV, IORING_OP_READ, IORING_OP_TIMEOUT };
+	size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe * probe = calloc(1, len);
+	if (probe == NULL) {
+		return -1;
+	}
+
+	if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+		perror("io_uring_register error");
+		free(probe);
+		return -1;
+	}
+
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+			fprintf(stderr, "io_uring op %d unsupported\n", ops[i]);
+			free(probe);
+			return -1;
+		}
+	}
+
+	free(probe);
+	return 0;
+}
+
+/**
+ * Submits the queued sqes and optionally waits for completions.
+ * @param to_submit The number of sqes to submit.
+ * @param wait_nr The number of completions to wait for.
+ * @returns 0 on success, -1 on error.
+ */
+static int ring_enter(unsigned to_submit, unsigned wait_nr) {
+	unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+	if (ring.sqpoll) {
+		// the polling thread submits, only wake it when it sleeps
+		to_submit = 0;
+		if (__atomic_load_n(ring.sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) {
+			flags |= IORING_ENTER_SQ_WAKEUP;
+		} else if (wait_nr == 0) {
+			return 0;
+		}
+	}
+
+	METRIC_ADD(uring_enters, 1);
+	if (syscall(__NR_io_uring_enter, ring.fd, to_submit, wait_nr, flags, NULL, 0) < 0) {
+		if (errno != EINTR) {
+			perror("io_uring_enter error");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Gets a cleared sqe, queued for the next ring_enter. Never runs out
+ * since each connection, the listening sockets and the queue timer
+ * have at most one operation in flight.
+ * @returns The sqe.
+ */
+static struct io_uring_sqe * ring_get_sqe() {
+	unsigned tail = *ring.sq_tail;
+	unsigned index = tail & *ring.sq_mask;
+	struct io_uring_sqe * sqe = &ring.sqes[index];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	ring.sq_array[index] = index;
+	__atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring.to_submit++;
+	METRIC_ADD(uring_sqes, 1);
+
+	return sqe;
+}
+
+/**
+ * Queues an accept on the listening socket.
+ * @param listen_sk The listening socket.
+ */
+static void prep_accept(int listen_sk) {
+	struct io_uring_sqe * sqe = ring_get_sqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = listen_sk;
+	accept_addrlen = sizeof(accept_addr);
+	sqe->addr = (unsigned long)&accept_addr;
+	sqe->addr2 = (unsigned long)&accept_addrlen;
+	sqe->user_data = OP_ACCEPT;
+}
+
+/**
+ * Queues an accept on the unix socket listener, local clients have
+ * no address worth keeping.
+ * @param local_sk The unix socket listener.
+ */
+static void prep_accept_local(int local_sk) {
+	struct io_uring_sqe * sqe = ring_get_sqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = local_sk;
+	sqe->user_data = OP_ACCEPT_LOCAL;
+}
+
+/**
+ * Queues a timeout that completes after a number of ms.
+ * @param ms The ms to wait.
+ */
+static void prep_timeout(int ms) {
+	expire_ts.tv_sec = ms / 1000;
+	expire_ts.tv_nsec = (ms % 1000) * 1000000L;
+
+	struct io_uring_sqe * sqe = ring_get_sqe();
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (unsigned long)&expire_ts;
+	sqe->len = 1;
+	sqe->user_data = OP_TIMEOUT;
+	expiring = 1;
+}
+
+/**
+ * Queues a receive into the free end of the connection's buffer.
+ * @param conn The connection.
+ */
+static void prep_recv(struct uconn_t * conn) {
+	struct io_uring_sqe * sqe = ring_get_sqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = conn->fd;
+	sqe->addr = (unsigned long)(conn->iobuf.bytes + conn->len);
+	sqe->len = sizeof(conn->iobuf.bytes) - conn->len;
+	sqe->user_data = (unsigned long)conn | OP_RECV;
+	conn->receiving = 1;
+}
+
+/**
+ * Queues a gathered send of the responses not yet sent.
+ * @param conn The connection.
+ */
+static void prep_writev(struct uconn_t * conn) {
+	struct io_uring_sqe * sqe = ring_get_sqe();
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = conn->fd;
+	sqe->addr = (unsigned long)&conn->iov[conn->iovoff];
+	sqe->len = conn->npkts - conn->iovoff;
+	sqe->user_data = (unsigned long)conn | OP_WRITEV;
+}
+
+/**
+ * Queues the next store read of a query scan.
+ * @param conn The connection.
+ */
+static void prep_read(struct uconn_t * conn) {
+	struct io_uring_sqe * sqe = ring_get_sqe();
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = dbfd;
+	sqe->addr = (unsigned long)conn->scanbuf;
+	sqe->len = sizeof(conn->scanbuf);
+	sqe->off = conn->scanoff;
+	sqe->user_data = (unsigned long)conn | OP_READ;
+}
+
+/**
+ * Takes a connection off the free list.
+ * @returns The connection, NULL if all are in use.
+ */
+static struct uconn_t * conn_get() {
+	struct uconn_t * conn = free_conns;
+	if (conn != NULL) {
+		free_conns = conn->next_free;
+		conn->len = 0;
+		conn->npkts = conn->next = 0;
+	}
+	return conn;
+}
+
+/**
+ * Starts serving a connection.
+ * @param conn The connection, taken off the free list.
+ * @param sk The connected socket.
+ * @param addr The client address.
+ */
+static void conn_start(struct uconn_t * conn, int sk, struct in_addr addr) {
+	conn->fd = sk;
+	conn->addr = addr;
+	conn->capid = capture_conn();
+	conn->active = now_ms();
+	nactive++;
+	METRIC_ADD(connections, 1);
+	prep_recv(conn);
+}
+
+/**
+ * Closes a connection and hands it to the oldest queued connection,
+ * or returns it to the free list.
+ * @param conn The connection.
+ */
+static void conn_put(struct uconn_t * conn) {
+	capture_flush();
+	close(conn->fd);
+	conn->fd = -1;
+	nactive--;
+
+	int sk;
+	if ((sk = connq_pop(&connq)) >= 0) {
+		conn->len = 0;
+		conn->npkts = conn->next = 0;
+		conn_start(conn, sk, peer_addr(sk));
+		return;
+	}
+
+	conn->next_free = free_conns;
+	free_conns = conn;
+}
+
+/**
+ * Handles a completed accept, serving, queuing or shedding the
+ * connection.
+ * @param res The connected socket or a negative errno.
+ * @param addr The client address.
+ */
+static void on_accept(int res, struct in_addr addr) {
+	struct uconn_t * conn;
+	if (res < 0) {
+		fprintf(stderr, "accept error: %s\n", strerror(-res));
+	} else if ((conn = conn_get()) != NULL) {
+		conn_start(conn, res, addr);
+	} else if (connq_push(&connq, res) < 0) {
+		admit_shed(res);
+	}
+}
+
+/**
+ * Answers the received requests in order, starting with the next
+ * one. Stops at a query to scan the store for it, the read
+ * completion resumes answering. Sends every response once all are
+ * answered.
+ * @param conn The connection.
+ */
+static void answer(struct uconn_t * conn) {
+	while (conn->next < conn->npkts) {
+		struct pkt_t * pkt = &conn->iobuf.pkts[conn->next];
+
+		// shed the requests beyond the client's rate
+		if (conn->next >= conn->admitted) {
+			encode_busy(pkt);
+			conn->next++;
+			continue;
+		}
+
+		// requests the client gave up on are not worth a scan
+		if (drop_expired(pkt, conn->start)) {
+			conn->next++;
+			continue;
+		}
+
+		// queries owned by this shard scan the store through the ring,
+		//	unless it is mapped
+		if (ntohs(pkt->ptype) == PTYPE_QUERY && ntohl(pkt->body.query.code) == DB_QUERY_CODE
+				&& shard_of(ntohl(pkt->body.query.acctnum), nshards) == shard_id && !store_mapped()) {
+			conn->acctnum = ntohl(pkt->body.query.acctnum);
+			if (!store_has(conn->acctnum)) {
+				encode_error(pkt, "Record not found!");
+				note_late(pkt, conn->start);
+				conn->next++;
+				continue;
+			}
+			sketch_note(conn->acctnum, 0);
+
+			conn->scanoff = 0;
+			conn->traced = TRACE_START();
+			prep_read(conn);
+			return;
+		}
+
+		uint64_t t = TRACE_START();
+		handle_pkt(pkt);
+		TRACE_END(TRACE_HANDLE, t);
+		note_late(pkt, conn->start);
+		conn->next++;
+	}
+
+	for (int i = 0; i < conn->npkts; i++) {
+		conn->iov[i].iov_base = &conn->iobuf.pkts[i];
+		conn->iov[i].iov_len = PKTSIZE;
+	}
+	conn->iovoff = 0;
+
+	METRIC_ADD(requests, conn->npkts);
+	METRIC_ADD(writevs, 1);
+	conn->traced = TRACE_START();
+	prep_writev(conn);
+}
+
+/**
+ * Handles a completed receive.
+ * @param conn The connection.
+ * @param res The bytes received or a negative errno.
+ */
+static void on_recv(struct uconn_t * conn, int res) {
+	conn->receiving = 0;
+	if (res <= 0) { // closed or failed
+		if (res < 0 && res != -ECONNRESET) {
+			fprintf(stderr, "recv error: %s\n", strerror(-res));
+		}
+		conn_put(conn);
+		return;
+	}
+
+	conn->len += res;
+	conn->npkts = conn->len / PKTSIZE;
+	conn->next = 0;
+	conn->active = conn->start = now_ms();
+	capture_pkts(conn->capid, conn->iobuf.pkts, conn->npkts);
+
+	if (conn->npkts == 0) {
+		prep_recv(conn);
+	} else {
+		conn->admitted = admit_take(conn->addr, conn->npkts);
+		answer(conn);
+	}
+}
+
+/**
+ * Handles a completed store read of a query scan.
+ * @param conn The connection.
+ * @param res The bytes read or a negative errno.
+ */
+static void on_read(struct uconn_t * conn, int res) {
+	struct pkt_t * pkt = &conn->iobuf.pkts[conn->next];
+
+	if (res != sizeof(conn->scanbuf)) { // the last read of the scan
+		TRACE_END(TRACE_SCAN, conn->traced);
+	}
+
+	if (res < 0) {
+		fprintf(stderr, "read error: %s\n", strerror(-res));
+		encode_error(pkt, "Record not found!");
+		note_late(pkt, conn->start);
+		conn->next++;
+		answer(conn);
+		return;
+	}
+
+	int nrecs = res / sizeof(struct record_t);
+	for (int i = 0; i < nrecs; i++) {
+		if (conn->scanbuf[i].acctnum == conn->acctnum) {
+			if (res == sizeof(conn->scanbuf)) {
+				TRACE_END(TRACE_SCAN, conn->traced);
+			}
+			encode_record(pkt, &conn->scanbuf[i]);
+			note_late(pkt, conn->start);
+			conn->next++;
+			answer(conn);
+			return;
+		}
+	}
+
+	if (res == sizeof(conn->scanbuf)) { // more of the store to scan
+		conn->scanoff += res;
+		prep_read(conn);
+	} else {
+		METRIC_ADD(bloom_false_pos, 1);
+		encode_error(pkt, "Record not found!");
+		note_late(pkt, conn->start);
+		conn->next++;
+		answer(conn);
+	}
+}
+
+/**
+ * Handles a completed gathered send.
+ * @param conn The connection.
+ * @param res The bytes sent or a negative errno.
+ */
+static void on_writev(struct uconn_t * conn, int res) {
+	if (res < 0) {
+		fprintf(stderr, "send error: %s\n", strerror(-res));
+		conn_put(conn);
+		return;
+	}
+
+	// skip the responses that were sent
+	while (conn->iovoff < conn->npkts && (size_t)res >= conn->iov[conn->iovoff].iov_len) {
+		res -= conn->iov[conn->iovoff].iov_len;
+		conn->iovoff++;
+	}
+	if (conn->iovoff < conn->npkts) { // short send
+		conn->iov[conn->iovoff].iov_base = (char *)conn->iov[conn->iovoff].iov_base + res;
+		conn->iov[conn->iovoff].iov_len -= res;
+		prep_writev(conn);
+		return;
+	}
+	TRACE_END(TRACE_SEND, conn->traced);
+
+	// keep the partial request for the next recv
+	size_t used = conn->npkts * PKTSIZE;
+	if (conn->len > used) {
+		memmove(conn->iobuf.bytes, conn->iobuf.bytes + used, conn->len - used);
+		METRIC_ADD(copies, 1);
+		METRIC_ADD(copy_bytes, conn->len - used);
+	}
+	conn->len -= used;
+	conn->npkts = conn->next = 0;
+	prep_recv(conn);
+}
+
+/**
+ * Sheds queued connections that waited too long and, at most every
+ * quarter of the idle timeout, closes connections that sent nothing
+ * for the whole timeout. Shutting the socket down completes its
+ * receive, which then releases the connection as usual.
+ * @returns The ms until the next expiry, -1 if there is nothing to
+ * expire.
+ */
+static int expire_conns() {
+	int ms = connq_expire(&connq);
+	if (idle_timeout == 0 || nactive == 0) {
+		return ms;
+	}
+
+	double t = now_ms();
+	if (t >= next_sweep) {
+		for (int i = 0; i < max_conns && i < URING_MAXCONNS; i++) {
+			struct uconn_t * conn = &conns[i];
+			if (conn->fd >= 0 && conn->receiving && t - conn->active >= idle_timeout) {
+				shutdown(conn->fd, SHUT_RDWR);
+				conn->receiving = 0;
+				METRIC_ADD(idle_conns, 1);
+			}
+		}
+		next_sweep = t + idle_timeout / 4 + 1;
+	}
+
+	// wake for new queued connections too, they expire no sooner
+	// than queue_timeout from now
+	int sweep_ms = (int)(next_sweep - t) + 1;
+	if (max_queue > 0 && queue_timeout > 0 && sweep_ms > queue_timeout) {
+		sweep_ms = queue_timeout;
+	}
+	return ms < 0 || sweep_ms < ms ? sweep_ms : ms;
+}
+
+/**
+ * Serves connections from an io_uring event loop.
+ * @param listen_sk The listening socket.
+ * @param local_sk The unix socket listener, -1 for none.
+ * @param sqpoll_cpu The cpu of the kernel polling thread, -1 for none.
+ * @returns -1 if io_uring is unavailable, otherwise never returns.
+ */
+int uring_serve(int listen_sk, int local_sk, int sqpoll_cpu) {
+	if (ring_setup(URING_ENTRIES, sqpoll_cpu) < 0) {
+		return -1;
+	}
+
+	if (ring_probe() < 0) {
+		close(ring.fd);
+		return -1;
+	}
+
+	if ((dbfd = open(dbfile, O_RDONLY)) < 0) {
+		perror("open error");
+		close(ring.fd);
+		return -1;
+	}
+
+	int nconns = max_conns < URING_MAXCONNS ? max_conns : URING_MAXCONNS;
+	if ((conns = calloc(nconns, sizeof(struct uconn_t))) == NULL || connq_init(&connq, max_queue, queue_timeout) < 0) {
+		perror("calloc error");
+		free(conns);
+		close(dbfd);
+		close(ring.fd);
+		return -1;
+	}
+
+	free_conns = NULL;
+	for (int i = nconns - 1; i >= 0; i--) {
+		conns[i].fd = -1;
+		conns[i].next_free = free_conns;
+		free_conns = &conns[i];
+	}
+
+	printf("Serving with io_uring%s\n", ring.sqpoll ? " (sqpoll)" : "");
+	fflush(stdout);
+
+	prep_accept(listen_sk);
+	if (local_sk >= 0) {
+		prep_accept_local(local_sk);
+	}
+
+	while (1) {
+		// only wait when nothing has completed yet
+		unsigned head = *ring.cq_head;
+		unsigned wait_nr = head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE) ? 1 : 0;
+		if (ring.to_submit > 0 || wait_nr > 0) {
+			if (ring_enter(ring.to_submit, wait_nr) < 0) {
+				exit(1);
+			}
+			ring.to_submit = 0;
+		}
+
+		unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe * cqe = &ring.cqes[head & *ring.cq_mask];
+			int op = cqe->user_data & OP_MASK;
+			struct uconn_t * conn = (struct uconn_t *)(unsigned long)(cqe->user_data & ~(unsigned long)OP_MASK);
+
+			if (op == OP_ACCEPT) {
+				on_accept(cqe->res, accept_addr.sin_addr);
+				prep_accept(listen_sk);
+			} else if (op == OP_ACCEPT_LOCAL) {
+				// local clients share the loopback rate limit
+				struct in_addr loopback = { htonl(INADDR_LOOPBACK) };
+				if (cqe->res >= 0) {
+					METRIC_ADD(local_conns, 1);
+				}
+				on_accept(cqe->res, loopback);
+				prep_accept_local(local_sk);
+			} else if (op == OP_TIMEOUT) {
+				expiring = 0;
+			} else if (op == OP_RECV) {
+				on_recv(conn, cqe->res);
+			} else if (op == OP_WRITEV) {
+				on_writev(conn, cqe->res);
+			} else if (op == OP_READ) {
+				on_read(conn, cqe->res);
+			}
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+		// shed queued connections that waited too long, close idle ones
+		int ms = expire_conns();
+		if (ms >= 0 && !expiring) {
+			prep_timeout(ms);
+		}
+	}
+}